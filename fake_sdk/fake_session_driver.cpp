@@ -0,0 +1,448 @@
+#include "fake_session_driver.h"
+#include <stdio.h>
+#include <fstream>
+#include <chrono>
+#include "json.hpp"
+#include "media_clock.h"
+using Json = nlohmann::json;
+using namespace std::chrono;
+
+// the SDK numbers its users from here, the bot is the first.
+static const unsigned int first_user_id = 16778240;
+
+bool FakeSessionDriver::Event::operator>(const Event &other) const
+{
+	if (at_us != other.at_us)
+		return at_us > other.at_us;
+	return seq > other.seq;
+}
+
+FakeSessionDriver::FakeSessionDriver(FakeVideoSDK *sdk, IZoomVideoSDKVirtualAudioSpeaker *speaker)
+{
+	sdk_ = sdk;
+	speaker_ = speaker;
+	stop_ = false;
+}
+
+FakeSessionDriver::~FakeSessionDriver()
+{
+	stop();
+	join();
+	for (auto iter = users_.begin(); iter != users_.end(); iter++)
+		delete iter->user;
+}
+
+static int64_t seconds_to_ms(const Json &object, const char *key, double fallback)
+{
+	return (int64_t)(object.value(key, fallback) * 1000.0);
+}
+
+int FakeSessionDriver::load(const char *fileName)
+{
+	std::ifstream file(fileName);
+	if (!file)
+	{
+		printf("Error open session script %s.\n", fileName);
+		return -1;
+	}
+	Json script;
+	try
+	{
+		file >> script;
+	}
+	catch (Json::exception &ex)
+	{
+		printf("Error parse session script %s: %s\n", fileName, ex.what());
+		return -1;
+	}
+
+	try
+	{
+		duration_ms_ = seconds_to_ms(script, "duration_s", 60.0);
+		virtual_time_ = script.value("virtual_time", false);
+		Json audio = script.value("audio", Json::object());
+		sample_rate_ = audio.value("sample_rate", 32000);
+		channels_ = audio.value("channels", 1);
+
+		Json users = script.value("users", Json::array());
+		for (size_t entry = 0; entry < users.size(); entry++)
+		{
+			const Json &json_user = users[entry];
+			Json video = json_user.value("video", Json());
+			Json talk = json_user.value("talk", Json());
+			Json share = json_user.value("share", Json());
+			Json changes = json_user.value("resolution_changes", Json::array());
+			std::string name = json_user.value("name", std::string("User"));
+			int count = json_user.value("count", 1);
+			int64_t join_ms = seconds_to_ms(json_user, "join_s", 0.0);
+			int64_t spacing_ms = seconds_to_ms(json_user, "join_spacing_s", 0.0);
+			int64_t leave_ms = seconds_to_ms(json_user, "leave_s", -0.001);
+
+			for (int copy = 0; copy < count; copy++)
+			{
+				UserScript s = UserScript();
+				int index = users_.size() + 1;
+				unsigned int id = first_user_id + index * 1024;
+				std::string user_name = count > 1 ? name + " " + std::to_string(copy + 1) : name;
+				s.user = new FakeUser(user_name, std::to_string(id), id);
+				s.join_ms = join_ms + spacing_ms * copy;
+				s.leave_ms = leave_ms;
+
+				s.video = video.is_object();
+				if (s.video)
+				{
+					s.width = video.value("width", 640);
+					s.height = video.value("height", 360);
+					s.fps = video.value("fps", 15);
+					s.rotation = video.value("rotation", 0);
+					s.full_range = video.value("full_range", false);
+				}
+				for (size_t change = 0; change < changes.size(); change++)
+				{
+					Change c;
+					c.at_ms = seconds_to_ms(changes[change], "at_s", 0.0);
+					c.width = changes[change].value("width", s.width);
+					c.height = changes[change].value("height", s.height);
+					c.rotation = changes[change].value("rotation", s.rotation);
+					s.changes.push_back(c);
+				}
+
+				if (talk.is_object())
+				{
+					// copies take turns instead of talking at once.
+					s.talk_ms = seconds_to_ms(talk, "talk_s", 3.0);
+					s.pause_ms = seconds_to_ms(talk, "pause_s", 5.0);
+					s.talk_start_ms = seconds_to_ms(talk, "start_s", 0.0) + s.talk_ms * copy;
+				}
+				s.tone_hz = 220.0 + 55.0 * (index % 8);
+
+				s.share = share.is_object();
+				if (s.share)
+				{
+					s.share_start_ms = seconds_to_ms(share, "start_s", 0.0);
+					s.share_stop_ms = seconds_to_ms(share, "stop_s", -0.001);
+					s.share_width = share.value("width", 1920);
+					s.share_height = share.value("height", 1080);
+					s.share_fps = share.value("fps", 5);
+					s.share_audio = share.value("audio", false);
+				}
+				users_.push_back(s);
+			}
+		}
+	}
+	catch (Json::exception &ex)
+	{
+		printf("Error in session script %s: %s\n", fileName, ex.what());
+		return -1;
+	}
+	printf("session script %s: %d users, %lld s%s\n", fileName, (int)users_.size(), (long long)duration_ms_ / 1000,
+		   virtual_time_ ? " on virtual time" : "");
+	return 0;
+}
+
+void FakeSessionDriver::schedule(int64_t at_us, EventType type, int user)
+{
+	Event event;
+	event.at_us = at_us;
+	event.seq = seq_++;
+	event.type = type;
+	event.user = user;
+	queue_.push(event);
+}
+
+void FakeSessionDriver::start()
+{
+	for (size_t index = 0; index < users_.size(); index++)
+	{
+		UserScript &s = users_[index];
+		schedule(s.join_ms * 1000, Event_Join, index);
+		if (s.leave_ms >= 0)
+			schedule(s.leave_ms * 1000, Event_Leave, index);
+	}
+	schedule(0, Event_Audio, -1);
+	schedule(duration_ms_ * 1000, Event_End, -1);
+	// the session clock runs from now, ahead of real time when nothing keeps it back.
+	if (virtual_time_ && !MediaClock::is_virtual())
+		MediaClock::start_virtual(time(NULL));
+	thread_ = std::thread(&FakeSessionDriver::run, this);
+}
+
+void FakeSessionDriver::join()
+{
+	if (thread_.joinable() && !in_driver_thread())
+		thread_.join();
+}
+
+void FakeSessionDriver::notify(const std::function<void(IZoomVideoSDKDelegate *)> &call)
+{
+	std::vector<IZoomVideoSDKDelegate *> listeners = sdk_->listeners();
+	for (auto iter = listeners.begin(); iter != listeners.end(); iter++)
+		call(*iter);
+}
+
+void FakeSessionDriver::run()
+{
+	// on virtual time the session moves on once this thread and the compositor wait.
+	MediaClock::attach();
+	steady_clock::time_point origin = MediaClock::now();
+	FakeSession *session = sdk_->session();
+	notify([](IZoomVideoSDKDelegate *listener) { listener->onSessionJoin(); });
+	// the SDK reports the bot itself as the first joined user.
+	batch_.push_back(session->getMyself());
+	flush_batch(Event_Join);
+
+	while (!queue_.empty())
+	{
+		int64_t now_us = duration_cast<microseconds>(MediaClock::now() - origin).count();
+		if (stop_)
+		{
+			// leaveSession(): end now instead of at the scripted time.
+			while (!queue_.empty())
+				queue_.pop();
+			schedule(now_us, Event_End, -1);
+		}
+		if (queue_.top().at_us > now_us)
+		{
+			MediaClock::sleep_until(origin + microseconds(queue_.top().at_us));
+			continue;
+		}
+
+		Event event = queue_.top();
+		queue_.pop();
+		if (event.type == Event_Join || event.type == Event_Leave)
+		{
+			// users joining or leaving at the same time are reported in one list.
+			if (event.type == Event_Join)
+			{
+				UserScript &s = users_[event.user];
+				s.joined = true;
+				s.user->video_on = s.video;
+				s.user->video_width = s.width;
+				s.user->video_height = s.height;
+				s.user->video_fps = s.fps;
+				session->add_remote(s.user);
+				batch_.push_back(s.user);
+			}
+			else
+			{
+				leave(event.user);
+			}
+			if (queue_.empty() || queue_.top().at_us != event.at_us || queue_.top().type != event.type)
+				flush_batch(event.type);
+			if (event.type == Event_Join)
+			{
+				// first frames and the share follow the join notification.
+				UserScript &s = users_[event.user];
+				if (s.video)
+					schedule(event.at_us, Event_VideoFrame, event.user);
+				if (!s.changes.empty())
+					schedule(s.changes[0].at_ms * 1000, Event_Change, event.user);
+				if (s.share && (s.share_stop_ms < 0 || s.share_stop_ms > s.join_ms))
+					schedule((s.share_start_ms > s.join_ms ? s.share_start_ms : s.join_ms) * 1000, Event_ShareStart, event.user);
+			}
+			continue;
+		}
+		dispatch(event, now_us);
+		if (event.type == Event_End)
+			break;
+	}
+	printf("session script finished: %lld video frames, %lld share frames, %lld frames dropped late\n",
+		   (long long)video_frames_, (long long)share_frames_, (long long)late_frames_);
+	notify([](IZoomVideoSDKDelegate *listener) { listener->onSessionLeave(); });
+	MediaClock::detach();
+}
+
+void FakeSessionDriver::flush_batch(EventType type)
+{
+	if (batch_.empty())
+		return;
+	FakeVector<IZoomVideoSDKUser *> list(batch_);
+	batch_.clear();
+	if (type == Event_Join)
+		notify([&list](IZoomVideoSDKDelegate *listener) { listener->onUserJoin(NULL, &list); });
+	else
+		notify([&list](IZoomVideoSDKDelegate *listener) { listener->onUserLeave(NULL, &list); });
+}
+
+void FakeSessionDriver::leave(int index)
+{
+	UserScript &s = users_[index];
+	if (!s.joined || s.left)
+		return;
+	s.left = true;
+	if (s.user->sharing)
+	{
+		s.user->sharing = false;
+		FakeUser *user = s.user;
+		notify([user](IZoomVideoSDKDelegate *listener) {
+			listener->onUserShareStatusChanged(NULL, user, ZoomVideoSDKShareStatus_Stop, ZoomVideoSDKShareType_Normal);
+		});
+	}
+	s.user->video_on = false;
+	s.user->talking = false;
+	sdk_->session()->remove_remote(s.user);
+	batch_.push_back(s.user);
+}
+
+// next time of a stream running at fps, frames that are already a whole
+// interval late are dropped like the SDK drops them for a slow receiver.
+static int64_t next_frame_us(int64_t at_us, int fps, int64_t now_us, int64_t *late)
+{
+	int64_t interval = 1000000 / (fps > 0 ? fps : 1);
+	int64_t next = at_us + interval;
+	while (next + interval <= now_us)
+	{
+		next += interval;
+		(*late)++;
+	}
+	return next;
+}
+
+void FakeSessionDriver::dispatch(const Event &event, int64_t now_us)
+{
+	UserScript *s = event.user >= 0 ? &users_[event.user] : NULL;
+	if (s && s->left)
+		return;
+
+	switch (event.type)
+	{
+	case Event_Change:
+	{
+		const Change &change = s->changes[s->next_change++];
+		s->width = change.width;
+		s->height = change.height;
+		s->rotation = change.rotation;
+		s->user->video_width = s->width;
+		s->user->video_height = s->height;
+		if (s->next_change < s->changes.size())
+			schedule(s->changes[s->next_change].at_ms * 1000, Event_Change, event.user);
+		break;
+	}
+	case Event_VideoFrame:
+		// each user starts at another phase, so equal cameras do not look alike.
+		s->user->video_pipe()->deliver(SyntheticMedia::Pattern_Camera, s->width, s->height, (int)(s->frame_count + event.user),
+									   s->rotation, s->full_range);
+		s->frame_count++;
+		video_frames_++;
+		schedule(next_frame_us(event.at_us, s->fps, now_us, &late_frames_), Event_VideoFrame, event.user);
+		break;
+	case Event_ShareStart:
+	{
+		FakeUser *user = s->user;
+		user->share_width = s->share_width;
+		user->share_height = s->share_height;
+		user->share_fps = s->share_fps;
+		user->sharing = true;
+		notify([user](IZoomVideoSDKDelegate *listener) {
+			listener->onUserShareStatusChanged(NULL, user, ZoomVideoSDKShareStatus_Start, ZoomVideoSDKShareType_Normal);
+		});
+		schedule(event.at_us, Event_ShareFrame, event.user);
+		if (s->share_stop_ms >= 0)
+			schedule(s->share_stop_ms * 1000, Event_ShareStop, event.user);
+		break;
+	}
+	case Event_ShareFrame:
+		if (!s->user->sharing)
+			break;
+		// a slide changes every two seconds, the frames in between repeat it.
+		s->user->share_pipe()->deliver(SyntheticMedia::Pattern_Share, s->share_width, s->share_height,
+									   (int)(s->share_frame_count / (s->share_fps * 2 > 0 ? s->share_fps * 2 : 1)), 0, false);
+		s->share_frame_count++;
+		share_frames_++;
+		schedule(next_frame_us(event.at_us, s->share_fps, now_us, &late_frames_), Event_ShareFrame, event.user);
+		break;
+	case Event_ShareStop:
+	{
+		FakeUser *user = s->user;
+		if (!user->sharing)
+			break;
+		user->sharing = false;
+		notify([user](IZoomVideoSDKDelegate *listener) {
+			listener->onUserShareStatusChanged(NULL, user, ZoomVideoSDKShareStatus_Stop, ZoomVideoSDKShareType_Normal);
+		});
+		break;
+	}
+	case Event_Audio:
+		deliver_audio(event.at_us / 1000);
+		// audio is not dropped, a late tick is caught up by the following ones.
+		schedule(event.at_us + audio_interval_ms * 1000, Event_Audio, -1);
+		break;
+	case Event_End:
+		for (size_t index = 0; index < users_.size(); index++)
+			leave(index);
+		flush_batch(Event_Leave);
+		break;
+	default:
+		break;
+	}
+}
+
+void FakeSessionDriver::deliver_audio(int64_t now_ms)
+{
+	int nb_samples = sample_rate_ * audio_interval_ms / 1000;
+	size_t count = (size_t)nb_samples * channels_;
+	samples_.resize(count);
+	mix_.assign(count, 0);
+	// without the virtual speaker audio reaches the delegate only after subscribing.
+	bool receiving = speaker_ || sdk_->audio_helper()->subscribed;
+	std::vector<IZoomVideoSDKUser *> active;
+
+	for (size_t index = 0; index < users_.size(); index++)
+	{
+		UserScript &s = users_[index];
+		if (!s.joined || s.left)
+			continue;
+		int64_t cycle = s.talk_ms + s.pause_ms;
+		bool talking = s.talk_ms > 0 && now_ms >= s.talk_start_ms && (now_ms - s.talk_start_ms) % cycle < s.talk_ms;
+		s.user->talking = talking;
+		if (talking)
+			active.push_back(s.user);
+
+		SyntheticMedia::tone(samples_.data(), nb_samples, channels_, sample_rate_, s.tone_hz, talking, s.audio_position);
+		s.audio_position += nb_samples;
+		for (size_t i = 0; i < count; i++)
+		{
+			int sum = mix_[i] + samples_[i];
+			mix_[i] = sum > 32767 ? 32767 : (sum < -32768 ? -32768 : sum);
+		}
+		if (!receiving)
+			continue;
+
+		FakeAudioRawData *data = new FakeAudioRawData(samples_.data(), nb_samples, sample_rate_, channels_);
+		FakeUser *user = s.user;
+		if (speaker_)
+			speaker_->onVirtualSpeakerOneWayAudioReceived(data, user);
+		else
+			notify([data, user](IZoomVideoSDKDelegate *listener) { listener->onOneWayAudioRawDataReceived(data, user); });
+		data->Release();
+
+		if (s.share_audio && user->sharing && (speaker_ || user->share_pipe()->shared_audio_subscribed()))
+		{
+			SyntheticMedia::tone(samples_.data(), nb_samples, channels_, sample_rate_, 440.0, true, now_ms * sample_rate_ / 1000);
+			FakeAudioRawData *shared = new FakeAudioRawData(samples_.data(), nb_samples, sample_rate_, channels_);
+			if (speaker_)
+				speaker_->onVirtualSpeakerSharedAudioReceived(shared);
+			else
+				notify([shared](IZoomVideoSDKDelegate *listener) { listener->onSharedAudioRawDataReceived(shared); });
+			shared->Release();
+		}
+	}
+
+	if (receiving)
+	{
+		FakeAudioRawData *mixed = new FakeAudioRawData(mix_.data(), nb_samples, sample_rate_, channels_);
+		if (speaker_)
+			speaker_->onVirtualSpeakerMixedAudioReceived(mixed);
+		else
+			notify([mixed](IZoomVideoSDKDelegate *listener) { listener->onMixedAudioRawDataReceived(mixed); });
+		mixed->Release();
+	}
+
+	if (active != active_)
+	{
+		active_ = active;
+		FakeVector<IZoomVideoSDKUser *> list(active);
+		IZoomVideoSDKAudioHelper *helper = sdk_->audio_helper();
+		notify([helper, &list](IZoomVideoSDKDelegate *listener) { listener->onUserActiveAudioChanged(helper, &list); });
+	}
+}
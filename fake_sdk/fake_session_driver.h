@@ -0,0 +1,124 @@
+#pragma once
+#include <stdint.h>
+#include <vector>
+#include <queue>
+#include <string>
+#include <thread>
+#include <atomic>
+#include <functional>
+
+#include "fake_video_sdk.h"
+
+// Plays the session script of the offline SDK on its own thread: users join and
+// leave, change resolution, talk and share at the scripted times, and their
+// synthetic camera, share and audio frames are delivered at the scripted rates.
+// The script is a JSON file, see fake_sdk/fake_session.json. All times are in
+// seconds from the session join; a user with "count" > 1 is repeated that many
+// times, "join_spacing_s" apart.
+class FakeSessionDriver
+{
+	struct Change
+	{
+		int64_t at_ms;
+		int width;
+		int height;
+		unsigned int rotation;
+	};
+	struct UserScript
+	{
+		FakeUser* user;
+		int64_t join_ms;
+		int64_t leave_ms; // -1: stays until the session ends
+		// camera
+		bool video;
+		int width;
+		int height;
+		int fps;
+		unsigned int rotation;
+		bool full_range;
+		std::vector<Change> changes;
+		// talk spurts of talk_ms every talk_ms + pause_ms, from talk_start_ms
+		int64_t talk_start_ms;
+		int64_t talk_ms;
+		int64_t pause_ms;
+		double tone_hz;
+		// screen share
+		bool share;
+		int64_t share_start_ms;
+		int64_t share_stop_ms;
+		int share_width;
+		int share_height;
+		int share_fps;
+		bool share_audio;
+
+		// playback state
+		bool joined;
+		bool left;
+		size_t next_change;
+		int64_t frame_count;
+		int64_t share_frame_count;
+		int64_t audio_position;
+	};
+	typedef enum
+	{
+		Event_Join,
+		Event_Leave,
+		Event_Change,
+		Event_VideoFrame,
+		Event_ShareStart,
+		Event_ShareFrame,
+		Event_ShareStop,
+		Event_Audio,
+		Event_End,
+	} EventType;
+	struct Event
+	{
+		int64_t at_us;
+		int seq; // keeps events of the same time in scheduling order
+		EventType type;
+		int user;
+		bool operator>(const Event& other) const;
+	};
+
+	FakeVideoSDK* sdk_;
+	IZoomVideoSDKVirtualAudioSpeaker* speaker_;
+	std::vector<UserScript> users_;
+	int64_t duration_ms_ = 60000;
+	bool virtual_time_ = false; // run on MediaClock's virtual time, as fast as the bot keeps up
+	int sample_rate_ = 32000;
+	int channels_ = 1;
+	static const int audio_interval_ms = 10;
+
+	std::priority_queue<Event, std::vector<Event>, std::greater<Event> > queue_;
+	int seq_ = 0;
+	std::vector<IZoomVideoSDKUser*> batch_;
+	std::vector<IZoomVideoSDKUser*> active_;
+	std::vector<int16_t> samples_;
+	std::vector<int16_t> mix_;
+
+	std::thread thread_;
+	std::atomic<bool> stop_;
+	int64_t video_frames_ = 0;
+	int64_t share_frames_ = 0;
+	int64_t late_frames_ = 0;
+
+	void schedule(int64_t at_us, EventType type, int user);
+	void run();
+	void dispatch(const Event& event, int64_t now_us);
+	void flush_batch(EventType type);
+	void leave(int index);
+	void deliver_audio(int64_t now_ms);
+	void notify(const std::function<void(IZoomVideoSDKDelegate*)>& call);
+
+public:
+	FakeSessionDriver(FakeVideoSDK* sdk, IZoomVideoSDKVirtualAudioSpeaker* speaker);
+	~FakeSessionDriver();
+
+	// parse the script and create its users. Returns 0 on success.
+	int load(const char* fileName);
+	void start();
+	// ends the session at the next tick; only sets a flag, safe from a signal handler.
+	void stop() { stop_ = true; }
+	bool in_driver_thread() { return std::this_thread::get_id() == thread_.get_id(); }
+	void join();
+};
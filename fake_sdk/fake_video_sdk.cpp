@@ -0,0 +1,403 @@
+#include "fake_video_sdk.h"
+#include "fake_session_driver.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+
+FakeYUVRawData::FakeYUVRawData(const char *buffer, int width, int height, unsigned int rotation, bool full_range,
+							   unsigned int source_id)
+{
+	buffer_ = const_cast<char *>(buffer);
+	width_ = width;
+	height_ = height;
+	rotation_ = rotation;
+	full_range_ = full_range;
+	source_id_ = source_id;
+}
+
+unsigned int FakeYUVRawData::GetBufferLen()
+{
+	return width_ * height_ + ((width_ + 1) / 2) * ((height_ + 1) / 2) * 2;
+}
+
+FakeAudioRawData::FakeAudioRawData(const int16_t *samples, int nb_samples, unsigned int sample_rate, unsigned int channels)
+	: buffer_((const char *)samples, (const char *)(samples + nb_samples * channels)), refs_(1)
+{
+	sample_rate_ = sample_rate;
+	channels_ = channels;
+}
+
+bool FakeAudioRawData::AddRef()
+{
+	refs_++;
+	return true;
+}
+
+int FakeAudioRawData::Release()
+{
+	int refs = --refs_;
+	if (refs == 0)
+		delete this;
+	return refs;
+}
+
+FakeRawDataPipe::FakeRawDataPipe(FakeUser *owner, ZoomVideoSDKRawDataType type)
+{
+	owner_ = owner;
+	type_ = type;
+	shared_audio_ = false;
+}
+
+ZoomVideoSDKErrors FakeRawDataPipe::subscribe(ZoomVideoSDKResolution resolution, IZoomVideoSDKRawDataPipeDelegate *listener)
+{
+	if (!listener)
+		return ZoomVideoSDKErrors_Invalid_Parameter;
+	std::lock_guard<std::recursive_mutex> lock(mutex_);
+	for (auto iter = listeners_.begin(); iter != listeners_.end(); iter++)
+	{
+		if (iter->delegate == listener)
+		{
+			iter->resolution = resolution;
+			return ZoomVideoSDKErrors_Success;
+		}
+	}
+	Listener entry = {listener, resolution};
+	listeners_.push_back(entry);
+	return ZoomVideoSDKErrors_Success;
+}
+
+ZoomVideoSDKErrors FakeRawDataPipe::unSubscribe(IZoomVideoSDKRawDataPipeDelegate *listener)
+{
+	std::lock_guard<std::recursive_mutex> lock(mutex_);
+	for (auto iter = listeners_.begin(); iter != listeners_.end(); iter++)
+	{
+		if (iter->delegate == listener)
+		{
+			listeners_.erase(iter);
+			return ZoomVideoSDKErrors_Success;
+		}
+	}
+	return ZoomVideoSDKErrors_Wrong_Usage;
+}
+
+ZoomVideoSDKErrors FakeRawDataPipe::subscribeToSharedComputerAudio()
+{
+	if (type_ != RAW_DATA_TYPE_SHARE)
+		return ZoomVideoSDKErrors_Wrong_Usage;
+	shared_audio_ = true;
+	return ZoomVideoSDKErrors_Success;
+}
+
+ZoomVideoSDKErrors FakeRawDataPipe::unsubscribeToSharedComputerAudio()
+{
+	shared_audio_ = false;
+	return ZoomVideoSDKErrors_Success;
+}
+
+ZoomVideoSDKVideoStatus FakeRawDataPipe::getVideoStatus()
+{
+	return owner_->getVideoStatus();
+}
+
+ZoomVideoSDKShareStatus FakeRawDataPipe::getShareStatus()
+{
+	return owner_->getShareStatus();
+}
+
+ZoomVideoSDKShareType FakeRawDataPipe::getShareType()
+{
+	return owner_->sharing ? ZoomVideoSDKShareType_Normal : ZoomVideoSDKShareType_None;
+}
+
+int FakeRawDataPipe::listener_count()
+{
+	std::lock_guard<std::recursive_mutex> lock(mutex_);
+	return listeners_.size();
+}
+
+// largest size of the stream that fits the subscribed resolution, the long side
+// against the long side so portrait streams are not shrunk twice.
+static void fit_resolution(ZoomVideoSDKResolution resolution, int *width, int *height)
+{
+	int cap_long, cap_short;
+	switch (resolution)
+	{
+	case ZoomVideoSDKResolution_90P:
+		cap_long = 160, cap_short = 90;
+		break;
+	case ZoomVideoSDKResolution_180P:
+		cap_long = 320, cap_short = 180;
+		break;
+	case ZoomVideoSDKResolution_360P:
+		cap_long = 640, cap_short = 360;
+		break;
+	case ZoomVideoSDKResolution_720P:
+		cap_long = 1280, cap_short = 720;
+		break;
+	default:
+		return;
+	}
+	int long_side = std::max(*width, *height), short_side = std::min(*width, *height);
+	if (long_side <= cap_long && short_side <= cap_short)
+		return;
+	double scale = std::min((double)cap_long / long_side, (double)cap_short / short_side);
+	*width = std::max(2, (int)(*width * scale) & ~1);
+	*height = std::max(2, (int)(*height * scale) & ~1);
+}
+
+void FakeRawDataPipe::deliver(SyntheticMedia::Pattern pattern, int width, int height, int phase, unsigned int rotation,
+							  bool full_range)
+{
+	std::lock_guard<std::recursive_mutex> lock(mutex_);
+	// by index: a listener may unsubscribe itself from the callback.
+	for (size_t index = 0; index < listeners_.size(); index++)
+	{
+		Listener listener = listeners_[index];
+		int w = width, h = height;
+		if (type_ == RAW_DATA_TYPE_VIDEO)
+			fit_resolution(listener.resolution, &w, &h);
+		FakeYUVRawData data(SyntheticMedia::frame(pattern, w, h, phase), w, h, rotation, full_range, owner_->source_id());
+		listener.delegate->onRawDataFrameReceived(&data);
+		if (index < listeners_.size() && listeners_[index].delegate != listener.delegate)
+			index--;
+	}
+}
+
+void FakeRawDataPipe::deliver(YUVRawDataI420 *data)
+{
+	std::lock_guard<std::recursive_mutex> lock(mutex_);
+	for (size_t index = 0; index < listeners_.size(); index++)
+	{
+		IZoomVideoSDKRawDataPipeDelegate *delegate = listeners_[index].delegate;
+		delegate->onRawDataFrameReceived(data);
+		if (index < listeners_.size() && listeners_[index].delegate != delegate)
+			index--;
+	}
+}
+
+FakeUser::FakeUser(const std::string &name, const std::string &id, unsigned int source_id)
+	: name_(name), id_(id), source_id_(source_id), video_pipe_(this, RAW_DATA_TYPE_VIDEO),
+	  share_pipe_(this, RAW_DATA_TYPE_SHARE)
+{
+	video_on = false;
+	sharing = false;
+	talking = false;
+	video_width = 0;
+	video_height = 0;
+	video_fps = 0;
+	share_width = 0;
+	share_height = 0;
+	share_fps = 0;
+}
+
+FakeUser::~FakeUser()
+{
+	for (auto iter = cameras_.items.begin(); iter != cameras_.items.end(); iter++)
+		delete static_cast<FakeRawDataPipe *>(*iter);
+}
+
+FakeRawDataPipe *FakeUser::camera_pipe(int camera)
+{
+	while ((int)cameras_.items.size() < camera)
+		cameras_.items.push_back(new FakeRawDataPipe(this, RAW_DATA_TYPE_VIDEO));
+	return camera > 0 ? static_cast<FakeRawDataPipe *>(cameras_.items[camera - 1]) : &video_pipe_;
+}
+
+ZoomVideoSDKVideoStatus FakeUser::getVideoStatus()
+{
+	ZoomVideoSDKVideoStatus status;
+	status.isHasVideoDevice = video_on;
+	status.isOn = video_on;
+	return status;
+}
+
+ZoomVideoSDKAudioStatus FakeUser::getAudioStatus()
+{
+	ZoomVideoSDKAudioStatus status;
+	status.audioType = ZoomVideoSDKAudioType_VOIP;
+	status.isMuted = false;
+	status.isTalking = talking;
+	return status;
+}
+
+ZoomVideoSDKShareStatus FakeUser::getShareStatus()
+{
+	return sharing ? ZoomVideoSDKShareStatus_Start : ZoomVideoSDKShareStatus_None;
+}
+
+ZoomVideoSDKVideoStatisticInfo FakeUser::getVideoStatisticInfo()
+{
+	ZoomVideoSDKVideoStatisticInfo info;
+	info.width = video_width;
+	info.height = video_height;
+	info.fps = video_fps;
+	info.bpf = 0;
+	return info;
+}
+
+ZoomVideoSDKShareStatisticInfo FakeUser::getShareStatisticInfo()
+{
+	ZoomVideoSDKShareStatisticInfo info;
+	info.width = share_width;
+	info.height = share_height;
+	info.fps = share_fps;
+	info.bpf = 0;
+	return info;
+}
+
+FakeSession::FakeSession(const std::string &name, const std::string &password, FakeUser *myself)
+	: name_(name), password_(password), myself_(myself)
+{
+}
+
+FakeSession::~FakeSession()
+{
+	delete myself_;
+}
+
+void FakeSession::add_remote(FakeUser *user)
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	remote_.push_back(user);
+}
+
+void FakeSession::remove_remote(FakeUser *user)
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	remote_.erase(std::remove(remote_.begin(), remote_.end(), user), remote_.end());
+}
+
+IVideoSDKVector<IZoomVideoSDKUser *> *FakeSession::getRemoteUsers()
+{
+	// like the SDK, the list is owned by the session and replaced by the next call.
+	std::lock_guard<std::mutex> lock(mutex_);
+	remote_snapshot_.items.assign(remote_.begin(), remote_.end());
+	return &remote_snapshot_;
+}
+
+bool FakeSession::IsValidUser(IZoomVideoSDKUser *pUser)
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	return pUser == myself_ || std::find(remote_.begin(), remote_.end(), pUser) != remote_.end();
+}
+
+ZoomVideoSDKErrors FakeAudioHelper::subscribe()
+{
+	subscribed = true;
+	return ZoomVideoSDKErrors_Success;
+}
+
+ZoomVideoSDKErrors FakeAudioHelper::unSubscribe()
+{
+	subscribed = false;
+	return ZoomVideoSDKErrors_Success;
+}
+
+FakeVideoSDK::FakeVideoSDK()
+{
+	initialized_ = false;
+	session_ = NULL;
+	driver_ = NULL;
+}
+
+FakeVideoSDK::~FakeVideoSDK()
+{
+	cleanup();
+}
+
+std::vector<IZoomVideoSDKDelegate *> FakeVideoSDK::listeners()
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	return listeners_;
+}
+
+ZoomVideoSDKErrors FakeVideoSDK::initialize(ZoomVideoSDKInitParams &params)
+{
+	initialized_ = true;
+	printf("offline video sdk: no session is joined, users and media come from a session script.\n");
+	return ZoomVideoSDKErrors_Success;
+}
+
+ZoomVideoSDKErrors FakeVideoSDK::cleanup()
+{
+	if (driver_)
+	{
+		driver_->stop();
+		// called from a callback the driver finishes on its own.
+		if (driver_->in_driver_thread())
+			return ZoomVideoSDKErrors_Wrong_Usage;
+		delete driver_;
+		driver_ = NULL;
+	}
+	delete session_;
+	session_ = NULL;
+	initialized_ = false;
+	return ZoomVideoSDKErrors_Success;
+}
+
+void FakeVideoSDK::addListener(IZoomVideoSDKDelegate *listener)
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	if (listener && std::find(listeners_.begin(), listeners_.end(), listener) == listeners_.end())
+		listeners_.push_back(listener);
+}
+
+void FakeVideoSDK::removeListener(IZoomVideoSDKDelegate *listener)
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	listeners_.erase(std::remove(listeners_.begin(), listeners_.end(), listener), listeners_.end());
+}
+
+IZoomVideoSDKSession *FakeVideoSDK::joinSession(ZoomVideoSDKSessionContext &params)
+{
+	if (!initialized_ || session_)
+		return NULL;
+
+	const char *script = getenv("FAKE_SDK_SCRIPT");
+	if (!script || !*script)
+		script = "fake_session.json";
+	FakeUser *myself = new FakeUser(params.userName ? params.userName : "", "16778240", 16778240);
+	session_ = new FakeSession(params.sessionName ? params.sessionName : "",
+							   params.sessionPassword ? params.sessionPassword : "", myself);
+	driver_ = new FakeSessionDriver(this, params.virtualAudioSpeaker);
+	if (driver_->load(script) != 0)
+	{
+		delete driver_;
+		driver_ = NULL;
+		delete session_;
+		session_ = NULL;
+		std::vector<IZoomVideoSDKDelegate *> targets = listeners();
+		for (auto iter = targets.begin(); iter != targets.end(); iter++)
+			(*iter)->onError(ZoomVideoSDKErrors_Invalid_Parameter, 0);
+		return NULL;
+	}
+	driver_->start();
+	return session_;
+}
+
+ZoomVideoSDKErrors FakeVideoSDK::leaveSession(bool end)
+{
+	// may run in a signal handler, the driver ends the session on its thread.
+	if (!driver_)
+		return ZoomVideoSDKErrors_Wrong_Usage;
+	driver_->stop();
+	return ZoomVideoSDKErrors_Success;
+}
+
+static FakeVideoSDK *sdk_instance = NULL;
+
+BEGIN_ZOOM_VIDEO_SDK_NAMESPACE
+IZoomVideoSDK *CreateZoomVideoSDKObj()
+{
+	if (!sdk_instance)
+		sdk_instance = new FakeVideoSDK();
+	return sdk_instance;
+}
+
+void DestroyZoomVideoSDKObj()
+{
+	delete sdk_instance;
+	sdk_instance = NULL;
+}
+END_ZOOM_VIDEO_SDK_NAMESPACE
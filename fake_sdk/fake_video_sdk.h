@@ -0,0 +1,266 @@
+#pragma once
+#include <vector>
+#include <string>
+#include <mutex>
+#include <atomic>
+
+// Zoom Video SDK
+#include "zoom_video_sdk_api.h"
+#include "zoom_video_sdk_def.h"
+#include "zoom_video_sdk_interface.h"
+#include "zoom_video_sdk_delegate_interface.h"
+#include "zoom_video_sdk_session_info_interface.h"
+#include "helpers/zoom_video_sdk_user_helper_interface.h"
+#include "helpers/zoom_video_sdk_audio_helper_interface.h"
+#include "helpers/zoom_video_sdk_audio_send_rawdata_interface.h"
+using namespace ZOOMVIDEOSDK;
+
+#include "synthetic_media.h"
+
+// Offline stand-in for the Video SDK library. It implements the part of the SDK
+// the bot uses and plays a scripted session (see FakeSessionDriver) instead of
+// joining a real one, so the bot can be run and loaded without network or token.
+// Everything is delivered from the driver thread.
+
+class FakeSessionDriver;
+
+template <class T>
+class FakeVector : public IVideoSDKVector<T>
+{
+public:
+	std::vector<T> items;
+
+	FakeVector() {}
+	FakeVector(const std::vector<T>& from) : items(from) {}
+	virtual int GetCount() { return (int)items.size(); }
+	virtual T GetItem(int index) { return index >= 0 && index < (int)items.size() ? items[index] : T(); }
+};
+
+// a frame from the SyntheticMedia cache, only valid during the callback.
+class FakeYUVRawData : public YUVRawDataI420
+{
+	char* buffer_;
+	int width_;
+	int height_;
+	unsigned int rotation_;
+	bool full_range_;
+	unsigned int source_id_;
+
+public:
+	FakeYUVRawData(const char* buffer, int width, int height, unsigned int rotation, bool full_range, unsigned int source_id);
+	virtual bool CanAddRef() { return false; }
+	virtual bool AddRef() { return false; }
+	virtual int Release() { return 0; }
+	virtual char* GetYBuffer() { return buffer_; }
+	virtual char* GetUBuffer() { return buffer_ + width_ * height_; }
+	virtual char* GetVBuffer() { return GetUBuffer() + ((width_ + 1) / 2) * ((height_ + 1) / 2); }
+	virtual char* GetBuffer() { return buffer_; }
+	virtual unsigned int GetBufferLen();
+	virtual bool IsLimitedI420() { return !full_range_; }
+	virtual unsigned int GetStreamWidth() { return width_; }
+	virtual unsigned int GetStreamHeight() { return height_; }
+	virtual unsigned int GetRotation() { return rotation_; }
+	virtual unsigned int GetSourceID() { return source_id_; }
+};
+
+// reference counted like the SDK's heap mode buffers: created with one reference
+// held by the driver, deleted by the last Release().
+class FakeAudioRawData : public AudioRawData
+{
+	std::vector<char> buffer_;
+	unsigned int sample_rate_;
+	unsigned int channels_;
+	std::atomic<int> refs_;
+
+public:
+	FakeAudioRawData(const int16_t* samples, int nb_samples, unsigned int sample_rate, unsigned int channels);
+	virtual bool CanAddRef() { return true; }
+	virtual bool AddRef();
+	virtual int Release();
+	virtual char* GetBuffer() { return buffer_.data(); }
+	virtual unsigned int GetBufferLen() { return buffer_.size(); }
+	virtual unsigned int GetSampleRate() { return sample_rate_; }
+	virtual unsigned int GetChannelNum() { return channels_; }
+};
+
+class FakeUser;
+
+class FakeRawDataPipe : public IZoomVideoSDKRawDataPipe
+{
+	struct Listener
+	{
+		IZoomVideoSDKRawDataPipeDelegate* delegate;
+		ZoomVideoSDKResolution resolution;
+	};
+	// recursive: listeners may change their subscription from inside a callback.
+	// A listener removed by unSubscribe() is never called again once it returns.
+	std::recursive_mutex mutex_;
+	std::vector<Listener> listeners_;
+	FakeUser* owner_;
+	ZoomVideoSDKRawDataType type_;
+	std::atomic<bool> shared_audio_;
+
+public:
+	FakeRawDataPipe(FakeUser* owner, ZoomVideoSDKRawDataType type);
+	virtual ~FakeRawDataPipe() {}
+
+	virtual ZoomVideoSDKErrors subscribe(ZoomVideoSDKResolution resolution, IZoomVideoSDKRawDataPipeDelegate* listener);
+	virtual ZoomVideoSDKErrors unSubscribe(IZoomVideoSDKRawDataPipeDelegate* listener);
+	virtual ZoomVideoSDKErrors subscribeToSharedComputerAudio();
+	virtual ZoomVideoSDKErrors unsubscribeToSharedComputerAudio();
+	virtual ZoomVideoSDKRawDataType getRawdataType() { return type_; }
+	virtual ZoomVideoSDKVideoStatus getVideoStatus();
+	virtual ZoomVideoSDKShareStatus getShareStatus();
+	virtual ZoomVideoSDKShareType getShareType();
+
+	// driver side. Camera frames are scaled down to each listener's resolution
+	// the way the SDK does, shares always come at their own size.
+	void deliver(SyntheticMedia::Pattern pattern, int width, int height, int phase, unsigned int rotation, bool full_range);
+	// a frame as it is, e.g. read back from a capture.
+	void deliver(YUVRawDataI420* data);
+	bool shared_audio_subscribed() { return shared_audio_; }
+	int listener_count();
+};
+
+class FakeUser : public IZoomVideoSDKUser
+{
+	std::string name_;
+	std::string id_;
+	unsigned int source_id_;
+	FakeRawDataPipe video_pipe_;
+	FakeRawDataPipe share_pipe_;
+	FakeVector<IZoomVideoSDKRawDataPipe*> cameras_;
+
+public:
+	// written by the driver, read by the pipes and the getters.
+	std::atomic<bool> video_on;
+	std::atomic<bool> sharing;
+	std::atomic<bool> talking;
+	std::atomic<int> video_width;
+	std::atomic<int> video_height;
+	std::atomic<int> video_fps;
+	std::atomic<int> share_width;
+	std::atomic<int> share_height;
+	std::atomic<int> share_fps;
+
+	FakeUser(const std::string& name, const std::string& id, unsigned int source_id);
+	virtual ~FakeUser();
+	unsigned int source_id() { return source_id_; }
+	FakeRawDataPipe* video_pipe() { return &video_pipe_; }
+	FakeRawDataPipe* share_pipe() { return &share_pipe_; }
+	// additional camera, 1-based like the encoder numbers them. Created on first use.
+	FakeRawDataPipe* camera_pipe(int camera);
+	// driver thread only, nothing reads the name concurrently with it.
+	void set_name(const std::string& name) { name_ = name; }
+
+	virtual const zchar_t* getCustomIdentity() { return ""; }
+	virtual const zchar_t* getUserName() { return name_.c_str(); }
+	virtual const zchar_t* getUserID() { return id_.c_str(); }
+	virtual ZoomVideoSDKVideoStatus getVideoStatus();
+	virtual ZoomVideoSDKAudioStatus getAudioStatus();
+	virtual ZoomVideoSDKShareStatus getShareStatus();
+	virtual bool isHost() { return false; }
+	virtual bool isManager() { return false; }
+	virtual ZoomVideoSDKVideoStatisticInfo getVideoStatisticInfo();
+	virtual ZoomVideoSDKShareStatisticInfo getShareStatisticInfo();
+	virtual IZoomVideoSDKRawDataPipe* GetVideoPipe() { return &video_pipe_; }
+	virtual IZoomVideoSDKRawDataPipe* GetSharePipe() { return &share_pipe_; }
+	virtual IZoomVideoSDKRemoteCameraControlHelper* getRemoteCameraControlHelper() { return NULL; }
+	virtual IVideoSDKVector<IZoomVideoSDKRawDataPipe*>* getMultiCameraStreamList() { return &cameras_; }
+	virtual IZoomVideoSDKLiveTranscriptionHelper* getLiveTranscriptionHelper() { return NULL; }
+};
+
+class FakeSession : public IZoomVideoSDKSession
+{
+	std::mutex mutex_;
+	std::string name_;
+	std::string password_;
+	FakeUser* myself_;
+	std::vector<FakeUser*> remote_;
+	FakeVector<IZoomVideoSDKUser*> remote_snapshot_;
+
+public:
+	// the session owns myself, the remote users belong to the driver.
+	FakeSession(const std::string& name, const std::string& password, FakeUser* myself);
+	virtual ~FakeSession();
+
+	void add_remote(FakeUser* user);
+	void remove_remote(FakeUser* user);
+
+	virtual const zchar_t* getSessionName() { return name_.c_str(); }
+	virtual const zchar_t* getSessionPassword() { return password_.c_str(); }
+	virtual const zchar_t* getSessionID() { return "offline"; }
+	virtual const zchar_t* getSessionHostName() { return myself_->getUserName(); }
+	virtual IZoomVideoSDKUser* getSessionHost() { return myself_; }
+	virtual IVideoSDKVector<IZoomVideoSDKUser*>* getRemoteUsers();
+	virtual IZoomVideoSDKUser* getMyself() { return myself_; }
+	virtual bool IsValidUser(IZoomVideoSDKUser* pUser);
+	virtual ZoomVideoSDKErrors getSessionAudioStatisticInfo(ZoomVideoSDKSessionAudioStatisticInfo& send_info, ZoomVideoSDKSessionAudioStatisticInfo& recv_info) { return ZoomVideoSDKErrors_No_Impl; }
+	virtual ZoomVideoSDKErrors getSessionVideoStatisticInfo(ZoomVideoSDKSessionASVStatisticInfo& send_info, ZoomVideoSDKSessionASVStatisticInfo& recv_info) { return ZoomVideoSDKErrors_No_Impl; }
+	virtual ZoomVideoSDKErrors getSessionShareStatisticInfo(ZoomVideoSDKSessionASVStatisticInfo& send_info, ZoomVideoSDKSessionASVStatisticInfo& recv_info) { return ZoomVideoSDKErrors_No_Impl; }
+};
+
+class FakeAudioHelper : public IZoomVideoSDKAudioHelper
+{
+	FakeVector<IZoomVideoSDKSpeakerDevice*> speakers_;
+	FakeVector<IZoomVideoSDKMicDevice*> mics_;
+
+public:
+	// one-way, mixed and shared audio reach the delegate only while subscribed.
+	std::atomic<bool> subscribed;
+
+	FakeAudioHelper() : subscribed(false) {}
+	virtual ZoomVideoSDKErrors startAudio() { return ZoomVideoSDKErrors_Success; }
+	virtual ZoomVideoSDKErrors stopAudio() { return ZoomVideoSDKErrors_Success; }
+	virtual ZoomVideoSDKErrors muteAudio(IZoomVideoSDKUser* pUser) { return ZoomVideoSDKErrors_Success; }
+	virtual ZoomVideoSDKErrors unMuteAudio(IZoomVideoSDKUser* pUser) { return ZoomVideoSDKErrors_Success; }
+	virtual int setSpeaker(bool speaker) { return 0; }
+	virtual bool getSpeakerStatus() { return false; }
+	virtual bool canSwitchSpeaker() { return false; }
+	virtual IVideoSDKVector<IZoomVideoSDKSpeakerDevice*>* getSpeakerList() { return &speakers_; }
+	virtual IVideoSDKVector<IZoomVideoSDKMicDevice*>* getMicList() { return &mics_; }
+	virtual ZoomVideoSDKErrors selectSpeaker(const zchar_t* deviceId, const zchar_t* deviceName) { return ZoomVideoSDKErrors_Success; }
+	virtual ZoomVideoSDKErrors selectMic(const zchar_t* deviceId, const zchar_t* deviceName) { return ZoomVideoSDKErrors_Success; }
+	virtual ZoomVideoSDKErrors subscribe();
+	virtual ZoomVideoSDKErrors unSubscribe();
+};
+
+class FakeVideoSDK : public IZoomVideoSDK
+{
+	std::mutex mutex_;
+	std::vector<IZoomVideoSDKDelegate*> listeners_;
+	bool initialized_;
+	FakeSession* session_;
+	FakeAudioHelper audio_helper_;
+	FakeSessionDriver* driver_;
+
+public:
+	FakeVideoSDK();
+	virtual ~FakeVideoSDK();
+
+	// snapshot, the driver calls the listeners without holding the lock.
+	std::vector<IZoomVideoSDKDelegate*> listeners();
+	FakeSession* session() { return session_; }
+	FakeAudioHelper* audio_helper() { return &audio_helper_; }
+
+	virtual ZoomVideoSDKErrors initialize(ZoomVideoSDKInitParams& params);
+	virtual ZoomVideoSDKErrors cleanup();
+	virtual void addListener(IZoomVideoSDKDelegate* listener);
+	virtual void removeListener(IZoomVideoSDKDelegate* listener);
+	virtual IZoomVideoSDKSession* joinSession(ZoomVideoSDKSessionContext& params);
+	virtual ZoomVideoSDKErrors leaveSession(bool end);
+	virtual IZoomVideoSDKSession* getSessionInfo() { return session_; }
+	virtual bool isInSession() { return session_ != NULL; }
+	virtual const zchar_t* getSDKVersion() { return "offline"; }
+	virtual IZoomVideoSDKAudioHelper* getAudioHelper() { return &audio_helper_; }
+	virtual IZoomVideoSDKVideoHelper* getVideoHelper() { return NULL; }
+	virtual IZoomVideoSDKRecordingHelper* getRecordingHelper() { return NULL; }
+	virtual IZoomVideoSDKUserHelper* getUserHelper() { return NULL; }
+	virtual IZoomVideoSDKShareHelper* getShareHelper() { return NULL; }
+	virtual IZoomVideoSDKLiveStreamHelper* getLiveStreamHelper() { return NULL; }
+	virtual IZoomVideoSDKPhoneHelper* getPhoneHelper() { return NULL; }
+	virtual IZoomVideoSDKChatHelper* getChatHelper() { return NULL; }
+	virtual IZoomVideoSDKCmdChannel* getCmdChannel() { return NULL; }
+	virtual IZoomVideoSDKAudioSettingHelper* getAudioSettingHelper() { return NULL; }
+	virtual IZoomVideoSDKTestAudioDeviceHelper* GetAudioDeviceTestHelper() { return NULL; }
+};
@@ -0,0 +1,110 @@
+#include "synthetic_media.h"
+#include <math.h>
+#include <string.h>
+
+std::mutex SyntheticMedia::mutex_;
+std::map<SyntheticMedia::Key, std::vector<char>*> SyntheticMedia::cache_;
+
+bool SyntheticMedia::Key::operator<(const Key &other) const
+{
+	if (pattern != other.pattern)
+		return pattern < other.pattern;
+	if (width != other.width)
+		return width < other.width;
+	if (height != other.height)
+		return height < other.height;
+	return phase < other.phase;
+}
+
+const char *SyntheticMedia::frame(Pattern pattern, int width, int height, int phase)
+{
+	int phases = pattern == Pattern_Camera ? camera_phases : share_phases;
+	Key key = {pattern, width, height, phase % phases};
+
+	std::lock_guard<std::mutex> lock(mutex_);
+	auto iter = cache_.find(key);
+	if (iter != cache_.end())
+		return iter->second->data();
+
+	int uv_width = (width + 1) / 2, uv_height = (height + 1) / 2;
+	// frames are never freed, the pipes hand out pointers into them.
+	std::vector<char> *buffer = new std::vector<char>((size_t)width * height + (size_t)uv_width * uv_height * 2);
+	if (pattern == Pattern_Camera)
+		draw_camera(buffer->data(), width, height, key.phase);
+	else
+		draw_share(buffer->data(), width, height, key.phase);
+	cache_[key] = buffer;
+	return buffer->data();
+}
+
+void SyntheticMedia::draw_camera(char *buffer, int width, int height, int phase)
+{
+	int uv_width = (width + 1) / 2, uv_height = (height + 1) / 2;
+	uint8_t *y_plane = (uint8_t *)buffer;
+	uint8_t *u_plane = y_plane + width * height;
+	uint8_t *v_plane = u_plane + uv_width * uv_height;
+
+	// diagonal gradient scrolling with the phase, in 16..235.
+	for (int y = 0; y < height; y++)
+		for (int x = 0; x < width; x++)
+			y_plane[y * width + x] = (uint8_t)(16 + ((x + y + phase * 8) * 219 / (width + height)) % 220);
+	memset(u_plane, 128, uv_width * uv_height);
+	memset(v_plane, 128, uv_width * uv_height);
+
+	// a box a quarter of the frame wide walks from left to right over the phases.
+	int box_w = width / 4 & ~1, box_h = height / 4 & ~1;
+	int box_x = (width - box_w) * phase / (camera_phases - 1) & ~1;
+	int box_y = (height - box_h) / 2 & ~1;
+	for (int y = box_y; y < box_y + box_h; y++)
+		memset(y_plane + y * width + box_x, 200, box_w);
+	for (int y = box_y / 2; y < (box_y + box_h) / 2; y++)
+	{
+		memset(u_plane + y * uv_width + box_x / 2, 90, box_w / 2);
+		memset(v_plane + y * uv_width + box_x / 2, 190, box_w / 2);
+	}
+}
+
+void SyntheticMedia::draw_share(char *buffer, int width, int height, int phase)
+{
+	int uv_width = (width + 1) / 2, uv_height = (height + 1) / 2;
+	uint8_t *y_plane = (uint8_t *)buffer;
+	uint8_t *u_plane = y_plane + width * height;
+	uint8_t *v_plane = u_plane + uv_width * uv_height;
+
+	memset(y_plane, 225, width * height);
+	memset(u_plane, 128, uv_width * uv_height);
+	memset(v_plane, 128, uv_width * uv_height);
+
+	// dark bars as text lines, of varying length like a slide.
+	int line_h = height / 24 > 2 ? height / 24 : 2;
+	int margin = width / 12;
+	for (int line = 0; (line * 2 + 3) * line_h < height; line++)
+	{
+		int top = (line * 2 + 2) * line_h;
+		int length = (width - margin * 2) * (5 + (line * 7) % 5) / 10;
+		uint8_t luma = line % share_phases == phase ? 60 : 110;
+		for (int y = top; y < top + line_h; y++)
+			memset(y_plane + y * width + margin, luma, length);
+	}
+}
+
+void SyntheticMedia::tone(int16_t *samples, int nb_samples, int channels, int sample_rate, double hz, bool talking,
+						  int64_t position)
+{
+	uint32_t seed = (uint32_t)position * 2654435761u;
+	for (int i = 0; i < nb_samples; i++)
+	{
+		int16_t value;
+		if (talking)
+		{
+			value = (int16_t)(6000.0 * sin(2.0 * M_PI * hz * (double)(position + i) / sample_rate));
+		}
+		else
+		{
+			seed = seed * 1664525 + 1013904223;
+			value = (int16_t)((int32_t)seed >> 24); // peaks at -48 dBFS
+		}
+		for (int c = 0; c < channels; c++)
+			samples[i * channels + c] = value;
+	}
+}
@@ -0,0 +1,40 @@
+#pragma once
+#include <stdint.h>
+#include <map>
+#include <mutex>
+#include <vector>
+
+// Test patterns for the offline SDK. Frames are generated once per size and
+// phase and shared by every stream of that size, so hundreds of fake users
+// cost no more CPU than the bot spends on their frames.
+class SyntheticMedia
+{
+public:
+	enum Pattern
+	{
+		Pattern_Camera, // gradient with a moving box, every phase differs
+		Pattern_Share,  // slide with text lines, one line highlighted per phase
+	};
+	static const int camera_phases = 16;
+	static const int share_phases = 4;
+
+	// contiguous I420 frame of width x height, limited range. Stays valid until exit.
+	static const char* frame(Pattern pattern, int width, int height, int phase);
+
+	// 16 bit PCM: a tone of frequency hz while talking, faint noise otherwise.
+	// position counts samples per channel and keeps the tone continuous between calls.
+	static void tone(int16_t* samples, int nb_samples, int channels, int sample_rate, double hz, bool talking,
+					 int64_t position);
+
+private:
+	struct Key
+	{
+		int pattern, width, height, phase;
+		bool operator<(const Key& other) const;
+	};
+	static std::mutex mutex_;
+	static std::map<Key, std::vector<char>*> cache_;
+
+	static void draw_camera(char* buffer, int width, int height, int phase);
+	static void draw_share(char* buffer, int width, int height, int phase);
+};
@@ -0,0 +1,51 @@
+#include "audio_continuity.h"
+#include <math.h>
+#include <string.h>
+
+AudioContinuity::AudioContinuity()
+{
+	seed_ = 0x12345678;
+}
+
+AudioContinuity::Action AudioContinuity::place(int64_t time_ms, int64_t end_ms, int *fill_ms)
+{
+	*fill_ms = 0;
+	if (end_ms < 0)
+		return Jump;
+
+	int64_t gap = time_ms - end_ms;
+	if (gap <= jitter_ms)
+		return Continue;
+	if (gap <= max_fill_ms)
+	{
+		filled_gaps_++;
+		filled_ms_ += gap;
+		*fill_ms = (int)gap;
+		return Fill;
+	}
+	jumps_++;
+	return Jump;
+}
+
+const int16_t *AudioContinuity::comfort_noise(int nb_samples, int channels, double rms)
+{
+	size_t count = (size_t)nb_samples * channels;
+	if (fill_.size() < count)
+		fill_.resize(count);
+	if (rms <= 0)
+	{
+		memset(fill_.data(), 0, count * sizeof(int16_t));
+		return fill_.data();
+	}
+	// uniform noise in [-a, a] has rms a / sqrt(3).
+	double amplitude = rms * sqrt(3.0);
+	if (amplitude > 32767.0)
+		amplitude = 32767.0;
+	for (size_t i = 0; i < count; i++)
+	{
+		seed_ = seed_ * 1664525 + 1013904223;
+		double r = ((int32_t)seed_) / 2147483648.0;
+		fill_[i] = (int16_t)(r * amplitude);
+	}
+	return fill_.data();
+}
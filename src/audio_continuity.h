@@ -0,0 +1,41 @@
+#pragma once
+#include <stdint.h>
+#include <vector>
+
+// Keeps a timestamped audio stream aligned to session time. Each buffer is
+// compared with where the stream currently ends: callback jitter is absorbed,
+// short gaps (network loss, muting, DTX pauses) are filled with comfort noise
+// or zeros, and long gaps become a timestamp jump so hours of silence are
+// never fed to the encoder.
+class AudioContinuity
+{
+	static const int jitter_ms = 40;
+	static const int max_fill_ms = 1000;
+
+	uint32_t seed_;
+	std::vector<int16_t> fill_;
+	int filled_gaps_ = 0;
+	int64_t filled_ms_ = 0;
+	int jumps_ = 0;
+
+public:
+	typedef enum
+	{
+		Continue, // append the buffer right after the previous one
+		Fill,     // insert fill_ms of comfort noise, then append
+		Jump,     // restart the stream at the buffer's own time
+	} Action;
+
+	AudioContinuity();
+
+	// time_ms: session time the buffer started at, from its arrival time.
+	// end_ms: session time the encoded stream currently ends at, negative before the first buffer.
+	Action place(int64_t time_ms, int64_t end_ms, int* fill_ms);
+
+	// nb_samples * channels of s16 noise with the given rms, zeros when rms is 0.
+	const int16_t* comfort_noise(int nb_samples, int channels, double rms);
+
+	int filled_gaps() const { return filled_gaps_; }
+	int64_t filled_ms() const { return filled_ms_; }
+	int jumps() const { return jumps_; }
+};
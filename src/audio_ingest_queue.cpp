@@ -0,0 +1,154 @@
+#include "audio_ingest_queue.h"
+#include "raw_audio_ffmpeg_encoder.h"
+#include "media_clock.h"
+#include <stdio.h>
+
+AudioIngestQueue::AudioIngestQueue()
+{
+	worker_ = std::thread(&AudioIngestQueue::run, this);
+}
+
+AudioIngestQueue &AudioIngestQueue::instance()
+{
+	// never destroyed: the bot may exit() from an SDK callback while the worker is parked.
+	static AudioIngestQueue *queue = new AudioIngestQueue();
+	return *queue;
+}
+
+void AudioIngestQueue::push(RawAudioFFMPEGEncoder *encoder, AudioRawData *data)
+{
+	Item item;
+	item.encoder = encoder;
+	item.sample_rate = data->GetSampleRate();
+	item.channels = data->GetChannelNum();
+	item.arrival = MediaClock::now();
+	item.stop = false;
+	if (data->CanAddRef() && data->AddRef())
+	{
+		item.data = data;
+	}
+	else
+	{
+		item.data = nullptr;
+		item.copy.assign(data->GetBuffer(), data->GetBuffer() + data->GetBufferLen());
+	}
+	item.bytes = data->GetBufferLen();
+
+	std::lock_guard<std::mutex> lock(mutex_);
+	if (pending_bytes_ + item.bytes > max_pending_bytes)
+		drop_oldest(item.bytes);
+	pending_bytes_ += item.bytes;
+	pending_.push_back(std::move(item));
+	cond_.notify_one();
+}
+
+void AudioIngestQueue::drop_oldest(size_t bytes)
+{
+	// stops are kept, they free their encoder.
+	int64_t dropped = 0;
+	size_t kept = 0;
+	size_t index = 0;
+	for (; index < pending_.size() && pending_bytes_ + bytes > max_pending_bytes; index++)
+	{
+		Item &item = pending_[index];
+		if (item.stop)
+		{
+			if (kept != index)
+				pending_[kept] = std::move(item);
+			kept++;
+			continue;
+		}
+		if (item.data)
+			item.data->Release();
+		pending_bytes_ -= item.bytes;
+		dropped++;
+	}
+	if (kept != index)
+	{
+		for (; index < pending_.size(); index++)
+			pending_[kept++] = std::move(pending_[index]);
+		pending_.resize(kept);
+	}
+	dropped_ += dropped;
+	// once a second at most, the queue overflows buffer after buffer while it lasts.
+	steady_clock::time_point now = steady_clock::now();
+	if (dropped && now - drop_logged_ >= seconds(1))
+	{
+		drop_logged_ = now;
+		printf("Audio encoding is %zu MB behind, %lld buffers dropped so far.\n", max_pending_bytes / (1024 * 1024),
+			   (long long)dropped_);
+	}
+}
+
+void AudioIngestQueue::push_stop(RawAudioFFMPEGEncoder *encoder)
+{
+	Item item;
+	item.encoder = encoder;
+	item.data = nullptr;
+	item.sample_rate = 0;
+	item.channels = 0;
+	item.bytes = 0;
+	item.arrival = MediaClock::now();
+	item.stop = true;
+
+	std::lock_guard<std::mutex> lock(mutex_);
+	pending_.push_back(std::move(item));
+	cond_.notify_one();
+}
+
+void AudioIngestQueue::drain()
+{
+	std::unique_lock<std::mutex> lock(mutex_);
+	drained_.wait(lock, [this] { return pending_.empty() && !busy_; });
+}
+
+size_t AudioIngestQueue::depth()
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	return pending_.size();
+}
+
+int64_t AudioIngestQueue::dropped()
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	return dropped_;
+}
+
+void AudioIngestQueue::run()
+{
+	while (true)
+	{
+		{
+			std::unique_lock<std::mutex> lock(mutex_);
+			busy_ = false;
+			drained_.notify_all();
+			cond_.wait(lock, [this] { return !pending_.empty(); });
+			// take the whole backlog; batch_ keeps its capacity between wakeups.
+			batch_.swap(pending_);
+			pending_bytes_ = 0;
+			busy_ = true;
+		}
+
+		for (auto iter = batch_.begin(); iter != batch_.end(); iter++)
+		{
+			Item &item = *iter;
+			if (item.stop)
+			{
+				delete item.encoder;
+				continue;
+			}
+			if (item.data)
+			{
+				item.encoder->process(reinterpret_cast<const int16_t *>(item.data->GetBuffer()), item.data->GetBufferLen(),
+									  item.sample_rate, item.channels, item.arrival);
+				item.data->Release();
+			}
+			else
+			{
+				item.encoder->process(reinterpret_cast<const int16_t *>(item.copy.data()), item.copy.size(),
+									  item.sample_rate, item.channels, item.arrival);
+			}
+		}
+		batch_.clear();
+	}
+}
@@ -0,0 +1,64 @@
+#pragma once
+#include <stdint.h>
+#include <vector>
+#include <chrono>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+using namespace std::chrono;
+
+#include "zoom_sdk_raw_data_def.h"
+
+class RawAudioFFMPEGEncoder;
+
+// Moves audio encoding off the SDK callback threads. The callback only takes a
+// reference on the SDK buffer (or copies it when the SDK does not allow that)
+// and queues it; one worker drains everything queued since its last wakeup and
+// encodes the batch, so no ffmpeg call happens on a callback thread.
+// Encoders are also destroyed on the worker, after their queued buffers.
+// When the worker falls max_pending_bytes behind, the oldest buffers are
+// released unencoded and counted as dropped.
+class AudioIngestQueue
+{
+	struct Item
+	{
+		RawAudioFFMPEGEncoder* encoder;
+		AudioRawData* data;     // referenced SDK buffer, released after encoding
+		std::vector<char> copy; // used when the SDK buffer can not be referenced
+		size_t bytes;
+		unsigned int sample_rate;
+		unsigned int channels;
+		steady_clock::time_point arrival;
+		bool stop;
+	};
+
+	static const size_t max_pending_bytes = 32 * 1024 * 1024;
+
+	std::mutex mutex_;
+	std::condition_variable cond_;
+	std::condition_variable drained_;
+	std::vector<Item> pending_;
+	size_t pending_bytes_ = 0;
+	int64_t dropped_ = 0;
+	steady_clock::time_point drop_logged_;
+	std::vector<Item> batch_;
+	bool busy_ = false;
+	std::thread worker_;
+
+	AudioIngestQueue();
+	void run();
+	// releases the oldest buffers until bytes more fit, with mutex_ held.
+	void drop_oldest(size_t bytes);
+
+public:
+	static AudioIngestQueue& instance();
+
+	void push(RawAudioFFMPEGEncoder* encoder, AudioRawData* data);
+	void push_stop(RawAudioFFMPEGEncoder* encoder);
+	// block until everything queued so far has been encoded.
+	void drain();
+	// buffers waiting for the worker.
+	size_t depth();
+	// buffers released unencoded because the worker was behind.
+	int64_t dropped();
+};
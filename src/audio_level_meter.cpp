@@ -0,0 +1,237 @@
+#include "audio_level_meter.h"
+#include <math.h>
+#include <string.h>
+#include "json.hpp"
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+using Json = nlohmann::json;
+
+static const double full_scale_square = 32768.0 * 32768.0;
+static const double silence_db = -120.0;
+
+AudioLevelMeter::AudioLevelMeter()
+{
+	reset(0, 0);
+}
+
+void AudioLevelMeter::reset(int sampleRate, int channels)
+{
+	sample_rate_ = sampleRate;
+	channels_ = channels;
+	hop_samples_ = sampleRate * channels * hop_ms / 1000;
+	hop_sum_ = 0;
+	hop_count_ = 0;
+	window_fill_ = 0;
+	window_pos_ = 0;
+	momentary_lufs_ = silence_db;
+	max_momentary_lufs_ = silence_db;
+	memset(hist_count_, 0, sizeof(hist_count_));
+	memset(hist_energy_, 0, sizeof(hist_energy_));
+	peak_ = 0;
+	period_peak_ = 0;
+	total_sum_ = 0;
+	total_samples_ = 0;
+	clipped_samples_ = 0;
+}
+
+void AudioLevelMeter::measure(const int16_t *samples, int count, uint64_t *sum_sq, int *peak)
+{
+	uint64_t sum = 0;
+	int max_v = 0;
+	int min_v = 0;
+	int i = 0;
+#if defined(__SSE2__)
+	// madd squares and adds sample pairs into 32 bit lanes; (-32768)^2 * 2 only fits unsigned,
+	// so the lanes are widened as unsigned into 64 bit accumulators. max and min are tracked
+	// separately because |-32768| does not fit a 16 bit lane.
+	const __m128i zero = _mm_setzero_si128();
+	__m128i acc = _mm_setzero_si128();
+	__m128i vmax = _mm_setzero_si128();
+	__m128i vmin = _mm_setzero_si128();
+	for (; i + 8 <= count; i += 8)
+	{
+		__m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(samples + i));
+		__m128i sq = _mm_madd_epi16(v, v);
+		acc = _mm_add_epi64(acc, _mm_unpacklo_epi32(sq, zero));
+		acc = _mm_add_epi64(acc, _mm_unpackhi_epi32(sq, zero));
+		vmax = _mm_max_epi16(vmax, v);
+		vmin = _mm_min_epi16(vmin, v);
+	}
+	uint64_t lanes[2];
+	_mm_storeu_si128(reinterpret_cast<__m128i *>(lanes), acc);
+	sum = lanes[0] + lanes[1];
+	int16_t maxs[8], mins[8];
+	_mm_storeu_si128(reinterpret_cast<__m128i *>(maxs), vmax);
+	_mm_storeu_si128(reinterpret_cast<__m128i *>(mins), vmin);
+	for (int k = 0; k < 8; k++)
+	{
+		if (maxs[k] > max_v)
+			max_v = maxs[k];
+		if (mins[k] < min_v)
+			min_v = mins[k];
+	}
+#endif
+	for (; i < count; i++)
+	{
+		sum += (int32_t)samples[i] * (int32_t)samples[i];
+		if (samples[i] > max_v)
+			max_v = samples[i];
+		if (samples[i] < min_v)
+			min_v = samples[i];
+	}
+	*sum_sq = sum;
+	*peak = max_v > -min_v ? max_v : -min_v;
+}
+
+double AudioLevelMeter::to_dbfs(double mean_square)
+{
+	if (mean_square <= 0)
+		return silence_db;
+	return 10.0 * log10(mean_square / full_scale_square);
+}
+
+double AudioLevelMeter::to_lufs(double mean_square)
+{
+	if (mean_square <= 0)
+		return silence_db;
+	return -0.691 + 10.0 * log10(mean_square / full_scale_square);
+}
+
+double AudioLevelMeter::process(const int16_t *samples, int count)
+{
+	if (count <= 0)
+		return 0;
+
+	uint64_t sum_sq;
+	int peak;
+	measure(samples, count, &sum_sq, &peak);
+
+	if (peak > peak_)
+		peak_ = peak;
+	if (peak > period_peak_)
+		period_peak_ = peak;
+	if (peak >= 32767)
+	{
+		// clipping is rare, only then pay for counting the clipped samples.
+		for (int i = 0; i < count; i++)
+		{
+			if (samples[i] >= 32767 || samples[i] <= -32767)
+				clipped_samples_++;
+		}
+	}
+	total_sum_ += (double)sum_sq;
+	total_samples_ += count;
+
+	// buffers are smaller than a hop (10ms vs 100ms), so a buffer closes at most one hop.
+	hop_sum_ += sum_sq;
+	hop_count_ += count;
+	if (hop_samples_ > 0 && hop_count_ >= hop_samples_)
+		close_hop();
+
+	return (double)sum_sq / count;
+}
+
+void AudioLevelMeter::close_hop()
+{
+	window_[window_pos_] = (double)hop_sum_ / hop_count_;
+	window_pos_ = (window_pos_ + 1) % blocks_per_window;
+	if (window_fill_ < blocks_per_window)
+		window_fill_++;
+	hop_sum_ = 0;
+	hop_count_ = 0;
+	if (window_fill_ < blocks_per_window)
+		return;
+
+	// momentary loudness over the last 400ms, one gating block per 100ms hop (75% overlap).
+	double block = 0;
+	for (int k = 0; k < blocks_per_window; k++)
+		block += window_[k];
+	block /= blocks_per_window;
+	momentary_lufs_ = to_lufs(block);
+	if (momentary_lufs_ > max_momentary_lufs_)
+		max_momentary_lufs_ = momentary_lufs_;
+
+	// absolute gate
+	if (momentary_lufs_ <= -70.0)
+		return;
+	int bin = (int)((momentary_lufs_ + 70.0) * 10.0);
+	if (bin >= hist_bins)
+		bin = hist_bins - 1;
+	hist_count_[bin]++;
+	hist_energy_[bin] += block;
+}
+
+double AudioLevelMeter::integrated_lufs() const
+{
+	double energy = 0;
+	uint64_t count = 0;
+	for (int k = 0; k < hist_bins; k++)
+	{
+		energy += hist_energy_[k];
+		count += hist_count_[k];
+	}
+	if (count == 0)
+		return silence_db;
+
+	// relative gate, 10 LU below the absolute-gated loudness.
+	double relative_gate = to_lufs(energy / count) - 10.0;
+	int first_bin = (int)ceil((relative_gate + 70.0) * 10.0);
+	if (first_bin < 0)
+		first_bin = 0;
+	energy = 0;
+	count = 0;
+	for (int k = first_bin; k < hist_bins; k++)
+	{
+		energy += hist_energy_[k];
+		count += hist_count_[k];
+	}
+	if (count == 0)
+		return silence_db;
+	return to_lufs(energy / count);
+}
+
+double AudioLevelMeter::rms_dbfs() const
+{
+	if (total_samples_ == 0)
+		return silence_db;
+	return to_dbfs(total_sum_ / total_samples_);
+}
+
+double AudioLevelMeter::peak_dbfs() const
+{
+	return peak_ > 0 ? 20.0 * log10(peak_ / 32768.0) : silence_db;
+}
+
+double AudioLevelMeter::take_period_peak_dbfs()
+{
+	double db = period_peak_ > 0 ? 20.0 * log10(period_peak_ / 32768.0) : silence_db;
+	period_peak_ = 0;
+	return db;
+}
+
+double AudioLevelMeter::duration_s() const
+{
+	if (sample_rate_ == 0 || channels_ == 0)
+		return 0;
+	return (double)total_samples_ / ((double)sample_rate_ * channels_);
+}
+
+bool AudioLevelMeter::is_dead() const
+{
+	return duration_s() > 10.0 && peak_dbfs() < -60.0;
+}
+
+std::string AudioLevelMeter::summary() const
+{
+	Json json;
+	json["duration_s"] = duration_s();
+	json["peak_dbfs"] = peak_dbfs();
+	json["rms_dbfs"] = rms_dbfs();
+	json["integrated_lufs"] = integrated_lufs();
+	json["max_momentary_lufs"] = max_momentary_lufs_;
+	json["clipped_samples"] = clipped_samples_;
+	json["dead_mic"] = is_dead();
+	return json.dump(4);
+}
@@ -0,0 +1,67 @@
+#pragma once
+#include <stdint.h>
+#include <string>
+
+// Level meter for s16 PCM. Every buffer gets one SIMD pass for sum of squares
+// and peak; the sums are folded into 100ms sub-blocks, giving EBU R128 style
+// momentary (400ms) and gated integrated loudness. No K-weighting is applied,
+// values are LUFS-like estimates on the unweighted signal.
+class AudioLevelMeter
+{
+	static const int hop_ms = 100;
+	static const int blocks_per_window = 4;
+	// integrated loudness histogram, 0.1 LU bins from -70 to +5 LUFS.
+	static const int hist_bins = 750;
+
+	int sample_rate_ = 0;
+	int channels_ = 0;
+	int hop_samples_ = 0;
+
+	// current 100ms sub-block
+	uint64_t hop_sum_ = 0;
+	int hop_count_ = 0;
+	double window_[blocks_per_window];
+	int window_fill_ = 0;
+	int window_pos_ = 0;
+
+	double momentary_lufs_;
+	double max_momentary_lufs_;
+	uint32_t hist_count_[hist_bins];
+	double hist_energy_[hist_bins];
+
+	int peak_;
+	int period_peak_;
+	double total_sum_ = 0;
+	int64_t total_samples_ = 0;
+	int64_t clipped_samples_ = 0;
+
+	void close_hop();
+
+public:
+	AudioLevelMeter();
+
+	// Sum of squares and absolute peak of `count` samples, SSE2 when available.
+	static void measure(const int16_t* samples, int count, uint64_t* sum_sq, int* peak);
+
+	void reset(int sampleRate, int channels);
+	// Meter one buffer, returns its mean square for reuse by later stages.
+	double process(const int16_t* samples, int count);
+
+	static double to_dbfs(double mean_square);
+	static double to_lufs(double mean_square);
+
+	double momentary_lufs() const { return momentary_lufs_; }
+	double integrated_lufs() const;
+	double rms_dbfs() const;
+	double peak_dbfs() const;
+	// peak since the previous call, for periodic metrics.
+	double take_period_peak_dbfs();
+	int64_t clipped_samples() const { return clipped_samples_; }
+	double duration_s() const;
+
+	// A microphone that never rose above -60 dBFS over more than 10s.
+	bool is_dead() const;
+
+	// JSON summary of the whole recording.
+	std::string summary() const;
+};
@@ -0,0 +1,96 @@
+#include "audio_vad.h"
+
+// -50 dBFS expressed as mean square of s16 samples.
+static const double abs_floor = 32768.0 * 32768.0 * 1e-5;
+// speech must be ~9 dB above the tracked noise floor.
+static const double floor_margin = 8.0;
+
+AudioVAD::AudioVAD()
+{
+	noise_floor_ = abs_floor;
+	threshold_ = abs_floor * floor_margin;
+	is_speech_ = false;
+	speech_start_ms_ = 0;
+	last_voice_ms_ = 0;
+	voiced_ms_ = 0;
+	spurt_count_ = 0;
+	fp_timeline_ = NULL;
+}
+
+AudioVAD::~AudioVAD()
+{
+	if (fp_timeline_)
+	{
+		fclose(fp_timeline_);
+	}
+}
+
+int AudioVAD::open_timeline(const char *fileName, int64_t start_epoch_ms)
+{
+	fp_timeline_ = fopen(fileName, "w");
+	if (fp_timeline_ == NULL)
+	{
+		printf("Error open speech timeline file %s.\n", fileName);
+		return -1;
+	}
+	fprintf(fp_timeline_, "# start_epoch_ms=%lld\nstart_ms,end_ms\n", (long long)start_epoch_ms);
+	return 0;
+}
+
+void AudioVAD::close_timeline(int64_t time_ms)
+{
+	if (is_speech_)
+	{
+		close_spurt(last_voice_ms_ < time_ms ? last_voice_ms_ : time_ms);
+		is_speech_ = false;
+	}
+	if (fp_timeline_)
+	{
+		fclose(fp_timeline_);
+		fp_timeline_ = NULL;
+	}
+}
+
+void AudioVAD::close_spurt(int64_t end_ms)
+{
+	if (end_ms - speech_start_ms_ < min_speech_ms)
+		return;
+	spurt_count_++;
+	voiced_ms_ += end_ms - speech_start_ms_;
+	if (fp_timeline_)
+	{
+		fprintf(fp_timeline_, "%lld,%lld\n", (long long)speech_start_ms_, (long long)end_ms);
+		fflush(fp_timeline_);
+	}
+}
+
+bool AudioVAD::process(double mean_square, int64_t time_ms, int duration_ms)
+{
+	bool voiced = mean_square > threshold_;
+
+	// track the noise floor quickly downwards and slowly upwards, so steady background
+	// noise is absorbed within ~20s while speech does not lift the floor.
+	if (voiced)
+		noise_floor_ *= 1.001;
+	else
+		noise_floor_ = noise_floor_ * 0.95 + mean_square * 0.05;
+	if (noise_floor_ < abs_floor)
+		noise_floor_ = abs_floor;
+	threshold_ = noise_floor_ * floor_margin;
+
+	if (voiced)
+	{
+		if (!is_speech_)
+		{
+			is_speech_ = true;
+			speech_start_ms_ = time_ms;
+		}
+		last_voice_ms_ = time_ms + duration_ms;
+	}
+	else if (is_speech_ && time_ms - last_voice_ms_ > hangover_ms)
+	{
+		close_spurt(last_voice_ms_);
+		is_speech_ = false;
+	}
+	return is_speech_;
+}
@@ -0,0 +1,42 @@
+#pragma once
+#include <stdio.h>
+#include <stdint.h>
+#include <math.h>
+
+// Energy based voice activity detector for one-way PCM (s16, interleaved).
+// Each buffer is classified as speech or silence against an adaptive noise
+// floor; a hangover keeps short pauses inside one talk spurt. Closed talk
+// spurts are appended to a sidecar timeline file as "start_ms,end_ms".
+class AudioVAD
+{
+	static const int hangover_ms = 400;
+	static const int min_speech_ms = 60;
+
+	double noise_floor_;
+	double threshold_;
+	bool is_speech_;
+	int64_t speech_start_ms_;
+	int64_t last_voice_ms_;
+	int64_t voiced_ms_;
+	int spurt_count_;
+	FILE* fp_timeline_;
+
+	void close_spurt(int64_t end_ms);
+
+public:
+	AudioVAD();
+	~AudioVAD();
+
+	int open_timeline(const char* fileName, int64_t start_epoch_ms);
+	void close_timeline(int64_t time_ms);
+
+	// Classify a buffer by its mean square (from AudioLevelMeter) that started at
+	// time_ms (relative to the recording start). Returns true while the buffer is
+	// speech or inside the hangover window, i.e. when it should be encoded.
+	bool process(double mean_square, int64_t time_ms, int duration_ms);
+
+	bool is_speech() const { return is_speech_; }
+	double noise_rms() const { return sqrt(noise_floor_); }
+	int spurt_count() const { return spurt_count_; }
+	int64_t voiced_ms() const { return voiced_ms_; }
+};
@@ -0,0 +1,129 @@
+#include "dirty_region_tracker.h"
+#include <string.h>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+// frames that touch less than this share of the tiles count as small updates (cursor, typing).
+static const double small_update_ratio = 0.05;
+
+// compare a w x h block of two planes with the same stride.
+static bool block_equal(const uint8_t *a, const uint8_t *b, int stride, int w, int h)
+{
+#if defined(__SSE2__)
+	if (w == 16)
+	{
+		__m128i eq = _mm_set1_epi8(-1);
+		for (int y = 0; y < h; y++)
+		{
+			__m128i va = _mm_loadu_si128(reinterpret_cast<const __m128i *>(a + y * stride));
+			__m128i vb = _mm_loadu_si128(reinterpret_cast<const __m128i *>(b + y * stride));
+			eq = _mm_and_si128(eq, _mm_cmpeq_epi8(va, vb));
+		}
+		return _mm_movemask_epi8(eq) == 0xFFFF;
+	}
+	if (w == 8)
+	{
+		__m128i eq = _mm_set1_epi8(-1);
+		for (int y = 0; y < h; y++)
+		{
+			__m128i va = _mm_loadl_epi64(reinterpret_cast<const __m128i *>(a + y * stride));
+			__m128i vb = _mm_loadl_epi64(reinterpret_cast<const __m128i *>(b + y * stride));
+			eq = _mm_and_si128(eq, _mm_cmpeq_epi8(va, vb));
+		}
+		return (_mm_movemask_epi8(eq) & 0xFF) == 0xFF;
+	}
+#endif
+	// partial tiles at the right edge
+	for (int y = 0; y < h; y++)
+	{
+		if (memcmp(a + y * stride, b + y * stride, w) != 0)
+			return false;
+	}
+	return true;
+}
+
+static void block_copy(uint8_t *dst, const uint8_t *src, int stride, int w, int h)
+{
+	for (int y = 0; y < h; y++)
+		memcpy(dst + y * stride, src + y * stride, w);
+}
+
+void DirtyRegionTracker::resize(int width, int height)
+{
+	width_ = width;
+	height_ = height;
+	tiles_x_ = (width + tile_size - 1) / tile_size;
+	tiles_y_ = (height + tile_size - 1) / tile_size;
+	map_.assign((size_t)tiles_x_ * tiles_y_, 1);
+	const size_t y_size = (size_t)width * height;
+	const size_t uv_size = (size_t)((width + 1) / 2) * ((height + 1) / 2);
+	prev_.resize(y_size + uv_size * 2);
+}
+
+int DirtyRegionTracker::update(const uint8_t *Y, const uint8_t *U, const uint8_t *V, int width, int height)
+{
+	const size_t y_size = (size_t)width * height;
+	const int uv_stride = (width + 1) / 2;
+	const size_t uv_size = (size_t)uv_stride * ((height + 1) / 2);
+
+	if (!has_prev_ || width != width_ || height != height_)
+	{
+		// first frame or new size: everything is dirty.
+		resize(width, height);
+		memcpy(prev_.data(), Y, y_size);
+		memcpy(prev_.data() + y_size, U, uv_size);
+		memcpy(prev_.data() + y_size + uv_size, V, uv_size);
+		has_prev_ = true;
+		dirty_count_ = (int)map_.size();
+	}
+	else
+	{
+		uint8_t *pY = prev_.data();
+		uint8_t *pU = pY + y_size;
+		uint8_t *pV = pU + uv_size;
+		const int c_tile = tile_size / 2;
+		const int uv_width = uv_stride;
+		const int uv_height = (height + 1) / 2;
+		dirty_count_ = 0;
+		for (int ty = 0; ty < tiles_y_; ty++)
+		{
+			const int y0 = ty * tile_size;
+			const int h = height - y0 < tile_size ? height - y0 : tile_size;
+			const int cy0 = ty * c_tile;
+			const int ch = uv_height - cy0 < c_tile ? uv_height - cy0 : c_tile;
+			for (int tx = 0; tx < tiles_x_; tx++)
+			{
+				const int x0 = tx * tile_size;
+				const int w = width - x0 < tile_size ? width - x0 : tile_size;
+				const int cx0 = tx * c_tile;
+				const int cw = uv_width - cx0 < c_tile ? uv_width - cx0 : c_tile;
+				const size_t off = (size_t)y0 * width + x0;
+				const size_t coff = (size_t)cy0 * uv_stride + cx0;
+
+				bool equal = block_equal(Y + off, pY + off, width, w, h) &&
+							 block_equal(U + coff, pU + coff, uv_stride, cw, ch) &&
+							 block_equal(V + coff, pV + coff, uv_stride, cw, ch);
+				map_[(size_t)ty * tiles_x_ + tx] = equal ? 0 : 1;
+				if (!equal)
+				{
+					dirty_count_++;
+					block_copy(pY + off, Y + off, width, w, h);
+					block_copy(pU + coff, U + coff, uv_stride, cw, ch);
+					block_copy(pV + coff, V + coff, uv_stride, cw, ch);
+				}
+			}
+		}
+	}
+
+	double ratio = dirty_ratio();
+	frames_++;
+	dirty_ratio_sum_ += ratio;
+	if (ratio > dirty_ratio_max_)
+		dirty_ratio_max_ = ratio;
+	if (dirty_count_ == 0)
+		static_frames_++;
+	else if (ratio < small_update_ratio)
+		small_update_frames_++;
+	return dirty_count_;
+}
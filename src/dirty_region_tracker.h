@@ -0,0 +1,60 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+// Tiled change detector for share streams. Each frame is compared with the
+// previous one in 16x16 luma tiles (with their 8x8 chroma), giving a map of
+// dirty tiles per frame. Only dirty tiles are copied into the reference, so a
+// cursor move or a typed character costs a handful of tile copies instead of a
+// full frame copy. Dirty area statistics cover one file
+// segment; reset() clears them with the previous frame.
+class DirtyRegionTracker
+{
+	int width_ = 0;
+	int height_ = 0;
+	int tiles_x_ = 0;
+	int tiles_y_ = 0;
+	std::vector<uint8_t> prev_;
+	std::vector<uint8_t> map_;
+	bool has_prev_ = false;
+	int dirty_count_ = 0;
+
+	// share statistics
+	int64_t frames_ = 0;
+	int64_t static_frames_ = 0;
+	int64_t small_update_frames_ = 0;
+	double dirty_ratio_sum_ = 0;
+	double dirty_ratio_max_ = 0;
+
+	void resize(int width, int height);
+
+public:
+	static const int tile_size = 16;
+
+	// Compare a tightly packed I420 frame with the previous one and update the map.
+	// Returns the number of dirty tiles, 0 for an unchanged frame.
+	int update(const uint8_t* Y, const uint8_t* U, const uint8_t* V, int width, int height);
+	void reset()
+	{
+		has_prev_ = false;
+		frames_ = 0;
+		static_frames_ = 0;
+		small_update_frames_ = 0;
+		dirty_ratio_sum_ = 0;
+		dirty_ratio_max_ = 0;
+	}
+
+	// one byte per tile, row major, non zero when the tile changed in the last frame.
+	const uint8_t* dirty_map() const { return map_.data(); }
+	int tiles_x() const { return tiles_x_; }
+	int tiles_y() const { return tiles_y_; }
+	int dirty_count() const { return dirty_count_; }
+	double dirty_ratio() const { return map_.empty() ? 0 : (double)dirty_count_ / map_.size(); }
+
+	int64_t frames() const { return frames_; }
+	int64_t static_frames() const { return static_frames_; }
+	int64_t small_update_frames() const { return small_update_frames_; }
+	double average_dirty_ratio() const { return frames_ ? dirty_ratio_sum_ / frames_ : 0; }
+	double max_dirty_ratio() const { return dirty_ratio_max_; }
+};
@@ -0,0 +1,205 @@
+#include "ffmpeg_video_writer.h"
+#include "frame_trace.h"
+#include <stdio.h>
+#include <string.h>
+
+FFMPEGVideoWriter::~FFMPEGVideoWriter()
+{
+	close();
+}
+
+AVFrame *FFMPEGVideoWriter::alloc_frame(int width, int height)
+{
+	AVFrame *frame = av_frame_alloc();
+	frame->format = AV_PIX_FMT_YUV420P;
+	frame->width = width;
+	frame->height = height;
+	if (av_frame_get_buffer(frame, 32) < 0)
+	{
+		av_frame_free(&frame);
+		return nullptr;
+	}
+	clear_frame(frame);
+	return frame;
+}
+
+void FFMPEGVideoWriter::clear_frame(AVFrame *frame)
+{
+	for (int y = 0; y < frame->height; y++)
+		memset(frame->data[0] + y * frame->linesize[0], 16, frame->width);
+	for (int y = 0; y < (frame->height + 1) / 2; y++)
+	{
+		memset(frame->data[1] + y * frame->linesize[1], 128, (frame->width + 1) / 2);
+		memset(frame->data[2] + y * frame->linesize[2], 128, (frame->width + 1) / 2);
+	}
+}
+
+void FFMPEGVideoWriter::set_scaler_range(SwsContext *sws, bool full_range)
+{
+	int *inv_table, *table;
+	int src_range, dst_range, brightness, contrast, saturation;
+	if (sws_getColorspaceDetails(sws, &inv_table, &src_range, &table, &dst_range, &brightness, &contrast, &saturation) < 0)
+		return;
+	// only touch the scaler when the range changes, setting it rebuilds its tables.
+	if (src_range == (full_range ? 1 : 0) && dst_range == 0)
+		return;
+	const int *coefficients = sws_getCoefficients(SWS_CS_ITU601);
+	sws_setColorspaceDetails(sws, coefficients, full_range ? 1 : 0, coefficients, 0, brightness, contrast, saturation);
+}
+
+int FFMPEGVideoWriter::open(const char *fileName, int width, int height, AVRational time_base,
+							const char *preset, const char *tune, int bit_rate, int gop_size)
+{
+	int ret;
+
+	av_register_all();
+	pFormatCtx = avformat_alloc_context();
+	AVOutputFormat *fmt = av_guess_format(NULL, fileName, NULL);
+	pFormatCtx->oformat = fmt;
+
+	if (avio_open(&pFormatCtx->pb, fileName, AVIO_FLAG_READ_WRITE) < 0)
+	{
+		printf("Failed to open output file! \n");
+		avformat_free_context(pFormatCtx);
+		pFormatCtx = nullptr;
+		return -1;
+	}
+
+	video_st = avformat_new_stream(pFormatCtx, 0);
+	if (video_st == NULL)
+	{
+		close();
+		return -1;
+	}
+	pCodecCtx = video_st->codec;
+	pCodecCtx->codec_id = fmt->video_codec;
+	pCodecCtx->codec_type = AVMEDIA_TYPE_VIDEO;
+	pCodecCtx->pix_fmt = AV_PIX_FMT_YUV420P;
+	pCodecCtx->width = width;
+	pCodecCtx->height = height;
+	pCodecCtx->bit_rate = bit_rate;
+	pCodecCtx->gop_size = gop_size;
+	pCodecCtx->time_base = time_base;
+	pCodecCtx->qmin = 10;
+	pCodecCtx->qmax = 51;
+	pCodecCtx->max_b_frames = 3;
+	// composed outputs are drawn in limited range BT.601, like most SDK frames.
+	pCodecCtx->color_range = AVCOL_RANGE_MPEG;
+	pCodecCtx->colorspace = AVCOL_SPC_SMPTE170M;
+	pCodecCtx->color_primaries = AVCOL_PRI_SMPTE170M;
+	pCodecCtx->color_trc = AVCOL_TRC_SMPTE170M;
+	video_st->time_base = time_base;
+
+	AVCodec *pCodec = avcodec_find_encoder(pCodecCtx->codec_id);
+	if (!pCodec)
+	{
+		printf("Can not find encoder! \n");
+		close();
+		return -1;
+	}
+
+	AVDictionary *param = 0;
+	if (pCodecCtx->codec_id == AV_CODEC_ID_H264)
+	{
+		if (preset)
+			av_dict_set(&param, "preset", preset, 0);
+		if (tune)
+			av_dict_set(&param, "tune", tune, 0);
+	}
+	if (avcodec_open2(pCodecCtx, pCodec, &param) < 0)
+	{
+		printf("Failed to open encoder! \n");
+		av_dict_free(&param);
+		close();
+		return -1;
+	}
+	av_dict_free(&param);
+
+	av_dump_format(pFormatCtx, 0, fileName, 1);
+	if ((ret = avformat_write_header(pFormatCtx, NULL)) < 0)
+	{
+		printf("Failed to write header! \n");
+		close();
+		return ret;
+	}
+	last_pts = -1;
+	framecnt = 0;
+	return 0;
+}
+
+int FFMPEGVideoWriter::write_packet()
+{
+	pkt.stream_index = video_st->index;
+	av_packet_rescale_ts(&pkt, pCodecCtx->time_base, video_st->time_base);
+	TraceSpan mux("mux");
+	int ret = av_write_frame(pFormatCtx, &pkt);
+	mux.end();
+	av_packet_unref(&pkt);
+	framecnt++;
+	return ret;
+}
+
+int FFMPEGVideoWriter::write(AVFrame *frame, bool force_keyframe)
+{
+	int ret;
+	if (!pFormatCtx)
+		return -1;
+	// composed outputs trace from here, their frames come from the compositors' ticks.
+	TraceFrame trace("composed");
+
+	if (frame->pts <= last_pts)
+		frame->pts = last_pts + 1;
+	last_pts = frame->pts;
+	frame->pict_type = force_keyframe ? AV_PICTURE_TYPE_I : AV_PICTURE_TYPE_NONE;
+	frame->color_range = pCodecCtx->color_range;
+	frame->colorspace = pCodecCtx->colorspace;
+
+	av_init_packet(&pkt);
+	pkt.data = NULL;
+	pkt.size = 0;
+	int got_picture = 0;
+	TraceSpan encode("encode");
+	if ((ret = avcodec_encode_video2(pCodecCtx, &pkt, frame, &got_picture)) < 0)
+	{
+		printf("Failed to encode, code: %d\n", ret);
+		return -1;
+	}
+	encode.end();
+	if (got_picture == 1)
+		return write_packet();
+	return 0;
+}
+
+int FFMPEGVideoWriter::close()
+{
+	if (!pFormatCtx)
+		return 0;
+
+	if (pCodecCtx && avcodec_is_open(pCodecCtx))
+	{
+		// Flush Encoder
+		if (pCodecCtx->codec->capabilities & AV_CODEC_CAP_DELAY)
+		{
+			while (1)
+			{
+				av_init_packet(&pkt);
+				pkt.data = NULL;
+				pkt.size = 0;
+				int got_picture = 0;
+				if (avcodec_encode_video2(pCodecCtx, &pkt, NULL, &got_picture) < 0 || !got_picture)
+					break;
+				if (write_packet() < 0)
+					break;
+			}
+		}
+		av_write_trailer(pFormatCtx);
+		avcodec_close(pCodecCtx);
+	}
+	if (pFormatCtx->pb)
+		avio_close(pFormatCtx->pb);
+	avformat_free_context(pFormatCtx);
+	pFormatCtx = nullptr;
+	video_st = nullptr;
+	pCodecCtx = nullptr;
+	return 0;
+}
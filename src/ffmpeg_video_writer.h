@@ -0,0 +1,43 @@
+#pragma once
+// ffmpeg
+#define __STDC_CONSTANT_MACROS
+extern "C"
+{
+#include "libavutil/avutil.h"
+#include "libavutil/imgutils.h"
+#include "libavformat/avformat.h"
+#include "libavcodec/avcodec.h"
+#include "libswscale/swscale.h"
+}
+
+// Encodes YUV420P frames of a fixed size into one file, for outputs that are
+// produced by the bot itself (composites) rather than received from a pipe.
+// Encoder settings follow RawDataFFMPEGEncoder; frames are limited range.
+class FFMPEGVideoWriter
+{
+	AVFormatContext* pFormatCtx = nullptr;
+	AVStream* video_st = nullptr;
+	AVCodecContext* pCodecCtx = nullptr;
+	AVPacket pkt;
+	int64_t last_pts = -1;
+	int framecnt = 0;
+
+	int write_packet();
+
+public:
+	~FFMPEGVideoWriter();
+
+	// time_base is the unit of the pts passed to write().
+	int open(const char* fileName, int width, int height, AVRational time_base,
+			 const char* preset, const char* tune, int bit_rate, int gop_size);
+	int write(AVFrame* frame, bool force_keyframe = false);
+	int close();
+	bool is_open() const { return pFormatCtx != nullptr; }
+	int frame_count() const { return framecnt; }
+
+	// allocate a YUV420P frame with its own buffer, cleared to black.
+	static AVFrame* alloc_frame(int width, int height);
+	static void clear_frame(AVFrame* frame);
+	// have a cached scaler convert full range sources to the limited range of composed outputs.
+	static void set_scaler_range(SwsContext* sws, bool full_range);
+};
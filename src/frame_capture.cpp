@@ -0,0 +1,455 @@
+#include "frame_capture.h"
+#include "frame_trace.h"
+#include "media_clock.h"
+#include <string.h>
+#include <zlib.h>
+
+static const char capture_magic[8] = {'Z', 'V', 'S', 'D', 'K', 'C', 'A', 'P'};
+static const uint32_t capture_version = 2;
+// type, 3 bytes padding, payload size, arrival time.
+static const size_t record_header_size = 16;
+
+std::atomic<bool> FrameCapture::on_(false);
+std::mutex FrameCapture::mutex_;
+std::condition_variable FrameCapture::cond_;
+std::vector<FrameCapture::Item> FrameCapture::pending_;
+std::vector<std::vector<char> > FrameCapture::spare_;
+size_t FrameCapture::pending_bytes_ = 0;
+bool FrameCapture::stopping_ = false;
+std::thread FrameCapture::worker_;
+FILE *FrameCapture::fp_ = NULL;
+steady_clock::time_point FrameCapture::origin_;
+int64_t FrameCapture::frames_ = 0;
+int64_t FrameCapture::dropped_ = 0;
+int64_t FrameCapture::written_bytes_ = 0;
+std::map<IZoomVideoSDKUser *, uint32_t> FrameCapture::capture_ids_;
+uint32_t FrameCapture::next_capture_id_ = 1;
+std::map<std::string, std::vector<char> > FrameCapture::last_frame_;
+std::vector<char> FrameCapture::work_;
+std::vector<char> FrameCapture::deflated_;
+
+static void put_bytes(std::vector<char> &out, const void *data, size_t size)
+{
+	out.insert(out.end(), (const char *)data, (const char *)data + size);
+}
+
+template <class T>
+static void put(std::vector<char> &out, T value)
+{
+	put_bytes(out, &value, sizeof(value));
+}
+
+static void put_string(std::vector<char> &out, const std::string &value)
+{
+	uint16_t size = value.size() < 0xffff ? value.size() : 0xffff;
+	put(out, size);
+	put_bytes(out, value.data(), size);
+}
+
+template <class T>
+static bool get(const std::vector<char> &in, size_t &pos, T *value)
+{
+	if (pos + sizeof(T) > in.size())
+		return false;
+	memcpy(value, in.data() + pos, sizeof(T));
+	pos += sizeof(T);
+	return true;
+}
+
+static bool get_string(const std::vector<char> &in, size_t &pos, std::string *value)
+{
+	uint16_t size;
+	if (!get(in, pos, &size) || pos + size > in.size())
+		return false;
+	value->assign(in.data() + pos, size);
+	pos += size;
+	return true;
+}
+
+// frames are delta coded against the previous frame of the same stream.
+static std::string stream_key(uint32_t capture_id, int profile, int camera)
+{
+	return std::to_string(capture_id) + "/" + std::to_string(profile) + "/" + std::to_string(camera);
+}
+
+// out = a ^ b, eight bytes at a time.
+static void xor_planes(char *out, const char *a, const char *b, size_t size)
+{
+	size_t i = 0;
+	for (; i + 8 <= size; i += 8)
+	{
+		uint64_t x, y;
+		memcpy(&x, a + i, 8);
+		memcpy(&y, b + i, 8);
+		x ^= y;
+		memcpy(out + i, &x, 8);
+	}
+	for (; i < size; i++)
+		out[i] = a[i] ^ b[i];
+}
+
+int FrameCapture::start(const char *fileName)
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	if (fp_)
+		return 0;
+	fp_ = fopen(fileName, "wb");
+	if (!fp_)
+	{
+		printf("Error open capture file %s.\n", fileName);
+		return -1;
+	}
+	// record times are media times, a session on virtual time is captured as it was stamped.
+	origin_ = MediaClock::now();
+	int64_t epoch_ms = MediaClock::epoch_ms(origin_);
+	fwrite(capture_magic, 1, sizeof(capture_magic), fp_);
+	fwrite(&capture_version, sizeof(capture_version), 1, fp_);
+	fwrite(&epoch_ms, sizeof(epoch_ms), 1, fp_);
+	stopping_ = false;
+	frames_ = dropped_ = written_bytes_ = 0;
+	capture_ids_.clear();
+	next_capture_id_ = 1;
+	worker_ = std::thread(&FrameCapture::run);
+	on_ = true;
+	printf("capturing raw frames to %s\n", fileName);
+	return 0;
+}
+
+void FrameCapture::stop()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		if (!fp_)
+			return;
+		on_ = false;
+		stopping_ = true;
+		cond_.notify_one();
+	}
+	worker_.join();
+	fclose(fp_);
+	fp_ = NULL;
+	last_frame_.clear();
+	printf("capture finished: %lld frames, %lld dropped, %lld bytes\n", (long long)frames_, (long long)dropped_,
+		   (long long)written_bytes_);
+}
+
+void FrameCapture::push(Item &item)
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	if (stopping_)
+		return;
+	if (item.type == Record_Frame && pending_bytes_ + item.planes.size() > max_pending_bytes)
+	{
+		// keep the event, lose the picture.
+		item.type = Record_Dropped;
+		spare_.push_back(std::move(item.planes));
+		item.planes.clear();
+	}
+	pending_bytes_ += item.planes.size();
+	pending_.push_back(std::move(item));
+	cond_.notify_one();
+}
+
+uint32_t FrameCapture::capture_id(IZoomVideoSDKUser *user)
+{
+	auto found = capture_ids_.find(user);
+	if (found != capture_ids_.end())
+		return found->second;
+	capture_ids_[user] = next_capture_id_;
+	return next_capture_id_++;
+}
+
+void FrameCapture::on_user_event(CaptureRecordType type, IZoomVideoSDKUser *user)
+{
+	on_event(type, user, 0);
+}
+
+void FrameCapture::on_camera_event(CaptureRecordType type, IZoomVideoSDKUser *user, IZoomVideoSDKRawDataPipe *pipe)
+{
+	if (!on_ || !user)
+		return;
+	int camera = 0;
+	IVideoSDKVector<IZoomVideoSDKRawDataPipe *> *cameras = user->getMultiCameraStreamList();
+	int count = cameras ? cameras->GetCount() : 0;
+	for (int index = 0; index < count; index++)
+	{
+		if (cameras->GetItem(index) == pipe)
+			camera = index + 1;
+	}
+	on_event(type, user, camera);
+}
+
+void FrameCapture::on_event(CaptureRecordType type, IZoomVideoSDKUser *user, int camera)
+{
+	if (!on_ || !user)
+		return;
+	Item item;
+	item.type = type;
+	item.time_us = duration_cast<microseconds>(MediaClock::now() - origin_).count();
+	item.user_id = user->getUserID() ? user->getUserID() : "";
+	item.name = user->getUserName();
+	item.profile = 0;
+	item.camera = camera;
+	item.width = item.height = 0;
+	item.rotation = item.source_id = 0;
+	item.full_range = false;
+	item.traced = false;
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		item.capture_id = capture_id(user);
+		// a user object coming back after it left is a new user.
+		if (type == Record_Leave)
+			capture_ids_.erase(user);
+	}
+	push(item);
+}
+
+void FrameCapture::on_frame(IZoomVideoSDKUser *user, int profile, int camera, YUVRawDataI420 *data)
+{
+	if (!on_ || !user || !data)
+		return;
+	Item item;
+	item.type = Record_Frame;
+	item.time_us = duration_cast<microseconds>(MediaClock::now() - origin_).count();
+	item.profile = profile;
+	item.camera = camera;
+	item.width = data->GetStreamWidth();
+	item.height = data->GetStreamHeight();
+	item.rotation = data->GetRotation();
+	item.source_id = data->GetSourceID();
+	item.full_range = !data->IsLimitedI420();
+	item.traced = FrameTrace::in_sampled_frame();
+	item.trace_stream = FrameTrace::sampled_stream();
+	item.queued = steady_clock::now();
+
+	size_t y_size = (size_t)item.width * item.height;
+	size_t uv_size = (size_t)((item.width + 1) / 2) * ((item.height + 1) / 2);
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		item.capture_id = capture_id(user);
+		if (!spare_.empty())
+		{
+			item.planes.swap(spare_.back());
+			spare_.pop_back();
+		}
+	}
+	item.planes.resize(y_size + uv_size * 2);
+	memcpy(item.planes.data(), data->GetYBuffer(), y_size);
+	memcpy(item.planes.data() + y_size, data->GetUBuffer(), uv_size);
+	memcpy(item.planes.data() + y_size + uv_size, data->GetVBuffer(), uv_size);
+	push(item);
+}
+
+void FrameCapture::run()
+{
+	std::vector<Item> batch;
+	while (true)
+	{
+		{
+			std::unique_lock<std::mutex> lock(mutex_);
+			// frame buffers of the last batch go back for reuse, a few are enough.
+			for (auto iter = batch.begin(); iter != batch.end() && spare_.size() < 8; iter++)
+			{
+				if (iter->planes.capacity())
+					spare_.push_back(std::move(iter->planes));
+			}
+			batch.clear();
+			cond_.wait(lock, [] { return !pending_.empty() || stopping_; });
+			if (pending_.empty())
+				break;
+			batch.swap(pending_);
+			pending_bytes_ = 0;
+		}
+		for (auto iter = batch.begin(); iter != batch.end(); iter++)
+		{
+			if (!iter->traced)
+			{
+				write(*iter);
+				continue;
+			}
+			steady_clock::time_point begin = steady_clock::now();
+			FrameTrace::record("queue_wait", iter->trace_stream, iter->queued, begin);
+			write(*iter);
+			FrameTrace::record("write", iter->trace_stream, begin, steady_clock::now());
+		}
+		fflush(fp_);
+	}
+}
+
+void FrameCapture::write(Item &item)
+{
+	std::vector<char> payload;
+	put(payload, item.capture_id);
+	switch (item.type)
+	{
+	case Record_Join:
+		put_string(payload, item.user_id);
+		put_string(payload, item.name);
+		break;
+	case Record_NameChanged:
+		put_string(payload, item.name);
+		break;
+	case Record_CameraJoin:
+	case Record_CameraLeave:
+		put(payload, (uint16_t)item.camera);
+		break;
+	case Record_Dropped:
+		put(payload, (uint8_t)item.profile);
+		put(payload, (uint16_t)item.camera);
+		dropped_++;
+		break;
+	case Record_Frame:
+	{
+		std::vector<char> &last = last_frame_[stream_key(item.capture_id, item.profile, item.camera)];
+		const size_t size = item.planes.size();
+		const char *source = item.planes.data();
+		uint8_t flags = item.full_range ? Frame_FullRange : 0;
+		if (last.size() == size)
+		{
+			work_.resize(size);
+			xor_planes(work_.data(), item.planes.data(), last.data(), size);
+			source = work_.data();
+			flags |= Frame_Delta;
+		}
+		uLongf deflated_size = compressBound(size);
+		deflated_.resize(deflated_size);
+		if (compress2((Bytef *)deflated_.data(), &deflated_size, (const Bytef *)source, size, 1) != Z_OK)
+		{
+			dropped_++;
+			return;
+		}
+		put(payload, (uint8_t)item.profile);
+		put(payload, flags);
+		put(payload, (uint16_t)item.camera);
+		put(payload, (uint32_t)item.width);
+		put(payload, (uint32_t)item.height);
+		put(payload, (uint32_t)item.rotation);
+		put(payload, (uint32_t)item.source_id);
+		put(payload, (uint32_t)size);
+		put_bytes(payload, deflated_.data(), deflated_size);
+		// the frame becomes the reference of the next one, the old reference is recycled.
+		last.swap(item.planes);
+		frames_++;
+		break;
+	}
+	default:
+		break;
+	}
+
+	std::vector<char> header;
+	put(header, (uint8_t)item.type);
+	put_bytes(header, "\0\0\0", 3);
+	put(header, (uint32_t)payload.size());
+	put(header, item.time_us);
+	fwrite(header.data(), 1, header.size(), fp_);
+	fwrite(payload.data(), 1, payload.size(), fp_);
+	written_bytes_ += header.size() + payload.size();
+}
+
+FrameCaptureReader::~FrameCaptureReader()
+{
+	if (fp_)
+		fclose(fp_);
+}
+
+int FrameCaptureReader::open(const char *fileName)
+{
+	fp_ = fopen(fileName, "rb");
+	if (!fp_)
+	{
+		printf("Error open capture file %s.\n", fileName);
+		return -1;
+	}
+	char magic[sizeof(capture_magic)];
+	uint32_t version = 0;
+	if (fread(magic, 1, sizeof(magic), fp_) != sizeof(magic) || memcmp(magic, capture_magic, sizeof(magic)) != 0 ||
+		fread(&version, sizeof(version), 1, fp_) != 1 || version != capture_version ||
+		fread(&start_epoch_ms_, sizeof(start_epoch_ms_), 1, fp_) != 1)
+	{
+		printf("Error %s is not a capture file of version %u.\n", fileName, capture_version);
+		fclose(fp_);
+		fp_ = NULL;
+		return -1;
+	}
+	return 0;
+}
+
+bool FrameCaptureReader::next(CaptureRecord &record)
+{
+	if (!fp_)
+		return false;
+	std::vector<char> header(record_header_size);
+	if (fread(header.data(), 1, header.size(), fp_) != header.size())
+		return false;
+	uint8_t type;
+	uint32_t size;
+	size_t pos = 0;
+	get(header, pos, &type);
+	pos += 3;
+	get(header, pos, &size);
+	get(header, pos, &record.time_us);
+	payload_.resize(size);
+	if (fread(payload_.data(), 1, size, fp_) != size)
+		return false;
+
+	record.type = (CaptureRecordType)type;
+	record.user_id.clear();
+	record.name.clear();
+	record.profile = record.camera = 0;
+	pos = 0;
+	if (!get(payload_, pos, &record.capture_id))
+		return false;
+	uint8_t profile, flags;
+	uint16_t camera;
+	switch (record.type)
+	{
+	case Record_Join:
+		return get_string(payload_, pos, &record.user_id) && get_string(payload_, pos, &record.name);
+	case Record_NameChanged:
+		return get_string(payload_, pos, &record.name);
+	case Record_CameraJoin:
+	case Record_CameraLeave:
+		if (!get(payload_, pos, &camera))
+			return false;
+		record.camera = camera;
+		return true;
+	case Record_Dropped:
+		if (!get(payload_, pos, &profile) || !get(payload_, pos, &camera))
+			return false;
+		record.profile = profile;
+		record.camera = camera;
+		return true;
+	case Record_Frame:
+	{
+		uint32_t width, height, rotation, source_id, raw_size;
+		if (!get(payload_, pos, &profile) || !get(payload_, pos, &flags) || !get(payload_, pos, &camera) ||
+			!get(payload_, pos, &width) || !get(payload_, pos, &height) || !get(payload_, pos, &rotation) ||
+			!get(payload_, pos, &source_id) || !get(payload_, pos, &raw_size))
+			return false;
+		record.profile = profile;
+		record.camera = camera;
+		record.width = width;
+		record.height = height;
+		record.rotation = rotation;
+		record.source_id = source_id;
+		record.full_range = (flags & Frame_FullRange) != 0;
+		record.planes.resize(raw_size);
+		uLongf inflated_size = raw_size;
+		if (uncompress((Bytef *)record.planes.data(), &inflated_size, (const Bytef *)payload_.data() + pos,
+					   payload_.size() - pos) != Z_OK ||
+			inflated_size != raw_size)
+			return false;
+		std::vector<char> &last = last_frame_[stream_key(record.capture_id, profile, camera)];
+		if (flags & Frame_Delta)
+		{
+			if (last.size() != raw_size)
+				return false;
+			xor_planes(record.planes.data(), record.planes.data(), last.data(), raw_size);
+		}
+		last = record.planes;
+		return true;
+	}
+	default:
+		return true;
+	}
+}
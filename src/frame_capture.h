@@ -0,0 +1,144 @@
+#pragma once
+#include <stdio.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <condition_variable>
+#include <chrono>
+using namespace std::chrono;
+
+// Zoom Video SDK
+#include "zoom_sdk_raw_data_def.h"
+#include "helpers/zoom_video_sdk_user_helper_interface.h"
+using namespace ZOOMVIDEOSDK;
+
+// Capture file: an 8 byte magic, the format version and the capture start
+// (epoch ms), then records of a RecordHeader and its payload, in host byte
+// order. Strings are a 16 bit length and the bytes. Every payload starts with
+// the user's capture id, a number given to each user the first time it shows
+// up: the SDK user id can still be empty at join.
+// Frame payload: capture id, profile (VideoProfile), flags, camera index, width,
+// height, rotation, source id, the I420 size, then the planes deflated. A frame
+// flagged Frame_Delta was XORed with the previous frame of its stream first, so
+// a repeated frame takes a few bytes.
+typedef enum
+{
+	Record_Join = 1,    // capture id, user id, name
+	Record_Leave,       // capture id
+	Record_NameChanged, // capture id, name
+	Record_ShareStart,  // capture id
+	Record_ShareStop,   // capture id
+	Record_CameraJoin,  // capture id, camera index
+	Record_CameraLeave, // capture id, camera index
+	Record_Frame,
+	Record_Dropped, // capture id, profile, camera index: the writer fell behind and lost a frame
+} CaptureRecordType;
+
+enum
+{
+	Frame_FullRange = 1,
+	Frame_Delta = 2,
+};
+
+struct CaptureRecord
+{
+	CaptureRecordType type;
+	int64_t time_us; // arrival, from the capture start
+	uint32_t capture_id = 0;
+	std::string user_id; // Record_Join
+	std::string name;
+	int profile = 0;
+	int camera = 0;
+	int width = 0;
+	int height = 0;
+	unsigned int rotation = 0;
+	unsigned int source_id = 0;
+	bool full_range = false;
+	std::vector<char> planes; // Record_Frame: contiguous I420
+};
+
+// Writes every frame the per-user encoders receive and the user events driving
+// them to a capture file, for zoom_v-sdk_replay. The SDK callback only copies
+// the frame; compression and writing happen on a worker. When the worker falls
+// max_pending_bytes behind, frames are dropped and recorded as dropped.
+class FrameCapture
+{
+	struct Item
+	{
+		CaptureRecordType type;
+		int64_t time_us;
+		uint32_t capture_id;
+		std::string user_id;
+		std::string name;
+		int profile;
+		int camera;
+		int width;
+		int height;
+		unsigned int rotation;
+		unsigned int source_id;
+		bool full_range;
+		std::vector<char> planes;
+		// frames of a sampled frame trace, their queue wait and write are traced on the worker.
+		bool traced;
+		int trace_stream;
+		steady_clock::time_point queued;
+	};
+	static const size_t max_pending_bytes = 256 * 1024 * 1024;
+
+	static std::atomic<bool> on_;
+	static std::mutex mutex_;
+	static std::condition_variable cond_;
+	static std::vector<Item> pending_;
+	static std::vector<std::vector<char> > spare_; // frame buffers for reuse
+	static size_t pending_bytes_;
+	static bool stopping_;
+	static std::thread worker_;
+	static FILE* fp_;
+	static steady_clock::time_point origin_;
+	static int64_t frames_;
+	static int64_t dropped_;
+	static int64_t written_bytes_;
+	static std::map<IZoomVideoSDKUser*, uint32_t> capture_ids_;
+	static uint32_t next_capture_id_;
+
+	// worker side
+	static std::map<std::string, std::vector<char> > last_frame_;
+	static std::vector<char> work_;
+	static std::vector<char> deflated_;
+	static void run();
+	static void write(Item& item);
+	static void push(Item& item);
+	// the user's capture id, a new one for a user not seen yet; with mutex_ held.
+	static uint32_t capture_id(IZoomVideoSDKUser* user);
+	static void on_event(CaptureRecordType type, IZoomVideoSDKUser* user, int camera);
+
+public:
+	static int start(const char* fileName);
+	// writes everything queued and closes the file.
+	static void stop();
+	static bool is_on() { return on_; }
+	static void on_user_event(CaptureRecordType type, IZoomVideoSDKUser* user);
+	// Record_CameraJoin and Record_CameraLeave, the camera is numbered like the encoder numbers it.
+	static void on_camera_event(CaptureRecordType type, IZoomVideoSDKUser* user, IZoomVideoSDKRawDataPipe* pipe);
+	static void on_frame(IZoomVideoSDKUser* user, int profile, int camera, YUVRawDataI420* data);
+};
+
+// Reads a capture file back, frames are inflated and un-deltaed.
+class FrameCaptureReader
+{
+	FILE* fp_ = NULL;
+	int64_t start_epoch_ms_ = 0;
+	std::map<std::string, std::vector<char> > last_frame_;
+	std::vector<char> payload_;
+
+public:
+	~FrameCaptureReader();
+	int open(const char* fileName);
+	int64_t start_epoch_ms() { return start_epoch_ms_; }
+	// false at the end of the file or on a damaged record.
+	bool next(CaptureRecord& record);
+};
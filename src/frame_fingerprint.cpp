@@ -0,0 +1,52 @@
+#include "frame_fingerprint.h"
+#include <string.h>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+bool FrameFingerprint::equal_bytes(const uint8_t *a, const uint8_t *b, size_t size)
+{
+	size_t i = 0;
+#if defined(__SSE2__)
+	for (; i + 64 <= size; i += 64)
+	{
+		__m128i e0 = _mm_cmpeq_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i *>(a + i)),
+									_mm_loadu_si128(reinterpret_cast<const __m128i *>(b + i)));
+		__m128i e1 = _mm_cmpeq_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i *>(a + i + 16)),
+									_mm_loadu_si128(reinterpret_cast<const __m128i *>(b + i + 16)));
+		__m128i e2 = _mm_cmpeq_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i *>(a + i + 32)),
+									_mm_loadu_si128(reinterpret_cast<const __m128i *>(b + i + 32)));
+		__m128i e3 = _mm_cmpeq_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i *>(a + i + 48)),
+									_mm_loadu_si128(reinterpret_cast<const __m128i *>(b + i + 48)));
+		__m128i e = _mm_and_si128(_mm_and_si128(e0, e1), _mm_and_si128(e2, e3));
+		if (_mm_movemask_epi8(e) != 0xFFFF)
+			return false;
+	}
+#endif
+	return memcmp(a + i, b + i, size - i) == 0;
+}
+
+bool FrameFingerprint::is_duplicate(const uint8_t *Y, const uint8_t *U, const uint8_t *V, int width, int height)
+{
+	const size_t y_size = (size_t)width * height;
+	const size_t uv_size = (size_t)((width + 1) / 2) * ((height + 1) / 2);
+
+	if (has_prev_ && width == width_ && height == height_)
+	{
+		const uint8_t *prev = prev_.data();
+		// Y first: any motion almost always shows there.
+		if (equal_bytes(Y, prev, y_size) &&
+			equal_bytes(U, prev + y_size, uv_size) &&
+			equal_bytes(V, prev + y_size + uv_size, uv_size))
+			return true;
+	}
+
+	width_ = width;
+	height_ = height;
+	prev_.resize(y_size + uv_size * 2);
+	memcpy(prev_.data(), Y, y_size);
+	memcpy(prev_.data() + y_size, U, uv_size);
+	memcpy(prev_.data() + y_size + uv_size, V, uv_size);
+	has_prev_ = true;
+	return false;
+}
@@ -0,0 +1,23 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+// Detects I420 frames identical to the previous one, before any scaling or
+// encoding is spent on them. The planes are compared against a copy of the
+// last distinct frame with SSE2, 64 bytes per step with an early exit on the
+// first difference; the copy is only refreshed when the frame changed.
+class FrameFingerprint
+{
+	int width_ = 0;
+	int height_ = 0;
+	std::vector<uint8_t> prev_;
+	bool has_prev_ = false;
+
+public:
+	static bool equal_bytes(const uint8_t* a, const uint8_t* b, size_t size);
+
+	// true when Y/U/V (tightly packed, width x height) equal the previous frame.
+	bool is_duplicate(const uint8_t* Y, const uint8_t* U, const uint8_t* V, int width, int height);
+	void reset() { has_prev_ = false; }
+};
@@ -0,0 +1,167 @@
+#include "frame_rotator.h"
+#include <string.h>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+// 64x64 source tiles: the 8x8 blocks of a tile fill whole cache lines of dst
+// before moving on, instead of touching one line per dst row across the frame.
+static const int tile_size = 64;
+
+int FrameRotator::quarter_turns(unsigned int rotation)
+{
+	if (rotation >= 4)
+		return (rotation / 90) % 4;
+	return rotation;
+}
+
+#if defined(__SSE2__)
+// transpose the 8x8 block at src into dst; rows are read bottom-up when flip is set.
+static inline void transpose_8x8(const uint8_t *src, int src_stride, uint8_t *dst, int dst_stride, bool flip)
+{
+	__m128i r[8];
+	for (int i = 0; i < 8; i++)
+		r[i] = _mm_loadl_epi64(reinterpret_cast<const __m128i *>(src + (flip ? 7 - i : i) * src_stride));
+
+	__m128i a0 = _mm_unpacklo_epi8(r[0], r[1]);
+	__m128i a1 = _mm_unpacklo_epi8(r[2], r[3]);
+	__m128i a2 = _mm_unpacklo_epi8(r[4], r[5]);
+	__m128i a3 = _mm_unpacklo_epi8(r[6], r[7]);
+	__m128i b0 = _mm_unpacklo_epi16(a0, a1);
+	__m128i b1 = _mm_unpackhi_epi16(a0, a1);
+	__m128i b2 = _mm_unpacklo_epi16(a2, a3);
+	__m128i b3 = _mm_unpackhi_epi16(a2, a3);
+	// each register holds two columns of the block, i.e. two rows of the result.
+	__m128i c[4];
+	c[0] = _mm_unpacklo_epi32(b0, b2);
+	c[1] = _mm_unpackhi_epi32(b0, b2);
+	c[2] = _mm_unpacklo_epi32(b1, b3);
+	c[3] = _mm_unpackhi_epi32(b1, b3);
+	for (int i = 0; i < 4; i++)
+	{
+		_mm_storel_epi64(reinterpret_cast<__m128i *>(dst + (2 * i) * dst_stride), c[i]);
+		_mm_storel_epi64(reinterpret_cast<__m128i *>(dst + (2 * i + 1) * dst_stride), _mm_unpackhi_epi64(c[i], c[i]));
+	}
+}
+
+static inline __m128i reverse_16(__m128i v)
+{
+	v = _mm_shuffle_epi32(v, _MM_SHUFFLE(0, 1, 2, 3));
+	v = _mm_shufflelo_epi16(v, _MM_SHUFFLE(2, 3, 0, 1));
+	v = _mm_shufflehi_epi16(v, _MM_SHUFFLE(2, 3, 0, 1));
+	return _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8));
+}
+#endif
+
+// rotate the source rectangle [x0, x1) x [y0, y1) pixel by pixel.
+static void rotate_region(const uint8_t *src, int src_stride, int width, int height,
+						  uint8_t *dst, int dst_stride, int turns, int x0, int x1, int y0, int y1)
+{
+	for (int y = y0; y < y1; y++)
+	{
+		const uint8_t *row = src + y * src_stride;
+		for (int x = x0; x < x1; x++)
+		{
+			switch (turns)
+			{
+			case 1:
+				dst[x * dst_stride + (height - 1 - y)] = row[x];
+				break;
+			case 2:
+				dst[(height - 1 - y) * dst_stride + (width - 1 - x)] = row[x];
+				break;
+			case 3:
+				dst[(width - 1 - x) * dst_stride + y] = row[x];
+				break;
+			}
+		}
+	}
+}
+
+void FrameRotator::rotate_plane(const uint8_t *src, int src_stride, int width, int height,
+								uint8_t *dst, int dst_stride, int turns)
+{
+	if (turns == 0)
+	{
+		for (int y = 0; y < height; y++)
+			memcpy(dst + y * dst_stride, src + y * src_stride, width);
+		return;
+	}
+
+	// the part covered by the SIMD kernels, the rest is done by rotate_region.
+	int done_w = 0;
+	int done_h = 0;
+#if defined(__SSE2__)
+	if (turns == 2)
+	{
+		done_w = width & ~15;
+		done_h = height;
+		for (int y = 0; y < height; y++)
+		{
+			const uint8_t *row = src + y * src_stride;
+			uint8_t *out = dst + (height - 1 - y) * dst_stride + width;
+			for (int x = 0; x < done_w; x += 16)
+			{
+				__m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(row + x));
+				_mm_storeu_si128(reinterpret_cast<__m128i *>(out - x - 16), reverse_16(v));
+			}
+		}
+	}
+	else
+	{
+		done_w = width & ~7;
+		done_h = height & ~7;
+		for (int ty = 0; ty < done_h; ty += tile_size)
+		{
+			for (int tx = 0; tx < done_w; tx += tile_size)
+			{
+				for (int by = ty; by < ty + tile_size && by < done_h; by += 8)
+				{
+					for (int bx = tx; bx < tx + tile_size && bx < done_w; bx += 8)
+					{
+						const uint8_t *block = src + by * src_stride + bx;
+						if (turns == 1)
+							transpose_8x8(block, src_stride, dst + bx * dst_stride + (height - 8 - by), dst_stride, true);
+						else
+							// 270: the block's columns land on dst rows going upwards.
+							transpose_8x8(block, src_stride, dst + (width - 1 - bx) * dst_stride + by, -dst_stride, false);
+					}
+				}
+			}
+		}
+	}
+#endif
+	rotate_region(src, src_stride, width, height, dst, dst_stride, turns, done_w, width, 0, height);
+	rotate_region(src, src_stride, width, height, dst, dst_stride, turns, 0, done_w, done_h, height);
+}
+
+void FrameRotator::rotate(const uint8_t *Y, const uint8_t *U, const uint8_t *V, int &width, int &height, int turns,
+						  const uint8_t **outY, const uint8_t **outU, const uint8_t **outV)
+{
+	const int uv_width = (width + 1) / 2;
+	const int uv_height = (height + 1) / 2;
+	const size_t y_size = (size_t)width * height;
+	const size_t uv_size = (size_t)uv_width * uv_height;
+	if (buffer_.size() < y_size + uv_size * 2)
+		buffer_.resize(y_size + uv_size * 2);
+
+	const bool swap = turns % 2 == 1;
+	const int out_width = swap ? height : width;
+	const int out_uv_width = swap ? uv_height : uv_width;
+	uint8_t *dstY = buffer_.data();
+	uint8_t *dstU = dstY + y_size;
+	uint8_t *dstV = dstU + uv_size;
+	rotate_plane(Y, width, width, height, dstY, out_width, turns);
+	rotate_plane(U, uv_width, uv_width, uv_height, dstU, out_uv_width, turns);
+	rotate_plane(V, uv_width, uv_width, uv_height, dstV, out_uv_width, turns);
+
+	if (swap)
+	{
+		int tmp = width;
+		width = height;
+		height = tmp;
+	}
+	*outY = dstY;
+	*outU = dstU;
+	*outV = dstV;
+}
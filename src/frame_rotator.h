@@ -0,0 +1,29 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+// Turns I420 frames upright according to YUVRawDataI420::GetRotation(), so
+// portrait cameras are not recorded sideways. The rotated frame is written to a
+// buffer owned by the rotator, which then stands in for the SDK buffer; a
+// rotation is the one copy of the frame, never an extra pass.
+// 90/270 transpose the planes in 8x8 blocks with SSE2, 180 reverses rows 16
+// bytes at a time; the block edges are done in scalar code.
+class FrameRotator
+{
+	std::vector<uint8_t> buffer_;
+
+public:
+	// clockwise quarter turns for an SDK rotation value, which is either
+	// 0..3 or degrees depending on the platform the sender is on.
+	static int quarter_turns(unsigned int rotation);
+
+	// dst is (turns odd ? height x width : width x height).
+	static void rotate_plane(const uint8_t* src, int src_stride, int width, int height,
+							 uint8_t* dst, int dst_stride, int turns);
+
+	// rotate tightly packed Y/U/V by turns, and return the planes of the result.
+	// width/height are updated to the rotated size.
+	void rotate(const uint8_t* Y, const uint8_t* U, const uint8_t* V, int& width, int& height, int turns,
+				const uint8_t** outY, const uint8_t** outU, const uint8_t** outV);
+};
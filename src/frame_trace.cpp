@@ -0,0 +1,206 @@
+#include "frame_trace.h"
+#include <stdio.h>
+#include <algorithm>
+#include <unistd.h>
+#include <sys/syscall.h>
+
+std::atomic<bool> FrameTrace::on_(false);
+std::atomic<bool> FrameTrace::dump_requested_(false);
+int FrameTrace::sample_every_ = 1;
+steady_clock::time_point FrameTrace::origin_;
+std::string FrameTrace::file_name_;
+std::mutex FrameTrace::mutex_;
+std::condition_variable FrameTrace::cond_;
+bool FrameTrace::stopping_ = false;
+std::thread FrameTrace::dumper_;
+std::vector<FrameTrace::Buffer *> FrameTrace::buffers_;
+
+// state of the calling thread: frames open, whether the outermost is sampled.
+static thread_local int frame_depth = 0;
+static thread_local bool frame_sampled = false;
+static thread_local uint32_t frame_serial = 0;
+static thread_local int frame_stream = -1;
+static thread_local uint32_t sample_random = 0;
+
+int FrameTrace::start(const char *fileName, int sample_every)
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	if (on_ || sample_every <= 0)
+		return -1;
+	file_name_ = fileName;
+	sample_every_ = sample_every;
+	origin_ = steady_clock::now();
+	stopping_ = false;
+	dump_requested_ = false;
+	dumper_ = std::thread(&FrameTrace::run);
+	on_ = true;
+	printf("tracing one frame in %d to %s\n", sample_every, fileName);
+	return 0;
+}
+
+void FrameTrace::stop()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		if (!on_)
+			return;
+		on_ = false;
+		stopping_ = true;
+		cond_.notify_one();
+	}
+	dumper_.join();
+	dump(file_name_.c_str());
+}
+
+void FrameTrace::run()
+{
+	std::unique_lock<std::mutex> lock(mutex_);
+	while (!stopping_)
+	{
+		// a signal handler cannot notify, the flag is polled.
+		cond_.wait_for(lock, milliseconds(200));
+		if (dump_requested_.exchange(false))
+		{
+			lock.unlock();
+			dump(file_name_.c_str());
+			lock.lock();
+		}
+	}
+}
+
+FrameTrace::Buffer *FrameTrace::thread_buffer()
+{
+	static thread_local Buffer *buffer = NULL;
+	if (!buffer)
+	{
+		buffer = new Buffer();
+		buffer->tid = (int)syscall(SYS_gettid);
+		buffer->head = 0;
+		std::lock_guard<std::mutex> lock(mutex_);
+		buffers_.push_back(buffer);
+	}
+	return buffer;
+}
+
+void FrameTrace::record(const char *name, int stream, steady_clock::time_point begin, steady_clock::time_point end)
+{
+	Buffer *buffer = thread_buffer();
+	uint64_t head = buffer->head.load(std::memory_order_relaxed);
+	Event &event = buffer->events[head % buffer_events];
+	event.name = name;
+	event.begin_ns = duration_cast<nanoseconds>(begin - origin_).count();
+	event.duration_ns = duration_cast<nanoseconds>(end - begin).count();
+	event.stream = stream;
+	event.frame = frame_depth > 0 ? frame_serial : 0;
+	// the event is complete before a dump can see it.
+	buffer->head.store(head + 1, std::memory_order_release);
+}
+
+bool FrameTrace::in_sampled_frame()
+{
+	return frame_depth > 0 && frame_sampled;
+}
+
+int FrameTrace::sampled_stream()
+{
+	return frame_stream;
+}
+
+int FrameTrace::dump(const char *fileName)
+{
+	std::vector<Buffer *> buffers;
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		buffers = buffers_;
+	}
+	FILE *fp = fopen(fileName, "w");
+	if (!fp)
+	{
+		printf("Error open trace file %s.\n", fileName);
+		return -1;
+	}
+	const int pid = getpid();
+	int64_t count = 0;
+	std::vector<Event> events;
+	fprintf(fp, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[");
+	for (auto iter = buffers.begin(); iter != buffers.end(); iter++)
+	{
+		// copied while the thread may go on writing: what it overwrote meanwhile is left out.
+		Buffer *buffer = *iter;
+		uint64_t head = buffer->head.load(std::memory_order_acquire);
+		uint64_t first = head > buffer_events ? head - buffer_events : 0;
+		events.clear();
+		for (uint64_t index = first; index < head; index++)
+			events.push_back(buffer->events[index % buffer_events]);
+		// the slot of event head_after may be half written already, it holds event head_after - buffer_events.
+		uint64_t head_after = buffer->head.load(std::memory_order_acquire);
+		uint64_t valid = head_after + 1 > buffer_events ? head_after + 1 - buffer_events : 0;
+		fprintf(fp, "%s\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%d,\"args\":{\"name\":\"thread %d\"}}",
+				count++ ? "," : "", pid, buffer->tid, buffer->tid);
+		for (uint64_t index = std::max(first, valid); index < head; index++)
+		{
+			const Event &event = events[index - first];
+			fprintf(fp, ",\n{\"name\":\"%s\",\"cat\":\"video\",\"ph\":\"X\",\"pid\":%d,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f,"
+						"\"args\":{\"stream\":%d,\"frame\":%u}}",
+					event.name, pid, buffer->tid, event.begin_ns / 1000.0, event.duration_ns / 1000.0, event.stream, event.frame);
+			count++;
+		}
+	}
+	fprintf(fp, "\n]}\n");
+	fclose(fp);
+	printf("trace written to %s, %lld events\n", fileName, (long long)(count - buffers.size()));
+	return 0;
+}
+
+TraceFrame::TraceFrame(const char *name, int stream)
+	: name_(name), stream_(stream), counted_(false), recording_(false)
+{
+	if (!FrameTrace::on_.load(std::memory_order_relaxed))
+		return;
+	counted_ = true;
+	if (frame_depth++ == 0)
+	{
+		// xorshift, seeded per thread, so the threads' samples do not line up.
+		if (!sample_random)
+			sample_random = (uint32_t)syscall(SYS_gettid) * 2654435761u | 1;
+		sample_random ^= sample_random << 13;
+		sample_random ^= sample_random >> 17;
+		sample_random ^= sample_random << 5;
+		frame_sampled = sample_random % FrameTrace::sample_every_ == 0;
+		if (frame_sampled)
+		{
+			frame_serial++;
+			frame_stream = stream;
+		}
+	}
+	recording_ = frame_sampled;
+	if (recording_)
+		begin_ = steady_clock::now();
+}
+
+TraceFrame::~TraceFrame()
+{
+	if (recording_)
+		FrameTrace::record(name_, stream_ >= 0 ? stream_ : frame_stream, begin_, steady_clock::now());
+	if (counted_)
+		frame_depth--;
+}
+
+TraceSpan::TraceSpan(const char *name)
+	: name_(name), recording_(frame_depth > 0 && frame_sampled)
+{
+	if (recording_)
+		begin_ = steady_clock::now();
+}
+
+TraceSpan::~TraceSpan()
+{
+	end();
+}
+
+void TraceSpan::end()
+{
+	if (recording_)
+		FrameTrace::record(name_, frame_stream, begin_, steady_clock::now());
+	recording_ = false;
+}
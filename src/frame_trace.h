@@ -0,0 +1,97 @@
+#pragma once
+#include <stdint.h>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <string>
+#include <condition_variable>
+#include <chrono>
+using namespace std::chrono;
+
+// Per-frame timing of the video pipeline, written as Chrome trace JSON (open it
+// in chrome://tracing or ui.perfetto.dev). One frame in sample_every is traced:
+// the TraceFrame opened where a frame enters a thread decides, and the spans
+// opened under it on that thread are recorded with it. Events go to a ring
+// buffer per thread that only that thread writes, so recording takes no lock;
+// a dump holds the latest events of each thread. Dumps are written on demand,
+// on request_dump() (safe in a signal handler) and when tracing stops.
+class FrameTrace
+{
+	struct Event
+	{
+		const char* name; // a string literal
+		int64_t begin_ns; // from the trace start
+		int64_t duration_ns;
+		int32_t stream;
+		uint32_t frame; // sampled frame of the thread, groups a frame's spans
+	};
+	static const size_t buffer_events = 16384;
+	struct Buffer
+	{
+		int tid;
+		std::atomic<uint64_t> head; // events written so far, the ring wraps
+		Event events[buffer_events];
+	};
+
+	static std::atomic<bool> on_;
+	static std::atomic<bool> dump_requested_;
+	static int sample_every_;
+	static steady_clock::time_point origin_;
+	static std::string file_name_;
+	static std::mutex mutex_;
+	static std::condition_variable cond_;
+	static bool stopping_;
+	static std::thread dumper_;
+	static std::vector<Buffer*> buffers_; // never freed, a thread may still write to its own
+
+	static Buffer* thread_buffer();
+	static void run();
+
+	friend class TraceFrame;
+	friend class TraceSpan;
+
+public:
+	// traces one frame in sample_every to fileName.
+	static int start(const char* fileName, int sample_every);
+	// writes a last dump.
+	static void stop();
+	static bool is_on() { return on_; }
+	static void request_dump() { dump_requested_ = true; }
+	static int dump(const char* fileName);
+	// a span timed elsewhere, e.g. the wait of a queued frame, recorded on the calling thread.
+	static void record(const char* name, int stream, steady_clock::time_point begin, steady_clock::time_point end);
+	// whether the calling thread is inside a sampled frame and its stream, for work
+	// handed to another thread, which records it there with record().
+	static bool in_sampled_frame();
+	static int sampled_stream();
+};
+
+// a frame entering a thread, opened for every frame; it is traced if sampled.
+// Opened inside another frame it is just a span of that one.
+class TraceFrame
+{
+	const char* name_;
+	int stream_;
+	bool counted_; // opened while tracing was on
+	bool recording_;
+	steady_clock::time_point begin_;
+
+public:
+	TraceFrame(const char* name, int stream = -1);
+	~TraceFrame();
+};
+
+// a stage of the frame being handled on this thread, recorded if the frame is sampled.
+class TraceSpan
+{
+	const char* name_;
+	bool recording_;
+	steady_clock::time_point begin_;
+
+public:
+	TraceSpan(const char* name);
+	~TraceSpan();
+	// ends the span before the scope does.
+	void end();
+};
@@ -0,0 +1,315 @@
+#include "gallery_compositor.h"
+#include "recording_file.h"
+#include "media_clock.h"
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+GalleryCompositor *GalleryCompositor::instance_ = nullptr;
+std::mutex GalleryCompositor::instance_mutex_;
+
+GalleryCompositor::GalleryCompositor(int width, int height, int fps)
+{
+	width_ = width;
+	height_ = height;
+	fps_ = fps;
+	running_ = false;
+}
+
+GalleryCompositor::~GalleryCompositor()
+{
+	for (auto iter = tick_slots_.begin(); iter != tick_slots_.end(); iter++)
+	{
+		sws_freeContext((*iter)->sws);
+		(*iter)->sws = nullptr;
+	}
+	for (auto iter = slots_.begin(); iter != slots_.end(); iter++)
+	{
+		sws_freeContext((*iter)->sws);
+		(*iter)->sws = nullptr;
+	}
+	if (canvas_)
+		av_frame_free(&canvas_);
+}
+
+int GalleryCompositor::start(const char *name, int width, int height, int fps)
+{
+	std::lock_guard<std::mutex> lock(instance_mutex_);
+	if (instance_)
+		return 0;
+
+	GalleryCompositor *compositor = new GalleryCompositor(width, height, fps);
+	compositor->canvas_ = FFMPEGVideoWriter::alloc_frame(width, height);
+	char fileName[120];
+	if (!compositor->canvas_ || RecordingFile::create(fileName, sizeof(fileName), name, ".mkv") < 0 ||
+		compositor->writer_.open(fileName, width, height, AVRational{1, fps}, "veryfast", "zerolatency", 2000000, fps * 10) < 0)
+	{
+		printf("Failed to start gallery view %s.\n", name);
+		delete compositor;
+		return -1;
+	}
+	printf("Gallery view started: %s, %dx%d@%d.\n", fileName, width, height, fps);
+	compositor->running_ = true;
+	compositor->thread_ = std::thread(&GalleryCompositor::run, compositor);
+	instance_ = compositor;
+	return 0;
+}
+
+void GalleryCompositor::stop()
+{
+	GalleryCompositor *compositor;
+	{
+		std::lock_guard<std::mutex> lock(instance_mutex_);
+		compositor = instance_;
+		instance_ = nullptr;
+	}
+	if (!compositor)
+		return;
+
+	compositor->running_ = false;
+	{
+		// on virtual time the last tick may wait for the clock to move.
+		MediaClockWait wait;
+		compositor->thread_.join();
+	}
+	compositor->writer_.close();
+	printf("Gallery view stopped: %d ticks, %d late, %d tile draws, %d busy tiles skipped.\n",
+		   compositor->ticks_, compositor->late_ticks_, compositor->draws_, compositor->busy_skips_);
+	delete compositor;
+}
+
+void GalleryCompositor::add_user(IZoomVideoSDKUser *user)
+{
+	std::lock_guard<std::mutex> lock(instance_mutex_);
+	if (!instance_)
+		return;
+	std::vector<std::shared_ptr<Slot>> &slots = instance_->slots_;
+	for (auto iter = slots.begin(); iter != slots.end(); iter++)
+	{
+		if ((*iter)->user == user)
+			return;
+	}
+	std::shared_ptr<Slot> slot(new Slot());
+	slot->user = user;
+	slots.push_back(slot);
+	instance_->layout_version_++;
+}
+
+void GalleryCompositor::remove_user(IZoomVideoSDKUser *user)
+{
+	std::lock_guard<std::mutex> lock(instance_mutex_);
+	if (!instance_)
+		return;
+	std::vector<std::shared_ptr<Slot>> &slots = instance_->slots_;
+	for (auto iter = slots.begin(); iter != slots.end(); iter++)
+	{
+		if ((*iter)->user == user)
+		{
+			// the tick thread may still hold the slot, it is freed with its last reference.
+			slots.erase(iter);
+			instance_->layout_version_++;
+			return;
+		}
+	}
+}
+
+void GalleryCompositor::on_frame(IZoomVideoSDKUser *user, const uint8_t *Y, const uint8_t *U, const uint8_t *V, int width, int height, bool full_range)
+{
+	std::shared_ptr<Slot> slot;
+	{
+		std::lock_guard<std::mutex> lock(instance_mutex_);
+		if (!instance_)
+			return;
+		std::vector<std::shared_ptr<Slot>> &slots = instance_->slots_;
+		for (auto iter = slots.begin(); iter != slots.end(); iter++)
+		{
+			if ((*iter)->user == user)
+			{
+				slot = *iter;
+				break;
+			}
+		}
+	}
+	if (!slot)
+		return;
+
+	const size_t y_size = (size_t)width * height;
+	// chroma planes round up like the SDK's, odd sizes included.
+	const size_t uv_size = (size_t)((width + 1) / 2) * ((height + 1) / 2);
+	std::lock_guard<std::mutex> lock(slot->mutex);
+	slot->frame.resize(y_size + uv_size * 2);
+	memcpy(slot->frame.data(), Y, y_size);
+	memcpy(slot->frame.data() + y_size, U, uv_size);
+	memcpy(slot->frame.data() + y_size + uv_size, V, uv_size);
+	slot->width = width;
+	slot->height = height;
+	slot->full_range = full_range;
+	slot->fresh = true;
+}
+
+void GalleryCompositor::run()
+{
+	const microseconds period(1000000 / fps_);
+	// the ticks pace virtual time together with whoever delivers the frames.
+	MediaClock::attach();
+	const steady_clock::time_point start = MediaClock::now();
+	int64_t tick = 0;
+	while (running_)
+	{
+		compose();
+		canvas_->pts = tick;
+		writer_.write(canvas_);
+		ticks_++;
+
+		tick++;
+		steady_clock::time_point next = start + period * tick;
+		steady_clock::time_point now = MediaClock::now();
+		if (now > next + period)
+		{
+			// fell behind, skip the missed ticks so the video stays on wall clock time.
+			late_ticks_++;
+			tick = (now - start) / period;
+			next = start + period * tick;
+		}
+		MediaClock::sleep_until(next);
+	}
+	MediaClock::detach();
+}
+
+void GalleryCompositor::clear(int x, int y, int w, int h)
+{
+	for (int row = y; row < y + h; row++)
+		memset(canvas_->data[0] + row * canvas_->linesize[0] + x, 16, w);
+	for (int row = y / 2; row < (y + h) / 2; row++)
+	{
+		memset(canvas_->data[1] + row * canvas_->linesize[1] + x / 2, 128, w / 2);
+		memset(canvas_->data[2] + row * canvas_->linesize[2] + x / 2, 128, w / 2);
+	}
+}
+
+void GalleryCompositor::layout()
+{
+	const int count = tick_slots_.size();
+	clear(0, 0, width_, height_);
+	if (count == 0)
+		return;
+
+	// the most square grid that fits everyone, filled row by row.
+	const int cols = (int)ceil(sqrt((double)count));
+	const int rows = (count + cols - 1) / cols;
+	const int tile_w = (width_ / cols) & ~1;
+	const int tile_h = (height_ / rows) & ~1;
+	for (int i = 0; i < count; i++)
+	{
+		Slot &slot = *tick_slots_[i];
+		const int row = i / cols;
+		// center the last row when it is not full.
+		const int in_row = row == rows - 1 ? count - row * cols : cols;
+		const int offset_x = (width_ - in_row * tile_w) / 2;
+		slot.tile_x = (offset_x + (i % cols) * tile_w) & ~1;
+		slot.tile_y = ((height_ - rows * tile_h) / 2 + row * tile_h) & ~1;
+		slot.tile_w = tile_w;
+		slot.tile_h = tile_h;
+		slot.draw_w = 0;
+		slot.draw_h = 0;
+		slot.redraw = true;
+	}
+}
+
+void GalleryCompositor::compose()
+{
+	{
+		std::lock_guard<std::mutex> lock(instance_mutex_);
+		if (layout_version_ != drawn_layout_version_)
+		{
+			// slots that left are dropped here, their scalers with them.
+			for (auto iter = tick_slots_.begin(); iter != tick_slots_.end(); iter++)
+			{
+				bool kept = false;
+				for (auto slot = slots_.begin(); slot != slots_.end(); slot++)
+					kept = kept || *slot == *iter;
+				if (!kept)
+				{
+					sws_freeContext((*iter)->sws);
+					(*iter)->sws = nullptr;
+				}
+			}
+			tick_slots_ = slots_;
+			drawn_layout_version_ = layout_version_;
+			layout();
+		}
+	}
+
+	for (auto iter = tick_slots_.begin(); iter != tick_slots_.end(); iter++)
+	{
+		Slot &slot = **iter;
+		bool fresh;
+		{
+			std::unique_lock<std::mutex> lock(slot.mutex, std::try_to_lock);
+			if (!lock.owns_lock())
+			{
+				// the user's next frame is being stored, keep the current picture for this tick.
+				busy_skips_++;
+				continue;
+			}
+			// the callback refills the buffer drawn last time, the new frame is scaled unlocked.
+			fresh = slot.fresh;
+			if (fresh)
+			{
+				slot.drawn.swap(slot.frame);
+				slot.drawn_width = slot.width;
+				slot.drawn_height = slot.height;
+				slot.drawn_full_range = slot.full_range;
+				slot.fresh = false;
+			}
+		}
+		const int width = slot.drawn_width;
+		const int height = slot.drawn_height;
+		if (width == 0 || height == 0 || (!fresh && !slot.redraw))
+			continue;
+
+		// fit the frame into the tile keeping its aspect ratio.
+		int draw_w = slot.tile_w;
+		int draw_h = (int)((int64_t)slot.tile_w * height / width);
+		if (draw_h > slot.tile_h)
+		{
+			draw_h = slot.tile_h;
+			draw_w = (int)((int64_t)slot.tile_h * width / height);
+		}
+		draw_w &= ~1;
+		draw_h &= ~1;
+		if (draw_w <= 0 || draw_h <= 0)
+			continue;
+		const int draw_x = (slot.tile_x + (slot.tile_w - draw_w) / 2) & ~1;
+		const int draw_y = (slot.tile_y + (slot.tile_h - draw_h) / 2) & ~1;
+		if (draw_w != slot.draw_w || draw_h != slot.draw_h)
+		{
+			clear(slot.tile_x, slot.tile_y, slot.tile_w, slot.tile_h);
+			slot.draw_x = draw_x;
+			slot.draw_y = draw_y;
+			slot.draw_w = draw_w;
+			slot.draw_h = draw_h;
+		}
+
+		slot.sws = sws_getCachedContext(slot.sws, width, height, AV_PIX_FMT_YUV420P,
+										draw_w, draw_h, AV_PIX_FMT_YUV420P, SWS_BILINEAR, NULL, NULL, NULL);
+		if (!slot.sws)
+			continue;
+		// the canvas is limited range, full range users are converted while scaling.
+		FFMPEGVideoWriter::set_scaler_range(slot.sws, slot.drawn_full_range);
+		const int y_size = width * height;
+		const int uv_width = (width + 1) / 2;
+		const int uv_size = uv_width * ((height + 1) / 2);
+		const uint8_t *src[4] = {slot.drawn.data(), slot.drawn.data() + y_size, slot.drawn.data() + y_size + uv_size, NULL};
+		const int src_stride[4] = {width, uv_width, uv_width, 0};
+		// scale straight into the tile, the canvas is the destination image.
+		uint8_t *dst[4] = {
+			canvas_->data[0] + draw_y * canvas_->linesize[0] + draw_x,
+			canvas_->data[1] + (draw_y / 2) * canvas_->linesize[1] + draw_x / 2,
+			canvas_->data[2] + (draw_y / 2) * canvas_->linesize[2] + draw_x / 2,
+			NULL};
+		sws_scale(slot.sws, src, src_stride, 0, height, dst, canvas_->linesize);
+		slot.redraw = false;
+		draws_++;
+	}
+}
@@ -0,0 +1,92 @@
+#pragma once
+// ffmpeg
+#define __STDC_CONSTANT_MACROS
+extern "C"
+{
+#include "libavutil/avutil.h"
+#include "libswscale/swscale.h"
+}
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <chrono>
+using namespace std::chrono;
+
+// Zoom Video SDK
+#include "helpers/zoom_video_sdk_user_helper_interface.h"
+using namespace ZOOMVIDEOSDK;
+
+#include "ffmpeg_video_writer.h"
+
+// Records the session as one gallery view: every participant gets a tile in a
+// grid, and the canvas is encoded once at a fixed frame rate on its own thread.
+// Camera encoders hand in their frames with on_frame(), which only keeps a copy
+// of the latest frame per user. The tick takes a new frame by swapping buffers
+// with the slot and scales it into its tile without holding the slot, so a
+// callback never waits for a scale. Tiles of users without a new frame keep
+// their last picture, and a tile whose frame is being replaced is skipped,
+// never waited for.
+// The grid is rebuilt when users join or leave.
+class GalleryCompositor
+{
+	struct Slot
+	{
+		IZoomVideoSDKUser* user;
+		// written by on_frame(), guarded by mutex
+		std::mutex mutex;
+		std::vector<uint8_t> frame; // latest I420 frame, planes packed
+		int width = 0;
+		int height = 0;
+		bool full_range = false;
+		bool fresh = false; // frame not drawn yet
+		// tick thread only
+		std::vector<uint8_t> drawn; // the frame last taken from the slot
+		int drawn_width = 0;
+		int drawn_height = 0;
+		bool drawn_full_range = false;
+		SwsContext* sws = nullptr;
+		int tile_x = 0, tile_y = 0, tile_w = 0, tile_h = 0;
+		int draw_x = 0, draw_y = 0, draw_w = 0, draw_h = 0;
+		bool redraw = false; // tile moved, draw again even without a new frame
+	};
+
+	static GalleryCompositor* instance_;
+	static std::mutex instance_mutex_;
+
+	// guarded by instance_mutex_
+	std::vector<std::shared_ptr<Slot>> slots_;
+	int layout_version_ = 0;
+
+	// tick thread
+	int width_;
+	int height_;
+	int fps_;
+	FFMPEGVideoWriter writer_;
+	AVFrame* canvas_ = nullptr;
+	std::thread thread_;
+	std::atomic<bool> running_;
+	int drawn_layout_version_ = -1;
+	std::vector<std::shared_ptr<Slot>> tick_slots_;
+	int ticks_ = 0;
+	int late_ticks_ = 0;
+	int draws_ = 0;
+	int busy_skips_ = 0;
+
+	GalleryCompositor(int width, int height, int fps);
+	~GalleryCompositor();
+	void run();
+	void layout();
+	void compose();
+	void clear(int x, int y, int w, int h);
+
+public:
+	// writes ../<name>.mkv, or the first free _2, _3 ... of it; output size should be a multiple of 2.
+	static int start(const char* name, int width, int height, int fps);
+	static void stop();
+
+	static void add_user(IZoomVideoSDKUser* user);
+	static void remove_user(IZoomVideoSDKUser* user);
+	static void on_frame(IZoomVideoSDKUser* user, const uint8_t* Y, const uint8_t* U, const uint8_t* V, int width, int height, bool full_range);
+};
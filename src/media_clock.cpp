@@ -0,0 +1,148 @@
+#include "media_clock.h"
+#include <thread>
+
+std::atomic<bool> MediaClock::virtual_(false);
+std::atomic<int64_t> MediaClock::virtual_us_(0);
+int64_t MediaClock::virtual_start_us_ = 0;
+time_t MediaClock::virtual_wall_start_ = 0;
+std::mutex MediaClock::mutex_;
+std::condition_variable MediaClock::cond_;
+int MediaClock::attached_ = 0;
+int MediaClock::sleeping_ = 0;
+std::multiset<int64_t> MediaClock::wake_ups_;
+
+static thread_local bool thread_attached = false;
+// the wake up of a thread waiting on another one, it is woken by that one.
+static const int64_t no_wake_up = INT64_MAX;
+
+steady_clock::time_point MediaClock::now()
+{
+	if (!virtual_)
+		return steady_clock::now();
+	return steady_clock::time_point(microseconds(virtual_us_.load()));
+}
+
+time_t MediaClock::wall_time()
+{
+	if (!virtual_)
+		return time(NULL);
+	return virtual_wall_start_ + (virtual_us_.load() - virtual_start_us_) / 1000000;
+}
+
+int64_t MediaClock::epoch_ms(steady_clock::time_point t)
+{
+	if (!virtual_)
+		return duration_cast<milliseconds>(system_clock::now().time_since_epoch() - (steady_clock::now() - t)).count();
+	return (int64_t)virtual_wall_start_ * 1000 + (duration_cast<microseconds>(t.time_since_epoch()).count() - virtual_start_us_) / 1000;
+}
+
+void MediaClock::start_virtual(time_t wall_start)
+{
+	virtual_start_us_ = duration_cast<microseconds>(steady_clock::now().time_since_epoch()).count();
+	virtual_wall_start_ = wall_start;
+	virtual_us_ = virtual_start_us_;
+	virtual_ = true;
+}
+
+void MediaClock::advance(microseconds step)
+{
+	virtual_us_ += step.count();
+	moved();
+}
+
+void MediaClock::advance_to(steady_clock::time_point t)
+{
+	int64_t target = duration_cast<microseconds>(t.time_since_epoch()).count();
+	int64_t current = virtual_us_.load();
+	while (current < target && !virtual_us_.compare_exchange_weak(current, target))
+	{
+	}
+	moved();
+}
+
+void MediaClock::moved()
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	cond_.notify_all();
+}
+
+// with mutex_ held: when every attached thread sleeps, time jumps to the earliest
+// wake up. False if someone is busy, or already due and not yet up.
+bool MediaClock::jump()
+{
+	if (attached_ == 0 || sleeping_ < attached_ || wake_ups_.empty())
+		return false;
+	int64_t next = *wake_ups_.begin();
+	if (next == no_wake_up || next <= virtual_us_)
+		return false;
+	virtual_us_ = next;
+	cond_.notify_all();
+	return true;
+}
+
+void MediaClock::sleep_until(steady_clock::time_point t)
+{
+	if (!virtual_)
+	{
+		std::this_thread::sleep_until(t);
+		return;
+	}
+	int64_t until = duration_cast<microseconds>(t.time_since_epoch()).count();
+	std::unique_lock<std::mutex> lock(mutex_);
+	std::multiset<int64_t>::iterator wake_up;
+	if (thread_attached)
+	{
+		sleeping_++;
+		wake_up = wake_ups_.insert(until);
+	}
+	while (virtual_us_ < until)
+	{
+		if (!thread_attached || !jump())
+			cond_.wait(lock);
+	}
+	if (thread_attached)
+	{
+		sleeping_--;
+		wake_ups_.erase(wake_up);
+	}
+}
+
+void MediaClock::attach()
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	if (thread_attached)
+		return;
+	thread_attached = true;
+	attached_++;
+}
+
+void MediaClock::detach()
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	if (!thread_attached)
+		return;
+	thread_attached = false;
+	attached_--;
+	// the others may all be asleep now.
+	jump();
+	cond_.notify_all();
+}
+
+MediaClockWait::MediaClockWait()
+{
+	std::lock_guard<std::mutex> lock(MediaClock::mutex_);
+	if (!thread_attached)
+		return;
+	MediaClock::sleeping_++;
+	MediaClock::wake_ups_.insert(no_wake_up);
+	MediaClock::jump();
+}
+
+MediaClockWait::~MediaClockWait()
+{
+	std::lock_guard<std::mutex> lock(MediaClock::mutex_);
+	if (!thread_attached)
+		return;
+	MediaClock::sleeping_--;
+	MediaClock::wake_ups_.erase(MediaClock::wake_ups_.find(no_wake_up));
+}
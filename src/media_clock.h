@@ -0,0 +1,67 @@
+#pragma once
+#include <stdint.h>
+#include <time.h>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <set>
+#include <chrono>
+using namespace std::chrono;
+
+// The time recordings are stamped with. It is the steady clock and the system
+// wall clock, unless virtual time is started: then it stands still and only
+// moves when advanced, so a scripted input gives the same timestamps, the same
+// keyframes and the same burned in clock on every run.
+//
+// Virtual time is advanced by hand (advance, advance_to), or by the threads that
+// pace themselves with sleep_until: once every attached thread sleeps, time jumps
+// to the earliest wake up, so a scripted session runs as fast as it is processed.
+class MediaClock
+{
+	static std::atomic<bool> virtual_;
+	static std::atomic<int64_t> virtual_us_; // virtual now, on the steady clock's epoch
+	static int64_t virtual_start_us_;
+	static time_t virtual_wall_start_;
+
+	// threads pacing virtual time
+	static std::mutex mutex_;
+	static std::condition_variable cond_;
+	static int attached_;
+	static int sleeping_; // attached threads in sleep_until or waiting
+	static std::multiset<int64_t> wake_ups_; // of the sleeping attached threads
+
+	static bool jump();
+	static void moved();
+
+	friend class MediaClockWait;
+
+public:
+	static steady_clock::time_point now();
+	// seconds since the epoch, what burned in clocks show.
+	static time_t wall_time();
+	// milliseconds since the epoch at a time point of now(), for file metadata.
+	static int64_t epoch_ms(steady_clock::time_point t);
+
+	// from here on now() starts at the current steady time and wall_time() at wall_start.
+	static void start_virtual(time_t wall_start);
+	static bool is_virtual() { return virtual_; }
+	static void advance(microseconds step);
+	// moves virtual time forward to t, never back.
+	static void advance_to(steady_clock::time_point t);
+
+	// sleeps until now() reaches t.
+	static void sleep_until(steady_clock::time_point t);
+	// the calling thread paces virtual time with sleep_until; until detached, time
+	// does not move on while it is busy.
+	static void attach();
+	static void detach();
+};
+
+// an attached thread blocked on another one, joining it for instance: virtual
+// time may move on without it meanwhile.
+class MediaClockWait
+{
+public:
+	MediaClockWait();
+	~MediaClockWait();
+};
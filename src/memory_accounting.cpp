@@ -0,0 +1,160 @@
+#include "memory_accounting.h"
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <chrono>
+using namespace std::chrono;
+
+MemoryAccounting::Owner MemoryAccounting::owners_[MemoryAccounting::max_owners];
+bool MemoryAccounting::hooks_linked_ = false;
+int MemoryAccounting::report_seconds_ = 0;
+std::mutex MemoryAccounting::mutex_;
+std::condition_variable MemoryAccounting::cond_;
+bool MemoryAccounting::stopping_ = false;
+std::thread MemoryAccounting::reporter_;
+thread_local int MemoryAccounting::current_owner = -1;
+thread_local int MemoryAccounting::current_stage = Memory_Other;
+
+static const char *stage_names[Memory_StageCount] = {"other", "filter", "encoder", "muxer"};
+
+int MemoryAccounting::register_owner(const char *name)
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	for (int index = 0; index < max_owners; index++)
+	{
+		Owner &owner = owners_[index];
+		// a released owner is only reused when none of its blocks can still be freed.
+		if (owner.state == Owner_Free || (owner.state == Owner_Closed && owner.total == 0))
+		{
+			snprintf(owner.name, sizeof(owner.name), "%s", name);
+			for (int stage = 0; stage < Memory_StageCount; stage++)
+				owner.live[stage] = 0;
+			owner.peak = 0;
+			owner.allocations = 0;
+			owner.state = Owner_Open;
+			return index;
+		}
+	}
+	return -1;
+}
+
+void MemoryAccounting::release_owner(int owner)
+{
+	if (owner < 0 || owner >= max_owners)
+		return;
+	std::lock_guard<std::mutex> lock(mutex_);
+	owners_[owner].state = Owner_Closed;
+}
+
+void MemoryAccounting::allocated(int owner, int stage, size_t bytes)
+{
+	Owner &item = owners_[owner];
+	item.live[stage].fetch_add(bytes, std::memory_order_relaxed);
+	int64_t total = item.total.fetch_add(bytes, std::memory_order_relaxed) + bytes;
+	item.allocations.fetch_add(1, std::memory_order_relaxed);
+	int64_t peak = item.peak.load(std::memory_order_relaxed);
+	while (total > peak && !item.peak.compare_exchange_weak(peak, total, std::memory_order_relaxed))
+	{
+	}
+}
+
+void MemoryAccounting::freed(int owner, int stage, size_t bytes)
+{
+	Owner &item = owners_[owner];
+	item.live[stage].fetch_sub(bytes, std::memory_order_relaxed);
+	item.total.fetch_sub(bytes, std::memory_order_relaxed);
+}
+
+int MemoryAccounting::start_reports(int seconds)
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	if (report_seconds_ > 0 || seconds <= 0)
+		return -1;
+	if (!hooks_linked_)
+	{
+		printf("memory reports need a build with -DMEMORY_ACCOUNTING=ON, only the process size is reported.\n");
+	}
+	report_seconds_ = seconds;
+	stopping_ = false;
+	reporter_ = std::thread(&MemoryAccounting::run);
+	printf("reporting memory every %d s\n", seconds);
+	return 0;
+}
+
+void MemoryAccounting::stop_reports()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		if (report_seconds_ == 0)
+			return;
+		report_seconds_ = 0;
+		stopping_ = true;
+		cond_.notify_one();
+	}
+	reporter_.join();
+	report();
+}
+
+void MemoryAccounting::run()
+{
+	std::unique_lock<std::mutex> lock(mutex_);
+	while (!stopping_)
+	{
+		cond_.wait_for(lock, seconds(report_seconds_));
+		if (stopping_)
+			break;
+		lock.unlock();
+		report();
+		lock.lock();
+	}
+}
+
+void MemoryAccounting::report()
+{
+	// resident size in pages, the second field of statm.
+	long pages = 0;
+	FILE *fp = fopen("/proc/self/statm", "r");
+	if (fp)
+	{
+		if (fscanf(fp, "%*d %ld", &pages) != 1)
+			pages = 0;
+		fclose(fp);
+	}
+	int64_t rss_kb = (int64_t)pages * sysconf(_SC_PAGESIZE) / 1024;
+	if (!hooks_linked_)
+	{
+		printf("memory: rss %lld KB\n", (long long)rss_kb);
+		return;
+	}
+
+	std::lock_guard<std::mutex> lock(mutex_);
+	int64_t attributed = 0;
+	int count = 0;
+	for (int index = 0; index < max_owners; index++)
+	{
+		if (owners_[index].state == Owner_Free || (owners_[index].state == Owner_Closed && owners_[index].total == 0))
+			continue;
+		attributed += owners_[index].total;
+		count++;
+	}
+	printf("memory: rss %lld KB, %lld KB held by %d owners\n", (long long)rss_kb, (long long)attributed / 1024, count);
+	if (count == 0)
+		return;
+	printf("  %-40s", "owner (KB)");
+	for (int stage = 1; stage <= Memory_StageCount; stage++)
+		printf(" %8s", stage_names[stage % Memory_StageCount]);
+	printf(" %8s %8s %10s\n", "total", "peak", "allocs");
+	for (int index = 0; index < max_owners; index++)
+	{
+		Owner &owner = owners_[index];
+		if (owner.state == Owner_Free || (owner.state == Owner_Closed && owner.total == 0))
+			continue;
+		printf("  %-40s", owner.name);
+		// stages in pipeline order, other last.
+		for (int stage = 1; stage <= Memory_StageCount; stage++)
+			printf(" %8lld", (long long)owner.live[stage % Memory_StageCount] / 1024);
+		printf(" %8lld %8lld %10llu%s\n", (long long)owner.total / 1024, (long long)owner.peak / 1024,
+			   (unsigned long long)owner.allocations, owner.state == Owner_Closed ? " leaked" : "");
+	}
+	fflush(stdout);
+}
@@ -0,0 +1,97 @@
+#pragma once
+#include <stdint.h>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+
+enum MemoryStage
+{
+	Memory_Other,
+	Memory_Filter, // the scale filter graph and its frames
+	Memory_Encoder, // the codec context, x264 and its lookahead
+	Memory_Muxer, // the format context, its io buffer and packets
+	Memory_StageCount
+};
+
+// Heap use per owner (a user's encoder) and stage of the pipeline. A MemoryScope
+// names the owner and stage of what the calling thread allocates; the heap hooks
+// of memory_hooks.cpp (build option MEMORY_ACCOUNTING) tag each block allocated
+// inside a scope with them, ffmpeg's av_malloc included, so the block is taken
+// off the right counters whichever thread frees it. Without the hooks scopes
+// cost a thread local write and nothing is counted.
+class MemoryAccounting
+{
+public:
+	static const int max_owners = 1024;
+
+private:
+	enum OwnerState
+	{
+		Owner_Free,
+		Owner_Open,
+		Owner_Closed // released, reused once everything it allocated is freed
+	};
+	struct Owner
+	{
+		std::atomic<int> state;
+		char name[64];
+		std::atomic<int64_t> live[Memory_StageCount]; // usable bytes of the tagged blocks
+		std::atomic<int64_t> total;
+		std::atomic<int64_t> peak;
+		std::atomic<uint64_t> allocations;
+	};
+	static Owner owners_[max_owners];
+	static bool hooks_linked_;
+	static int report_seconds_;
+	static std::mutex mutex_;
+	static std::condition_variable cond_;
+	static bool stopping_;
+	static std::thread reporter_;
+
+	static void run();
+
+public:
+	// owner and stage of what the calling thread allocates, -1 is none.
+	static thread_local int current_owner;
+	static thread_local int current_stage;
+
+	// set by the hooks when they are linked in.
+	static void set_hooks_linked() { hooks_linked_ = true; }
+	static bool hooks_linked() { return hooks_linked_; }
+
+	// an id for the scopes of a new owner, -1 when all are taken.
+	static int register_owner(const char* name);
+	// the owner is done; what it still holds is reported as leaked until freed.
+	static void release_owner(int owner);
+
+	// from the hooks, with the usable size of the block.
+	static void allocated(int owner, int stage, size_t bytes);
+	static void freed(int owner, int stage, size_t bytes);
+
+	// prints the report every seconds.
+	static int start_reports(int seconds);
+	static void stop_reports();
+	static void report();
+};
+
+// what the calling thread allocates until the scope ends belongs to owner and stage.
+class MemoryScope
+{
+	int owner_;
+	int stage_;
+
+public:
+	MemoryScope(int owner, MemoryStage stage)
+	{
+		owner_ = MemoryAccounting::current_owner;
+		stage_ = MemoryAccounting::current_stage;
+		MemoryAccounting::current_owner = owner;
+		MemoryAccounting::current_stage = stage;
+	}
+	~MemoryScope()
+	{
+		MemoryAccounting::current_owner = owner_;
+		MemoryAccounting::current_stage = stage_;
+	}
+};
@@ -0,0 +1,168 @@
+// Linked into the bot with the build option MEMORY_ACCOUNTING: replaces malloc and
+// friends with wrappers around glibc's that attribute blocks to the MemoryScope of
+// the allocating thread. av_malloc and operator new end up here too.
+//
+// A block allocated in a scope gets 8 more bytes and its last 8 usable bytes hold
+// a tag: owner, stage and a check derived from the address. Free reads the tag
+// back to take the block off the counters it was put on, whichever thread frees
+// it; blocks without a valid check were allocated outside any scope.
+#include "memory_accounting.h"
+#include <stddef.h>
+#include <string.h>
+#include <errno.h>
+#include <malloc.h>
+
+extern "C"
+{
+	void *__libc_malloc(size_t size);
+	void *__libc_calloc(size_t count, size_t size);
+	void *__libc_realloc(void *ptr, size_t size);
+	void *__libc_memalign(size_t alignment, size_t size);
+	void __libc_free(void *ptr);
+}
+
+static const size_t tag_size = sizeof(uint64_t);
+
+static inline uint32_t check(void *ptr)
+{
+	return (uint32_t)(((uintptr_t)ptr * 0x9E3779B97F4A7C15ull) >> 32) ^ 0x6d656d61;
+}
+
+// the tag: bits 0-15 owner + 1, 16-23 stage, 32-63 the check.
+static inline void write_tag(void *ptr, uint64_t tag)
+{
+	memcpy((char *)ptr + malloc_usable_size(ptr) - tag_size, &tag, tag_size);
+}
+
+static inline bool in_scope()
+{
+	return MemoryAccounting::current_owner >= 0;
+}
+
+// size with room for the tag when the calling thread is in a scope, 0 on overflow.
+static inline size_t room(size_t size)
+{
+	if (!in_scope())
+		return size;
+	return size + tag_size < size ? 0 : size + tag_size;
+}
+
+static inline void *tagged(void *ptr, int owner, int stage)
+{
+	if (!ptr || owner < 0)
+		return ptr;
+	uint64_t tag = ((uint64_t)check(ptr) << 32) | ((uint64_t)stage << 16) | (uint64_t)(owner + 1);
+	write_tag(ptr, tag);
+	MemoryAccounting::allocated(owner, stage, malloc_usable_size(ptr));
+	return ptr;
+}
+
+static inline void *tagged(void *ptr)
+{
+	return tagged(ptr, MemoryAccounting::current_owner, MemoryAccounting::current_stage);
+}
+
+// takes a tagged block off its counters and clears the tag, returns false if it has none.
+static inline bool untag(void *ptr, int &owner, int &stage)
+{
+	if (!ptr)
+		return false;
+	size_t usable = malloc_usable_size(ptr);
+	if (usable < tag_size)
+		return false;
+	uint64_t tag;
+	memcpy(&tag, (char *)ptr + usable - tag_size, tag_size);
+	owner = (int)(tag & 0xffff) - 1;
+	stage = (int)((tag >> 16) & 0xff);
+	if ((uint32_t)(tag >> 32) != check(ptr) || owner < 0 || owner >= MemoryAccounting::max_owners ||
+		stage >= Memory_StageCount)
+		return false;
+	write_tag(ptr, 0);
+	MemoryAccounting::freed(owner, stage, usable);
+	return true;
+}
+
+static struct HooksLinked
+{
+	HooksLinked() { MemoryAccounting::set_hooks_linked(); }
+} hooks_linked;
+
+extern "C"
+{
+	void *malloc(size_t size)
+	{
+		size_t bytes = room(size);
+		if (bytes == 0 && size != 0)
+			return NULL;
+		return tagged(__libc_malloc(bytes));
+	}
+
+	void *calloc(size_t count, size_t size)
+	{
+		if (!in_scope())
+			return __libc_calloc(count, size);
+		if (size != 0 && count > ((size_t)-1 - tag_size) / size)
+		{
+			errno = ENOMEM;
+			return NULL;
+		}
+		// zeroed tag room included, the tag overwrites it.
+		return tagged(__libc_calloc(1, count * size + tag_size));
+	}
+
+	void *realloc(void *ptr, size_t size)
+	{
+		// a block keeps the owner it was allocated by, an untagged one gets the caller's.
+		int owner = MemoryAccounting::current_owner, stage = MemoryAccounting::current_stage;
+		bool had_tag = untag(ptr, owner, stage);
+		if (!had_tag)
+		{
+			owner = MemoryAccounting::current_owner;
+			stage = MemoryAccounting::current_stage;
+		}
+		if (ptr && size == 0)
+		{
+			__libc_free(ptr);
+			return NULL;
+		}
+		size_t bytes = owner >= 0 && size + tag_size > size ? size + tag_size : size;
+		void *result = __libc_realloc(ptr, bytes);
+		if (!result)
+		{
+			// a failed realloc keeps the old block.
+			if (had_tag)
+				tagged(ptr, owner, stage);
+			return NULL;
+		}
+		return tagged(result, owner, stage);
+	}
+
+	void free(void *ptr)
+	{
+		int owner, stage;
+		untag(ptr, owner, stage);
+		__libc_free(ptr);
+	}
+
+	void *memalign(size_t alignment, size_t size)
+	{
+		size_t bytes = room(size);
+		if (bytes == 0 && size != 0)
+			return NULL;
+		return tagged(__libc_memalign(alignment, bytes));
+	}
+
+	void *aligned_alloc(size_t alignment, size_t size)
+	{
+		return memalign(alignment, size);
+	}
+
+	int posix_memalign(void **ptr, size_t alignment, size_t size)
+	{
+		void *result = memalign(alignment, size);
+		if (!result)
+			return ENOMEM;
+		*ptr = result;
+		return 0;
+	}
+}
@@ -0,0 +1,372 @@
+#include "pip_compositor.h"
+#include "media_clock.h"
+#include "recording_file.h"
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+
+std::mutex PipCompositor::mutex_;
+std::vector<PipCompositor *> PipCompositor::list_;
+std::atomic<int> PipCompositor::count_(0);
+std::atomic<IZoomVideoSDKUser *> PipCompositor::speaker_(nullptr);
+std::atomic<IZoomVideoSDKUser *> PipCompositor::candidate_(nullptr);
+steady_clock::time_point PipCompositor::candidate_since_;
+
+// inset size relative to the share, and its distance from the corner.
+static const int inset_divisor = 4;
+static const int inset_margin = 16;
+static const int inset_border = 2;
+
+PipCompositor::PipCompositor(IZoomVideoSDKUser *user, steady_clock::time_point share_start, int share)
+{
+	user_ = user;
+	user_name_ = user->getUserName() ? user->getUserName() : "";
+	user_id_ = user->getUserID() && strlen(user->getUserID()) > 0 ? user->getUserID() : "0";
+	share_number_ = share;
+	start_time_ = share_start;
+	pipe_ = user_->GetSharePipe();
+	pipe_->subscribe(ZoomVideoSDKResolution_720P, this);
+}
+
+PipCompositor::~PipCompositor()
+{
+	pipe_->unSubscribe(this);
+	writer_.close();
+	printf("Picture in picture stopped, user: %s, %d frames, %d recomposed, %d unchanged skipped.\n",
+		   user_name_.c_str(), writer_.frame_count(), recomposed_, skipped_);
+	sws_freeContext(share_sws_);
+	sws_freeContext(inset_sws_);
+	if (canvas_)
+		av_frame_free(&canvas_);
+}
+
+void PipCompositor::start_for(IZoomVideoSDKUser *user, steady_clock::time_point share_start, int share)
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		for (auto iter = list_.begin(); iter != list_.end(); iter++)
+		{
+			if ((*iter)->user_ == user)
+				return;
+		}
+	}
+	// subscribed without the lock, the pipe may hold its own while a frame waits for ours.
+	// Frames that come before the compositor is listed are ignored.
+	PipCompositor *compositor = new PipCompositor(user, share_start, share);
+	std::lock_guard<std::mutex> lock(mutex_);
+	list_.push_back(compositor);
+	count_ = list_.size();
+}
+
+void PipCompositor::stop_for(IZoomVideoSDKUser *user)
+{
+	PipCompositor *compositor = nullptr;
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		for (auto iter = list_.begin(); iter != list_.end(); iter++)
+		{
+			if ((*iter)->user_ == user)
+			{
+				compositor = *iter;
+				list_.erase(iter);
+				break;
+			}
+		}
+		count_ = list_.size();
+	}
+	finish(compositor);
+}
+
+void PipCompositor::stop_all()
+{
+	std::vector<PipCompositor *> stopping;
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		stopping.swap(list_);
+		count_ = 0;
+	}
+	for (auto iter = stopping.begin(); iter != stopping.end(); iter++)
+		finish(*iter);
+}
+
+void PipCompositor::finish(PipCompositor *compositor)
+{
+	if (!compositor)
+		return;
+	// out of the list nobody takes the canvas any more, wait for the frame that has it.
+	{
+		std::lock_guard<std::mutex> canvas(compositor->canvas_mutex_);
+	}
+	// unSubscribe may wait for a share frame that is waiting for the lock.
+	delete compositor;
+}
+
+void PipCompositor::remove_user(IZoomVideoSDKUser *user)
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		if (speaker_ == user)
+			speaker_ = nullptr;
+		if (candidate_ == user)
+			candidate_ = nullptr;
+	}
+	stop_for(user);
+}
+
+void PipCompositor::on_active_audio(IVideoSDKVector<IZoomVideoSDKUser *> *list)
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	IZoomVideoSDKUser *talking = nullptr;
+	int count = list ? list->GetCount() : 0;
+	for (int index = 0; index < count; index++)
+	{
+		IZoomVideoSDKUser *user = list->GetItem(index);
+		if (user == speaker_)
+		{
+			talking = nullptr;
+			break;
+		}
+		if (user && !talking)
+			talking = user;
+	}
+	if (talking != candidate_.load())
+	{
+		candidate_ = talking;
+		candidate_since_ = MediaClock::now();
+	}
+}
+
+void PipCompositor::on_camera_frame(IZoomVideoSDKUser *user, const uint8_t *Y, const uint8_t *U, const uint8_t *V,
+									int width, int height, bool full_range)
+{
+	// every camera encoder calls in, only the speaker's frames and the candidate's are of use.
+	IZoomVideoSDKUser *speaker = speaker_;
+	if (count_ == 0 || (speaker && speaker != user && candidate_.load() != user))
+		return;
+
+	std::unique_lock<std::mutex> lock(mutex_);
+	// the candidate's own frames confirm it once it talked for long enough.
+	if (candidate_.load() == user && MediaClock::now() - candidate_since_ >= milliseconds(switch_debounce_ms))
+	{
+		speaker_ = user;
+		candidate_ = nullptr;
+		printf("Picture in picture speaker: %s.\n", user->getUserName());
+	}
+	speaker = speaker_;
+
+	std::vector<PipCompositor *> drawing;
+	for (auto iter = list_.begin(); iter != list_.end(); iter++)
+	{
+		PipCompositor &pip = **iter;
+		if ((speaker ? speaker : pip.user_) != user)
+			continue;
+		const size_t y_size = (size_t)width * height;
+		const size_t uv_size = (size_t)((width + 1) / 2) * ((height + 1) / 2);
+		pip.pending_frame_.resize(y_size + uv_size * 2);
+		memcpy(pip.pending_frame_.data(), Y, y_size);
+		memcpy(pip.pending_frame_.data() + y_size, U, uv_size);
+		memcpy(pip.pending_frame_.data() + y_size + uv_size, V, uv_size);
+		pip.pending_width_ = width;
+		pip.pending_height_ = height;
+		pip.pending_full_range_ = full_range;
+		pip.pending_fresh_ = true;
+		// a share frame being encoded draws the inset with the next one.
+		if (pip.canvas_mutex_.try_lock())
+		{
+			pip.take_inset();
+			drawing.push_back(&pip);
+		}
+	}
+	lock.unlock();
+
+	for (auto iter = drawing.begin(); iter != drawing.end(); iter++)
+	{
+		PipCompositor &pip = **iter;
+		if (pip.has_share_)
+			pip.encode(false);
+		pip.canvas_mutex_.unlock();
+	}
+}
+
+// with mutex_ and canvas_mutex_ held: the pending frame becomes the inset to draw.
+void PipCompositor::take_inset()
+{
+	if (!pending_fresh_)
+		return;
+	inset_frame_.swap(pending_frame_);
+	inset_full_range_ = pending_full_range_;
+	inset_fresh_ = true;
+	pending_fresh_ = false;
+	if (pending_width_ != inset_src_width_ || pending_height_ != inset_src_height_)
+	{
+		inset_src_width_ = pending_width_;
+		inset_src_height_ = pending_height_;
+		place_inset();
+	}
+}
+
+int PipCompositor::open(int width, int height)
+{
+	width_ = width;
+	height_ = height;
+	canvas_ = FFMPEGVideoWriter::alloc_frame(width, height);
+	char name[100];
+	snprintf(name, sizeof(name), "%s_%.40s_share%d_pip_%dx%d", user_id_.c_str(), user_name_.c_str(), share_number_, width, height);
+	char fileName[120];
+	if (!canvas_ || RecordingFile::create(fileName, sizeof(fileName), name, ".mkv") < 0 ||
+		writer_.open(fileName, width, height, AVRational{1, 1000}, "veryfast", NULL, 1500000, 300) < 0)
+	{
+		printf("Failed to start picture in picture %s.\n", name);
+		return -1;
+	}
+	printf("Picture in picture started: %s.\n", fileName);
+	return 0;
+}
+
+void PipCompositor::place_inset()
+{
+	int w = 0, h = 0, x = 0, y = 0;
+	if (width_ > 0 && inset_src_width_ > 0 && inset_src_height_ > 0)
+	{
+		w = (width_ / inset_divisor) & ~1;
+		h = (int)((int64_t)w * inset_src_height_ / inset_src_width_) & ~1;
+		x = width_ - w - inset_margin;
+		y = height_ - h - inset_margin;
+		if (x < inset_border || y < inset_border || h <= 0)
+			w = h = x = y = 0;
+	}
+	if (w != inset_w_ || h != inset_h_ || x != inset_x_ || y != inset_y_)
+	{
+		// what was under the old inset comes back with the next share frame.
+		full_redraw_ = true;
+		inset_x_ = x;
+		inset_y_ = y;
+		inset_w_ = w;
+		inset_h_ = h;
+	}
+}
+
+void PipCompositor::draw_inset()
+{
+	const int bx = inset_x_ - inset_border;
+	const int by = inset_y_ - inset_border;
+	const int bw = inset_w_ + inset_border * 2;
+	const int bh = inset_h_ + inset_border * 2;
+	for (int row = by; row < by + bh; row++)
+		memset(canvas_->data[0] + row * canvas_->linesize[0] + bx, 235, bw);
+	for (int row = by / 2; row < (by + bh) / 2; row++)
+	{
+		memset(canvas_->data[1] + row * canvas_->linesize[1] + bx / 2, 128, bw / 2);
+		memset(canvas_->data[2] + row * canvas_->linesize[2] + bx / 2, 128, bw / 2);
+	}
+
+	inset_sws_ = sws_getCachedContext(inset_sws_, inset_src_width_, inset_src_height_, AV_PIX_FMT_YUV420P,
+									  inset_w_, inset_h_, AV_PIX_FMT_YUV420P, SWS_BILINEAR, NULL, NULL, NULL);
+	if (!inset_sws_)
+		return;
+	FFMPEGVideoWriter::set_scaler_range(inset_sws_, inset_full_range_);
+	const int y_size = inset_src_width_ * inset_src_height_;
+	const int uv_width = (inset_src_width_ + 1) / 2;
+	const int uv_size = uv_width * ((inset_src_height_ + 1) / 2);
+	const uint8_t *src[4] = {inset_frame_.data(), inset_frame_.data() + y_size, inset_frame_.data() + y_size + uv_size, NULL};
+	const int src_stride[4] = {inset_src_width_, uv_width, uv_width, 0};
+	uint8_t *dst[4] = {
+		canvas_->data[0] + inset_y_ * canvas_->linesize[0] + inset_x_,
+		canvas_->data[1] + (inset_y_ / 2) * canvas_->linesize[1] + inset_x_ / 2,
+		canvas_->data[2] + (inset_y_ / 2) * canvas_->linesize[2] + inset_x_ / 2,
+		NULL};
+	sws_scale(inset_sws_, src, src_stride, 0, inset_src_height_, dst, canvas_->linesize);
+}
+
+void PipCompositor::encode(bool changed)
+{
+	if (inset_fresh_ && inset_w_ > 0)
+	{
+		draw_inset();
+		changed = true;
+	}
+	inset_fresh_ = false;
+
+	const int64_t now_ms = duration_cast<milliseconds>(MediaClock::now() - start_time_).count();
+	const bool keyframe_due = now_ms - last_keyframe_ms_ >= keyframe_interval_ms;
+	if (!changed && !keyframe_due)
+	{
+		skipped_++;
+		return;
+	}
+	if (changed)
+		recomposed_++;
+	if (keyframe_due)
+		last_keyframe_ms_ = now_ms;
+	canvas_->pts = now_ms;
+	writer_.write(canvas_, keyframe_due);
+}
+
+void PipCompositor::onRawDataFrameReceived(YUVRawDataI420 *data)
+{
+	std::unique_lock<std::mutex> lock(mutex_);
+	if (std::find(list_.begin(), list_.end(), this) == list_.end())
+		return;
+	// the canvas is taken with mutex_ held, the share is drawn and encoded without it.
+	std::lock_guard<std::mutex> canvas(canvas_mutex_);
+	take_inset();
+	lock.unlock();
+
+	const int stream_width = data->GetStreamWidth();
+	const int stream_height = data->GetStreamHeight();
+	const int width = stream_width & ~1;
+	const int height = stream_height & ~1;
+	if (width <= 0 || height <= 0)
+		return;
+	if (width != width_ || height != height_)
+	{
+		// like the share recording, a resized share continues in a new file.
+		writer_.close();
+		if (canvas_)
+			av_frame_free(&canvas_);
+		share_fingerprint_.reset();
+		has_share_ = false;
+		if (open(width, height) < 0)
+			return;
+		place_inset();
+	}
+	if (!writer_.is_open())
+		return;
+
+	const uint8_t *Y = reinterpret_cast<const uint8_t *>(data->GetYBuffer());
+	const uint8_t *U = reinterpret_cast<const uint8_t *>(data->GetUBuffer());
+	const uint8_t *V = reinterpret_cast<const uint8_t *>(data->GetVBuffer());
+	const bool changed = !share_fingerprint_.is_duplicate(Y, U, V, stream_width, stream_height) || full_redraw_;
+	if (changed)
+	{
+		const int uv_width = (stream_width + 1) / 2;
+		if (!data->IsLimitedI420())
+		{
+			// the canvas is limited range, only full range shares go through the scaler.
+			share_sws_ = sws_getCachedContext(share_sws_, width, height, AV_PIX_FMT_YUV420P,
+											  width, height, AV_PIX_FMT_YUV420P, SWS_POINT, NULL, NULL, NULL);
+			if (!share_sws_)
+				return;
+			FFMPEGVideoWriter::set_scaler_range(share_sws_, true);
+			const uint8_t *src[4] = {Y, U, V, NULL};
+			const int src_stride[4] = {stream_width, uv_width, uv_width, 0};
+			sws_scale(share_sws_, src, src_stride, 0, height, canvas_->data, canvas_->linesize);
+		}
+		else
+		{
+			for (int row = 0; row < height; row++)
+				memcpy(canvas_->data[0] + row * canvas_->linesize[0], Y + row * stream_width, width);
+			for (int row = 0; row < height / 2; row++)
+			{
+				memcpy(canvas_->data[1] + row * canvas_->linesize[1], U + row * uv_width, width / 2);
+				memcpy(canvas_->data[2] + row * canvas_->linesize[2], V + row * uv_width, width / 2);
+			}
+		}
+		full_redraw_ = false;
+		has_share_ = true;
+		// the share was drawn over the inset.
+		if (!inset_frame_.empty())
+			inset_fresh_ = true;
+	}
+	encode(changed);
+}
@@ -0,0 +1,112 @@
+#pragma once
+// ffmpeg
+#define __STDC_CONSTANT_MACROS
+extern "C"
+{
+#include "libavutil/avutil.h"
+#include "libswscale/swscale.h"
+}
+#include <vector>
+#include <string>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+using namespace std::chrono;
+
+// Zoom Video SDK
+#include "zoom_sdk_raw_data_def.h"
+#include "helpers/zoom_video_sdk_user_helper_interface.h"
+using namespace ZOOMVIDEOSDK;
+
+#include "ffmpeg_video_writer.h"
+#include "frame_fingerprint.h"
+
+// Records a screen share with the active speaker's camera inset in the bottom
+// right corner, as one video instead of separate share and camera files.
+// The share pipe drives the output; camera frames come from the camera
+// encoders, and only the speaker's are kept. The inset is scaled with a cached
+// swscale context and drawn over the share on the canvas, which is only
+// recomposed and encoded when the share or the speaker's camera changed.
+// Camera frames of anybody but the speaker return without locking. The
+// speaker's frame is copied under the lock of all compositors; drawing and
+// encoding happen under the compositor's own canvas lock only.
+class PipCompositor :
+	private IZoomVideoSDKRawDataPipeDelegate
+{
+	virtual void onRawDataFrameReceived(YUVRawDataI420* data);
+	virtual void onRawDataStatusChanged(RawDataStatus status) {}
+
+	static const int keyframe_interval_ms = 10000;
+	static const int switch_debounce_ms = 1500;
+
+	// the list, the speaker and the pending insets of every compositor. A canvas
+	// lock is only taken with this one held, so a compositor out of the list has
+	// no new user of its canvas.
+	static std::mutex mutex_;
+	static std::vector<PipCompositor*> list_;
+	static std::atomic<int> count_;
+	// the speaker is chosen for all shares; until somebody talks it is the sharer.
+	// Written under mutex_, read without it to drop other cameras' frames.
+	static std::atomic<IZoomVideoSDKUser*> speaker_;
+	static std::atomic<IZoomVideoSDKUser*> candidate_;
+	static steady_clock::time_point candidate_since_;
+
+	IZoomVideoSDKUser* user_; // the sharer
+	IZoomVideoSDKRawDataPipe* pipe_;
+	std::string user_name_;
+	std::string user_id_;
+	int share_number_;
+	steady_clock::time_point start_time_;
+
+	// the speaker's latest camera frame, planes packed, under mutex_ until it is drawn.
+	std::vector<uint8_t> pending_frame_;
+	int pending_width_ = 0;
+	int pending_height_ = 0;
+	bool pending_full_range_ = false;
+	bool pending_fresh_ = false;
+
+	// everything below is under canvas_mutex_.
+	std::mutex canvas_mutex_;
+	FFMPEGVideoWriter writer_;
+	AVFrame* canvas_ = nullptr;
+	int width_ = 0;
+	int height_ = 0;
+	SwsContext* share_sws_ = nullptr; // full range shares only
+	FrameFingerprint share_fingerprint_;
+	bool has_share_ = false;
+	bool full_redraw_ = false; // the inset moved, the whole share must be drawn again
+
+	std::vector<uint8_t> inset_frame_; // the pending frame taken for drawing
+	int inset_src_width_ = 0;
+	int inset_src_height_ = 0;
+	bool inset_full_range_ = false;
+	bool inset_fresh_ = false;
+	SwsContext* inset_sws_ = nullptr;
+	int inset_x_ = 0, inset_y_ = 0, inset_w_ = 0, inset_h_ = 0;
+
+	int64_t last_keyframe_ms_ = -keyframe_interval_ms;
+	int recomposed_ = 0;
+	int skipped_ = 0;
+
+	PipCompositor(IZoomVideoSDKUser* user, steady_clock::time_point share_start, int share);
+	~PipCompositor();
+	static void finish(PipCompositor* compositor);
+	void take_inset();
+	int open(int width, int height);
+	void place_inset();
+	void draw_inset();
+	void encode(bool changed);
+
+public:
+	// replaces the share recording of user, timed from share_start and numbered like the shared audio.
+	static void start_for(IZoomVideoSDKUser* user, steady_clock::time_point share_start, int share);
+	static void stop_for(IZoomVideoSDKUser* user);
+	// the session ended, every file is finished.
+	static void stop_all();
+	// a user left, they can be neither sharer nor speaker any more.
+	static void remove_user(IZoomVideoSDKUser* user);
+
+	static void on_active_audio(IVideoSDKVector<IZoomVideoSDKUser*>* list);
+	static void on_camera_frame(IZoomVideoSDKUser* user, const uint8_t* Y, const uint8_t* U, const uint8_t* V,
+								int width, int height, bool full_range);
+};
@@ -0,0 +1,504 @@
+#include "raw_audio_ffmpeg_encoder.h"
+#include "audio_ingest_queue.h"
+#include "media_clock.h"
+#include "recording_file.h"
+#include <string.h>
+#include <stdlib.h>
+#include <algorithm>
+
+using namespace ZOOMVIDEOSDK;
+
+std::vector<RawAudioFFMPEGEncoder *> RawAudioFFMPEGEncoder::list_;
+std::mutex RawAudioFFMPEGEncoder::list_mutex_;
+int RawAudioFFMPEGEncoder::instance_count = 0;
+
+RawAudioFFMPEGEncoder::RawAudioFFMPEGEncoder(IZoomVideoSDKUser *user, AudioSource source)
+{
+	instance_id_ = instance_count++;
+	user_ = user;
+	source_ = source;
+	if (user)
+	{
+		user_name_ = user->getUserName();
+		user_id_ = user->getUserID();
+	}
+}
+
+RawAudioFFMPEGEncoder::~RawAudioFFMPEGEncoder()
+{
+	printf("********** [%d] Finishing audio encoding, user: %s, talk spurts: %d, voiced: %lldms, skipped: %lldms, filled gaps: %d (%lldms), jumps: %d.\n",
+		   instance_id_, user_name_.c_str(), vad_.spurt_count(), (long long)vad_.voiced_ms(), (long long)skipped_ms_,
+		   continuity_.filled_gaps(), (long long)continuity_.filled_ms(), continuity_.jumps());
+	if (is_ffmpeg_encoding_on)
+	{
+		ffmpeg_stop();
+		is_ffmpeg_encoding_on = 0;
+	}
+	instance_count--;
+	user_ = nullptr;
+}
+
+RawAudioFFMPEGEncoder *RawAudioFFMPEGEncoder::find_instance(IZoomVideoSDKUser *user, AudioSource source)
+{
+	for (auto iter = list_.begin(); iter != list_.end(); iter++)
+	{
+		RawAudioFFMPEGEncoder *item = *iter;
+		if (item->source_ == source && (item->user_ == user || user == nullptr))
+		{
+			return item;
+		}
+	}
+	return nullptr;
+}
+
+void RawAudioFFMPEGEncoder::start_encoding_for(IZoomVideoSDKUser *user)
+{
+	std::lock_guard<std::mutex> lock(list_mutex_);
+	if (!find_instance(user, AudioSource_OneWay))
+		list_.push_back(new RawAudioFFMPEGEncoder(user, AudioSource_OneWay));
+}
+
+void RawAudioFFMPEGEncoder::stop_encoding_for(IZoomVideoSDKUser *user)
+{
+	std::lock_guard<std::mutex> lock(list_mutex_);
+	for (auto iter = list_.begin(); iter != list_.end();)
+	{
+		if ((*iter)->user_ == user)
+		{
+			// destroyed on the worker, after the buffers queued before this point.
+			AudioIngestQueue::instance().push_stop(*iter);
+			iter = list_.erase(iter);
+		}
+		else
+			iter++;
+	}
+}
+
+void RawAudioFFMPEGEncoder::on_audio_received(AudioRawData *data, IZoomVideoSDKUser *user)
+{
+	// the lock orders this buffer before a concurrent stop of the same encoder.
+	std::lock_guard<std::mutex> lock(list_mutex_);
+	RawAudioFFMPEGEncoder *encoder = RawAudioFFMPEGEncoder::find_instance(user, AudioSource_OneWay);
+	if (encoder)
+	{
+		AudioIngestQueue::instance().push(encoder, data);
+	}
+}
+
+void RawAudioFFMPEGEncoder::start_share_audio_for(IZoomVideoSDKUser *user, steady_clock::time_point share_start, int share)
+{
+	std::lock_guard<std::mutex> lock(list_mutex_);
+	if (find_instance(user, AudioSource_Share))
+		return;
+	RawAudioFFMPEGEncoder *encoder = new RawAudioFFMPEGEncoder(user, AudioSource_Share);
+	encoder->share_number_ = share;
+	encoder->start_time = share_start;
+	encoder->has_start_time_ = true;
+	list_.push_back(encoder);
+}
+
+void RawAudioFFMPEGEncoder::stop_share_audio_for(IZoomVideoSDKUser *user)
+{
+	std::lock_guard<std::mutex> lock(list_mutex_);
+	RawAudioFFMPEGEncoder *encoder = find_instance(user, AudioSource_Share);
+	if (encoder)
+	{
+		AudioIngestQueue::instance().push_stop(encoder);
+		list_.erase(std::remove(list_.begin(), list_.end(), encoder), list_.end());
+	}
+}
+
+bool RawAudioFFMPEGEncoder::has_share_audio_for(IZoomVideoSDKUser *user)
+{
+	std::lock_guard<std::mutex> lock(list_mutex_);
+	return find_instance(user, AudioSource_Share) != nullptr;
+}
+
+void RawAudioFFMPEGEncoder::on_share_audio_received(AudioRawData *data)
+{
+	// the SDK mixes shared audio into one stream, it belongs to the share being recorded.
+	std::lock_guard<std::mutex> lock(list_mutex_);
+	RawAudioFFMPEGEncoder *encoder = RawAudioFFMPEGEncoder::find_instance(nullptr, AudioSource_Share);
+	if (encoder)
+	{
+		AudioIngestQueue::instance().push(encoder, data);
+	}
+}
+
+void RawAudioFFMPEGEncoder::on_mixed_audio_received(AudioRawData *data)
+{
+	std::lock_guard<std::mutex> lock(list_mutex_);
+	RawAudioFFMPEGEncoder *encoder = RawAudioFFMPEGEncoder::find_instance(nullptr, AudioSource_Mixed);
+	if (!encoder)
+	{
+		encoder = new RawAudioFFMPEGEncoder(nullptr, AudioSource_Mixed);
+		list_.push_back(encoder);
+	}
+	AudioIngestQueue::instance().push(encoder, data);
+}
+
+void RawAudioFFMPEGEncoder::stop_all()
+{
+	{
+		std::lock_guard<std::mutex> lock(list_mutex_);
+		for (auto iter = list_.begin(); iter != list_.end(); iter++)
+		{
+			AudioIngestQueue::instance().push_stop(*iter);
+		}
+		list_.clear();
+	}
+	AudioIngestQueue::instance().drain();
+}
+
+void RawAudioFFMPEGEncoder::process(const int16_t *samples, unsigned int bufLen, unsigned int sampleRate, unsigned int channels, steady_clock::time_point arrival)
+{
+	if (sampleRate == 0 || channels == 0)
+		return;
+	const int nb_samples = bufLen / (sizeof(int16_t) * channels);
+
+	if (start_failed_)
+		return;
+	if (!is_ffmpeg_encoding_on)
+	{
+		printf("********** [%d] Start audio encoding, user: %s, %dHz, %d channel(s).\n", instance_id_, user_name_.c_str(), sampleRate, channels);
+		if (!has_start_time_)
+		{
+			start_time = arrival;
+			has_start_time_ = true;
+		}
+		if (ffmpeg_start(user_name_.c_str(), user_id_.c_str(), sampleRate, channels) < 0)
+		{
+			printf("********** [%d] Audio encoding failed to start, user: %s, the stream is not recorded.\n", instance_id_, user_name_.c_str());
+			ffmpeg_free();
+			start_failed_ = true;
+			return;
+		}
+		is_ffmpeg_encoding_on = 1;
+	}
+
+	// the callback arrives when the buffer is complete, so it started one buffer earlier.
+	const int duration_ms = (int)((int64_t)nb_samples * 1000 / in_sample_rate);
+	int64_t time_ms = duration_cast<std::chrono::milliseconds>(arrival - start_time).count() - duration_ms;
+	if (time_ms < 0)
+		time_ms = 0;
+
+	// one metering pass per buffer, the VAD reuses its energy.
+	double mean_square = meter_.process(samples, nb_samples * channels);
+	if (time_ms - last_metrics_ms_ >= metrics_interval_ms)
+	{
+		last_metrics_ms_ = time_ms;
+		printf("********** [%d] Audio level, user: %s, momentary: %.1f LUFS, integrated: %.1f LUFS, peak: %.1f dBFS, clipped samples: %lld.\n",
+			   instance_id_, user_name_.c_str(), meter_.momentary_lufs(), meter_.integrated_lufs(), meter_.take_period_peak_dbfs(), (long long)meter_.clipped_samples());
+	}
+
+	bool speech = true;
+	if (source_ == AudioSource_OneWay)
+		speech = vad_.process(mean_square, time_ms, duration_ms);
+	if (speech)
+	{
+		// place the buffer on the session timeline: jitter is absorbed, short gaps are filled, long ones jumped.
+		int64_t end_ms = has_output_ ? (fifo_pts + av_audio_fifo_size(fifo)) * 1000 / pCodecCtx->sample_rate : -1;
+		int fill_ms = 0;
+		AudioContinuity::Action action = continuity_.place(time_ms, end_ms, &fill_ms);
+		if (action == AudioContinuity::Jump)
+		{
+			ffmpeg_encode_fifo(true);
+			fifo_pts = FFMAX(fifo_pts, time_ms * pCodecCtx->sample_rate / 1000);
+		}
+		else if (action == AudioContinuity::Fill)
+		{
+			// comfort noise at the speaker's noise floor, digital silence for share and mix.
+			int fill_samples = (int)((int64_t)fill_ms * in_sample_rate / 1000);
+			double rms = source_ == AudioSource_OneWay ? vad_.noise_rms() : 0;
+			ffmpeg_encode(continuity_.comfort_noise(fill_samples, in_channels, rms), fill_samples);
+		}
+		has_output_ = true;
+		ffmpeg_encode(samples, nb_samples);
+	}
+	else
+	{
+		if (was_speech_)
+		{
+			// end of a talk spurt, emit the tail instead of holding it until the next one.
+			ffmpeg_encode_fifo(true);
+		}
+		skipped_ms_ += duration_ms;
+	}
+	was_speech_ = speech;
+}
+
+int RawAudioFFMPEGEncoder::ffmpeg_start(const char *userName, const char *userID, int sampleRate, int channels)
+{
+	int ret = 0;
+
+	// timestamp, start_time is set by the caller
+	int64_t start_epoch_ms = MediaClock::epoch_ms(start_time);
+
+	in_sample_rate = sampleRate;
+	in_channels = channels;
+	meter_.reset(sampleRate, channels);
+
+	// init files
+	if (strlen(userID) == 0)
+		userID = "0";
+	char fileName[100];
+	if (source_ == AudioSource_Mixed)
+		snprintf(fileName, sizeof(fileName), "session_mixed_audio");
+	else if (source_ == AudioSource_Share)
+		// the share number of the share's video file, see RawDataFFMPEGEncoder::start_share_for.
+		snprintf(fileName, sizeof(fileName), "%s_%.40s_share%d_audio", userID, userName, share_number_);
+	else
+		snprintf(fileName, sizeof(fileName), "%s_%.40s_audio", userID, userName);
+	if (RecordingFile::create(fn_out, sizeof(fn_out), fileName, ".mka") < 0)
+		return -1;
+
+	// init encoder
+	av_register_all();
+	pFormatCtx = avformat_alloc_context();
+	fmt = av_guess_format(NULL, fn_out, NULL);
+	pFormatCtx->oformat = fmt;
+
+	// Open output file
+	if (avio_open(&pFormatCtx->pb, fn_out, AVIO_FLAG_READ_WRITE) < 0)
+	{
+		printf("Failed to open output file! \n");
+		return -1;
+	}
+
+	audio_st = avformat_new_stream(pFormatCtx, 0);
+	if (audio_st == NULL)
+	{
+		return -1;
+	}
+
+	pCodecCtx = audio_st->codec;
+	pCodecCtx->codec_id = fmt->audio_codec;
+	pCodecCtx->codec_type = AVMEDIA_TYPE_AUDIO;
+
+	pCodec = avcodec_find_encoder(pCodecCtx->codec_id);
+	if (!pCodec)
+	{
+		printf("Can not find audio encoder! \n");
+		return -1;
+	}
+
+	// pick the input rate if the encoder takes it, otherwise the closest supported one.
+	int out_sample_rate = sampleRate;
+	if (pCodec->supported_samplerates)
+	{
+		out_sample_rate = pCodec->supported_samplerates[0];
+		for (const int *rate = pCodec->supported_samplerates; *rate; rate++)
+		{
+			if (abs(*rate - sampleRate) < abs(out_sample_rate - sampleRate))
+				out_sample_rate = *rate;
+		}
+	}
+	pCodecCtx->sample_fmt = pCodec->sample_fmts ? pCodec->sample_fmts[0] : AV_SAMPLE_FMT_S16;
+	pCodecCtx->sample_rate = out_sample_rate;
+	pCodecCtx->channels = channels;
+	pCodecCtx->channel_layout = av_get_default_channel_layout(channels);
+	pCodecCtx->bit_rate = 48000 * channels;
+	pCodecCtx->time_base.num = 1;
+	pCodecCtx->time_base.den = out_sample_rate;
+	audio_st->time_base = pCodecCtx->time_base;
+	if (fmt->flags & AVFMT_GLOBALHEADER)
+		pCodecCtx->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
+
+	if (avcodec_open2(pCodecCtx, pCodec, NULL) < 0)
+	{
+		printf("Failed to open audio encoder! \n");
+		return -1;
+	}
+
+	frame_size = pCodecCtx->frame_size;
+	if (frame_size <= 0 || (pCodec->capabilities & AV_CODEC_CAP_VARIABLE_FRAME_SIZE))
+		frame_size = 1024;
+
+	// convert the SDK's interleaved s16 into the encoder's format and rate.
+	int64_t layout = av_get_default_channel_layout(channels);
+	swr_ctx = swr_alloc_set_opts(NULL,
+								 layout, pCodecCtx->sample_fmt, out_sample_rate,
+								 layout, AV_SAMPLE_FMT_S16, sampleRate,
+								 0, NULL);
+	if (!swr_ctx || swr_init(swr_ctx) < 0)
+	{
+		printf("Failed to init audio resampler! \n");
+		return -1;
+	}
+	fifo = av_audio_fifo_alloc(pCodecCtx->sample_fmt, channels, frame_size * 4);
+
+	pFrame = av_frame_alloc();
+	pFrame->nb_samples = frame_size;
+	pFrame->format = pCodecCtx->sample_fmt;
+	pFrame->channel_layout = pCodecCtx->channel_layout;
+	pFrame->sample_rate = out_sample_rate;
+	if (av_frame_get_buffer(pFrame, 0) < 0)
+	{
+		printf("Failed to alloc audio frame! \n");
+		return -1;
+	}
+
+	av_dump_format(pFormatCtx, 0, fn_out, 1);
+
+	// Write File Header
+	if ((ret = avformat_write_header(pFormatCtx, NULL)) < 0)
+	{
+		printf("Failed to write header! \n");
+		return ret;
+	}
+	fifo_pts = 0;
+	// the timeline is only opened for a file that is being written.
+	if (source_ == AudioSource_OneWay)
+	{
+		// named after the audio file, with its segment number.
+		char timelineFileName[130];
+		snprintf(timelineFileName, sizeof(timelineFileName), "%.*s.speech.csv", (int)strlen(fn_out) - 4, fn_out);
+		vad_.open_timeline(timelineFileName, start_epoch_ms);
+	}
+	return ret;
+}
+
+int RawAudioFFMPEGEncoder::ffmpeg_encode(const int16_t *samples, int nb_samples)
+{
+	int out_samples = swr_get_out_samples(swr_ctx, nb_samples);
+	if (out_samples > convert_buf_samples)
+	{
+		if (convert_buf)
+		{
+			av_freep(&convert_buf[0]);
+			av_freep(&convert_buf);
+		}
+		if (av_samples_alloc_array_and_samples(&convert_buf, NULL, in_channels, out_samples, pCodecCtx->sample_fmt, 0) < 0)
+		{
+			convert_buf_samples = 0;
+			return -1;
+		}
+		convert_buf_samples = out_samples;
+	}
+
+	const uint8_t *in[] = {reinterpret_cast<const uint8_t *>(samples)};
+	int converted = swr_convert(swr_ctx, convert_buf, out_samples, in, nb_samples);
+	if (converted < 0)
+	{
+		printf("Failed to convert audio samples.\n");
+		return -1;
+	}
+	av_audio_fifo_write(fifo, reinterpret_cast<void **>(convert_buf), converted);
+
+	return ffmpeg_encode_fifo(false);
+}
+
+int RawAudioFFMPEGEncoder::ffmpeg_encode_fifo(bool flush_partial)
+{
+	int ret;
+	while (av_audio_fifo_size(fifo) >= frame_size || (flush_partial && av_audio_fifo_size(fifo) > 0))
+	{
+		int n = FFMIN(av_audio_fifo_size(fifo), frame_size);
+		if (av_frame_make_writable(pFrame) < 0)
+			return -1;
+		av_audio_fifo_read(fifo, reinterpret_cast<void **>(pFrame->data), n);
+		if (n < frame_size)
+		{
+			// fixed frame size encoders need a full frame, pad the tail with silence.
+			av_samples_set_silence(pFrame->data, n, frame_size - n, in_channels, pCodecCtx->sample_fmt);
+		}
+		pFrame->nb_samples = frame_size;
+		pFrame->pts = fifo_pts;
+		fifo_pts += frame_size;
+
+		av_init_packet(&pkt);
+		pkt.data = NULL;
+		pkt.size = 0;
+		int got_packet = 0;
+		if ((ret = avcodec_encode_audio2(pCodecCtx, &pkt, pFrame, &got_packet)) < 0)
+		{
+			printf("Failed to encode audio, code: %d\n", ret);
+			return -1;
+		}
+		if (got_packet == 1)
+		{
+			packetcnt++;
+			pkt.stream_index = audio_st->index;
+			av_packet_rescale_ts(&pkt, pCodecCtx->time_base, audio_st->time_base);
+			av_write_frame(pFormatCtx, &pkt);
+			av_packet_unref(&pkt);
+		}
+	}
+	return 0;
+}
+
+int RawAudioFFMPEGEncoder::ffmpeg_stop()
+{
+	int ret;
+	int got_packet;
+
+	int64_t time_ms = duration_cast<std::chrono::milliseconds>(MediaClock::now() - start_time).count();
+	vad_.close_timeline(time_ms);
+
+	// Flush fifo and encoder
+	ffmpeg_encode_fifo(true);
+	if (pCodec->capabilities & AV_CODEC_CAP_DELAY)
+	{
+		while (1)
+		{
+			av_init_packet(&pkt);
+			pkt.data = NULL;
+			pkt.size = 0;
+			ret = avcodec_encode_audio2(pCodecCtx, &pkt, NULL, &got_packet);
+			if (ret < 0 || !got_packet)
+				break;
+			pkt.stream_index = audio_st->index;
+			av_packet_rescale_ts(&pkt, pCodecCtx->time_base, audio_st->time_base);
+			if (av_write_frame(pFormatCtx, &pkt) < 0)
+				break;
+			av_packet_unref(&pkt);
+		}
+	}
+	printf("********** [%d] Audio packets: %d, file: %s\n", instance_id_, packetcnt, fn_out);
+
+	// per recording level summary next to the audio file
+	char levelsFileName[130];
+	snprintf(levelsFileName, sizeof(levelsFileName), "%s.levels.json", fn_out);
+	FILE *fp_levels = fopen(levelsFileName, "w");
+	if (fp_levels)
+	{
+		fprintf(fp_levels, "%s\n", meter_.summary().c_str());
+		fclose(fp_levels);
+	}
+	if (meter_.is_dead())
+		printf("********** [%d] Warning: no signal above -60 dBFS, dead microphone? user: %s\n", instance_id_, user_name_.c_str());
+	if (meter_.clipped_samples() > 0)
+		printf("********** [%d] Warning: %lld clipped samples, user: %s\n", instance_id_, (long long)meter_.clipped_samples(), user_name_.c_str());
+
+	// Write file trailer
+	av_write_trailer(pFormatCtx);
+
+	// Clean
+	ffmpeg_free();
+	return 0;
+}
+
+// frees what ffmpeg_start allocated, also when it failed half way.
+void RawAudioFFMPEGEncoder::ffmpeg_free()
+{
+	if (pCodecCtx)
+		avcodec_close(pCodecCtx);
+	pCodecCtx = nullptr;
+	av_frame_free(&pFrame);
+	if (fifo)
+		av_audio_fifo_free(fifo);
+	fifo = nullptr;
+	swr_free(&swr_ctx);
+	if (convert_buf)
+	{
+		av_freep(&convert_buf[0]);
+		av_freep(&convert_buf);
+		convert_buf_samples = 0;
+	}
+	if (pFormatCtx)
+	{
+		avio_closep(&pFormatCtx->pb);
+		avformat_free_context(pFormatCtx);
+		pFormatCtx = nullptr;
+	}
+}
@@ -0,0 +1,126 @@
+#pragma once
+// ffmpeg
+#define __STDC_CONSTANT_MACROS
+extern "C"
+{
+#include "libavutil/avutil.h"
+#include "libavutil/audio_fifo.h"
+#include "libavutil/channel_layout.h"
+#include "libavformat/avformat.h"
+#include "libavcodec/avcodec.h"
+#include "libswresample/swresample.h"
+}
+#include <vector>
+#include <string>
+#include <mutex>
+#include <chrono>
+using namespace std::chrono;
+
+// Zoom Video SDK
+#include "zoom_sdk_raw_data_def.h"
+#include "helpers/zoom_video_sdk_user_helper_interface.h"
+using namespace ZOOMVIDEOSDK;
+
+#include "audio_vad.h"
+#include "audio_continuity.h"
+#include "audio_level_meter.h"
+
+typedef enum
+{
+	AudioSource_OneWay, // one user's voice, gated by voice activity
+	AudioSource_Share,  // computer audio shared along with a screen share
+	AudioSource_Mixed,  // the session mix as a participant would hear it
+} AudioSource;
+
+// Records one audio source to its own file. Buffers are queued by the SDK
+// callbacks and encoded on the AudioIngestQueue worker.
+// One-way audio is gated by AudioVAD: no packets are produced while the user
+// is not talking (DTX). Every encoded buffer is placed on the session
+// timeline by AudioContinuity, so gaps never shrink the recording.
+// Shared audio is encoded continuously on the clock of the share it belongs to,
+// the session mix on its own clock.
+class RawAudioFFMPEGEncoder
+{
+	static RawAudioFFMPEGEncoder* find_instance(IZoomVideoSDKUser* user, AudioSource source);
+
+	int instance_id_;
+	static int instance_count;
+	static std::vector<RawAudioFFMPEGEncoder*> list_;
+	static std::mutex list_mutex_;
+	IZoomVideoSDKUser* user_;
+	AudioSource source_;
+	int share_number_ = 0; // shared audio, see start_share_audio_for
+	// user name and id are copied, the SDK user object may be gone when the worker stops us.
+	std::string user_name_;
+	std::string user_id_;
+
+	int ffmpeg_start(const char* userName, const char* userID, int sampleRate, int channels);
+	int ffmpeg_encode(const int16_t* samples, int nb_samples);
+	int ffmpeg_encode_fifo(bool flush_partial);
+	int ffmpeg_stop();
+	void ffmpeg_free();
+
+	// ffmpeg encoding
+	AVFormatContext* pFormatCtx = nullptr;
+	AVOutputFormat* fmt;
+	AVStream* audio_st;
+	AVCodecContext* pCodecCtx = nullptr;
+	AVCodec* pCodec;
+	AVPacket pkt;
+	AVFrame* pFrame = nullptr;
+	SwrContext* swr_ctx = nullptr;
+	AVAudioFifo* fifo = nullptr;
+	uint8_t** convert_buf = nullptr;
+	int convert_buf_samples = 0;
+	int frame_size = 0;
+	int in_sample_rate = 0;
+	int in_channels = 0;
+	int64_t fifo_pts = 0; // pts of the first sample in fifo, in codec samples
+	int packetcnt = 0;
+	int is_ffmpeg_encoding_on = 0;
+	bool start_failed_ = false; // no retry per buffer, the rest of the stream is dropped
+	bool has_start_time_ = false;
+	bool has_output_ = false;
+	steady_clock::time_point start_time;
+
+	// voice activity gating
+	AudioVAD vad_;
+	bool was_speech_ = false;
+	int64_t skipped_ms_ = 0;
+
+	// gap filling against arrival time
+	AudioContinuity continuity_;
+
+	// level metering, logged every metrics_interval_ms and summarized per recording
+	static const int metrics_interval_ms = 10000;
+	AudioLevelMeter meter_;
+	int64_t last_metrics_ms_ = 0;
+
+	//Output audio file name.
+	char fn_out[120];
+
+	RawAudioFFMPEGEncoder(IZoomVideoSDKUser* user, AudioSource source);
+	~RawAudioFFMPEGEncoder();
+	friend class AudioIngestQueue;
+
+	// worker side, called by AudioIngestQueue.
+	void process(const int16_t* samples, unsigned int bufLen, unsigned int sampleRate, unsigned int channels, steady_clock::time_point arrival);
+
+public:
+	static void start_encoding_for(IZoomVideoSDKUser* user);
+	static void stop_encoding_for(IZoomVideoSDKUser* user);
+	static void on_audio_received(AudioRawData* data, IZoomVideoSDKUser* user);
+
+	// shared computer audio, timestamps are relative to share_start. share is the
+	// number of the share in the session, the audio file carries it like the video's.
+	static void start_share_audio_for(IZoomVideoSDKUser* user, steady_clock::time_point share_start, int share);
+	static void stop_share_audio_for(IZoomVideoSDKUser* user);
+	static bool has_share_audio_for(IZoomVideoSDKUser* user);
+	static void on_share_audio_received(AudioRawData* data);
+
+	// session mix, started with its first buffer.
+	static void on_mixed_audio_received(AudioRawData* data);
+
+	// stop every encoder and wait until their files are finalized.
+	static void stop_all();
+};
@@ -1,41 +1,120 @@
 
 #include "raw_data_ffmpeg_encoder.h"
+#include "gallery_compositor.h"
+#include "pip_compositor.h"
+#include "frame_capture.h"
+#include "frame_trace.h"
+#include "media_clock.h"
+#include "memory_accounting.h"
+#include "recording_file.h"
+#include <algorithm>
 
 using namespace ZOOMVIDEOSDK;
 
 const AVPixelFormat pix_fmts[] = {AV_PIX_FMT_YUV420P, AV_PIX_FMT_NONE};
 std::vector<RawDataFFMPEGEncoder *> RawDataFFMPEGEncoder::list_;
 int RawDataFFMPEGEncoder::instance_count = 0;
+bool RawDataFFMPEGEncoder::burn_in = false;
+bool RawDataFFMPEGEncoder::deterministic = false;
+std::atomic<int64_t> RawDataFFMPEGEncoder::stats_frames_(0);
+std::atomic<int64_t> RawDataFFMPEGEncoder::stats_us_(0);
+std::atomic<int64_t> RawDataFFMPEGEncoder::stats_max_us_(0);
+
+// counts the time the frame callback took when it returns, whichever way it does.
+struct FrameTimer
+{
+	steady_clock::time_point begin = steady_clock::now();
+	~FrameTimer() { RawDataFFMPEGEncoder::count_frame(steady_clock::now() - begin); }
+};
+
+RawDataFFMPEGEncoder::RawDataFFMPEGEncoder(IZoomVideoSDKUser *user, VideoProfile profile)
+{
+	instance_id_ = instance_count++;
+	user_ = user;
+	name_changed_ = true;
+	profile_ = profile;
+	if (profile_ == VideoProfile_Share)
+	{
+		// the share pipe delivers the shared screen at its native size whatever is requested here.
+		pipe_ = user_->GetSharePipe();
+		pipe_->subscribe(ZoomVideoSDKResolution_720P, this);
+	}
+	else
+	{
+		pipe_ = user_->GetVideoPipe();
+		pipe_->subscribe(ZoomVideoSDKResolution_360P, this);
+	}
+	list_.push_back(this);
+	open_memory_owner();
+}
 
-RawDataFFMPEGEncoder::RawDataFFMPEGEncoder(IZoomVideoSDKUser *user)
+RawDataFFMPEGEncoder::RawDataFFMPEGEncoder(IZoomVideoSDKUser *user, IZoomVideoSDKRawDataPipe *pipe)
 {
 	instance_id_ = instance_count++;
 	user_ = user;
-	user_->GetVideoPipe()->subscribe(ZoomVideoSDKResolution_360P, this);
+	name_changed_ = true;
+	profile_ = VideoProfile_MultiCamera;
+	pipe_ = pipe;
+	IVideoSDKVector<IZoomVideoSDKRawDataPipe *> *cameras = user_->getMultiCameraStreamList();
+	int count = cameras ? cameras->GetCount() : 0;
+	for (int index = 0; index < count; index++)
+	{
+		if (cameras->GetItem(index) == pipe_)
+			camera_index_ = index + 1;
+	}
+	pipe_->subscribe(ZoomVideoSDKResolution_360P, this);
 	list_.push_back(this);
+	open_memory_owner();
 }
 
 RawDataFFMPEGEncoder::~RawDataFFMPEGEncoder()
 {
 	// finish ffmpeg encoding
-	log(L"********** [%d] Finishing encoding, user: %s, %dx%d.\n", instance_id_, user_->getUserName(), in_width, in_height);
+	log("********** [%d] Finishing encoding, user: %s, %dx%d.\n", instance_id_, user_->getUserName(), in_width, in_height);
+	pipe_->unSubscribe(this);
 	if (is_ffmpeg_encoding_on)
 	{
 		ffmpeg_stop();
 		is_ffmpeg_encoding_on = 0;
 	}
-	user_->GetVideoPipe()->unSubscribe(this);
-	log(L"********** [%d] UnSubscribe, user: %s.\n", instance_id_, user_->getUserName());
+	log("********** [%d] UnSubscribe, user: %s.\n", instance_id_, user_->getUserName());
+	MemoryAccounting::release_owner(memory_owner_);
+	list_.erase(std::remove(list_.begin(), list_.end(), this), list_.end());
 	instance_count--;
 	user_ = nullptr;
 }
 
-RawDataFFMPEGEncoder *RawDataFFMPEGEncoder::find_instance(IZoomVideoSDKUser *user)
+void RawDataFFMPEGEncoder::open_memory_owner()
+{
+	char name[64];
+	if (profile_ == VideoProfile_Share)
+		snprintf(name, sizeof(name), "[%d] %s share", instance_id_, user_->getUserName());
+	else if (profile_ == VideoProfile_MultiCamera)
+		snprintf(name, sizeof(name), "[%d] %s camera%d", instance_id_, user_->getUserName(), camera_index_);
+	else
+		snprintf(name, sizeof(name), "[%d] %s camera", instance_id_, user_->getUserName());
+	memory_owner_ = MemoryAccounting::register_owner(name);
+}
+
+RawDataFFMPEGEncoder *RawDataFFMPEGEncoder::find_instance(IZoomVideoSDKUser *user, VideoProfile profile)
 {
 	for (auto iter = list_.begin(); iter != list_.end(); iter++)
 	{
 		RawDataFFMPEGEncoder *item = *iter;
-		if (item->user_ == user)
+		if (item->user_ == user && item->profile_ == profile)
+		{
+			return item;
+		}
+	}
+	return nullptr;
+}
+
+RawDataFFMPEGEncoder *RawDataFFMPEGEncoder::find_instance(IZoomVideoSDKRawDataPipe *pipe)
+{
+	for (auto iter = list_.begin(); iter != list_.end(); iter++)
+	{
+		RawDataFFMPEGEncoder *item = *iter;
+		if (item->pipe_ == pipe)
 		{
 			return item;
 		}
@@ -45,44 +124,159 @@ RawDataFFMPEGEncoder *RawDataFFMPEGEncoder::find_instance(IZoomVideoSDKUser *use
 
 void RawDataFFMPEGEncoder::stop_encoding_for(IZoomVideoSDKUser *user)
 {
-	RawDataFFMPEGEncoder *encoder = RawDataFFMPEGEncoder::find_instance(user);
+	RawDataFFMPEGEncoder *encoder;
+	while ((encoder = RawDataFFMPEGEncoder::find_instance(user, VideoProfile_Camera)) ||
+		   (encoder = RawDataFFMPEGEncoder::find_instance(user, VideoProfile_Share)) ||
+		   (encoder = RawDataFFMPEGEncoder::find_instance(user, VideoProfile_MultiCamera)))
+	{
+		delete encoder;
+	}
+}
+
+void RawDataFFMPEGEncoder::start_share_for(IZoomVideoSDKUser *user, steady_clock::time_point share_start, int share)
+{
+	if (find_instance(user, VideoProfile_Share))
+		return;
+	RawDataFFMPEGEncoder *encoder = new RawDataFFMPEGEncoder(user, VideoProfile_Share);
+	encoder->share_number_ = share;
+	encoder->start_time = share_start;
+	encoder->has_start_time_ = true;
+}
+
+void RawDataFFMPEGEncoder::stop_share_for(IZoomVideoSDKUser *user)
+{
+	RawDataFFMPEGEncoder *encoder = find_instance(user, VideoProfile_Share);
 	if (encoder)
 	{
-		encoder->~RawDataFFMPEGEncoder();
+		delete encoder;
 	}
 }
+
+void RawDataFFMPEGEncoder::on_user_name_changed(IZoomVideoSDKUser *user)
+{
+	for (auto iter = list_.begin(); iter != list_.end(); iter++)
+	{
+		if ((*iter)->user_ == user)
+			(*iter)->name_changed_ = true;
+	}
+}
+
+void RawDataFFMPEGEncoder::start_multi_camera_for(IZoomVideoSDKUser *user, IZoomVideoSDKRawDataPipe *pipe)
+{
+	if (!pipe || find_instance(pipe))
+		return;
+	RawDataFFMPEGEncoder *encoder = new RawDataFFMPEGEncoder(user, pipe);
+	log("********** [%d] Multi-camera stream joined, user: %s, camera: %d.\n", encoder->instance_id_, user->getUserName(), encoder->camera_index_);
+}
+
+void RawDataFFMPEGEncoder::stop_multi_camera_for(IZoomVideoSDKRawDataPipe *pipe)
+{
+	RawDataFFMPEGEncoder *encoder = find_instance(pipe);
+	if (encoder && encoder->profile_ == VideoProfile_MultiCamera)
+		delete encoder;
+}
+
 int j = 0;
 
 void RawDataFFMPEGEncoder::onRawDataFrameReceived(YUVRawDataI420 *data)
 {
+	// ingest: everything before scaling, new files are opened in it.
+	FrameTimer timer;
+	TraceFrame trace("frame", instance_id_);
+	TraceSpan ingest("ingest");
+	MemoryScope memory(memory_owner_, Memory_Other);
+	if (FrameCapture::is_on())
+		FrameCapture::on_frame(user_, profile_, camera_index_, data);
 	const zchar_t *userName = user_->getUserName();
 	const zchar_t *userID = user_->getUserID();
-	const int width = data->GetStreamWidth();
-	const int height = data->GetStreamHeight();
+	const int stream_width = data->GetStreamWidth();
+	const int stream_height = data->GetStreamHeight();
 	const int bufLen = data->GetBufferLen();
-	const int rotation = data->GetRotation();
+	// shares are always upright.
+	const int turns = profile_ == VideoProfile_Share ? 0 : FrameRotator::quarter_turns(data->GetRotation());
 	const int sourceID = data->GetSourceID();
+	const bool full_range = !data->IsLimitedI420();
+	// the upright size, everything after the rotation works with it.
+	const int width = turns % 2 ? stream_height : stream_width;
+	const int height = turns % 2 ? stream_width : stream_height;
+	if (turns != current_turns)
+	{
+		log("********** [%d] Rotation, user: %s, %d -> %d degrees.\n", instance_id_, user_->getUserName(), current_turns * 90, turns * 90);
+		current_turns = turns;
+	}
 
 	if ((sourceID != current_sourceID) && (sourceID == 0 || strlen(userID) > 0) // to skip frames when sourceID comes in but userID is not ready, otherwise create another sepreate file for this moment.
 	)
 	{
-		log(L"********** [%d] Start encoding, user: %s, %dx%d, sourceID: %d.\n", instance_id_, user_->getUserName(), width, height, sourceID);
+		log("********** [%d] Start encoding, user: %s, %dx%d, sourceID: %d.\n", instance_id_, user_->getUserName(), width, height, sourceID);
 		if (is_ffmpeg_encoding_on)
 		{
 			ffmpeg_stop();
 		};
 		current_sourceID = sourceID;
+		full_range_ = full_range;
 		in_width = width;
 		in_height = height;
-		ffmpeg_start(userName, userID, sourceID);
-		is_ffmpeg_encoding_on = 1;
+		if (profile_ == VideoProfile_Share)
+		{
+			// native resolution, only rounded down to what 4:2:0 can encode.
+			out_width = in_width & ~1;
+			out_height = in_height & ~1;
+		}
+		else
+		{
+			set_camera_output_size();
+		}
+		is_ffmpeg_encoding_on = ffmpeg_start(userName, userID, sourceID) == 0 ? 1 : 0;
 	}
 	else
 	{
-		if (is_ffmpeg_encoding_on == 1 && (width != in_width || height != in_height))
+		if (is_ffmpeg_encoding_on == 1 && full_range != full_range_)
+		{
+			// the range is tagged once per stream, a source switching range continues in a new file
+			// named after its range.
+			log("********** [%d] Color range changed, user: %s, %s -> %s.\n", instance_id_, user_->getUserName(),
+				full_range_ ? "full" : "limited", full_range ? "full" : "limited");
+			ffmpeg_stop();
+			full_range_ = full_range;
+			in_width = width;
+			in_height = height;
+			if (profile_ == VideoProfile_Share)
+			{
+				out_width = in_width & ~1;
+				out_height = in_height & ~1;
+			}
+			else
+			{
+				set_camera_output_size();
+			}
+			is_ffmpeg_encoding_on = ffmpeg_start(userName, userID, sourceID) == 0 ? 1 : 0;
+		}
+		else if (is_ffmpeg_encoding_on == 1 && profile_ == VideoProfile_Share && (width != in_width || height != in_height))
+		{
+			// a resized share is not squeezed into the old size, it continues in a new file at its new size.
+			log("********** [%d] Share resized, user: %s, %dx%d -> %dx%d.\n", instance_id_, user_->getUserName(), in_width, in_height, width, height);
+			ffmpeg_stop();
+			in_width = width;
+			in_height = height;
+			out_width = in_width & ~1;
+			out_height = in_height & ~1;
+			is_ffmpeg_encoding_on = ffmpeg_start(userName, userID, sourceID) == 0 ? 1 : 0;
+		}
+		else if (is_ffmpeg_encoding_on == 1 && (width != in_width || height != in_height) && (height > width) != (out_height > out_width))
+		{
+			// the camera turned between landscape and portrait, the output turns with it in a new file.
+			log("********** [%d] Orientation changed, user: %s, %dx%d -> %dx%d.\n", instance_id_, user_->getUserName(), in_width, in_height, width, height);
+			ffmpeg_stop();
+			in_width = width;
+			in_height = height;
+			set_camera_output_size();
+			is_ffmpeg_encoding_on = ffmpeg_start(userName, userID, sourceID) == 0 ? 1 : 0;
+		}
+		else if (is_ffmpeg_encoding_on == 1 && (width != in_width || height != in_height))
 		{
 			is_ffmpeg_encoding_on = 0;
-			log(L"********** [%d] Update scale, user: %s, %dx%d -> %dx%d sourceID: %d.\n", instance_id_, user_->getUserName(), in_width, in_height, width, height, sourceID);
+			log("********** [%d] Update scale, user: %s, %dx%d -> %dx%d sourceID: %d.\n", instance_id_, user_->getUserName(), in_width, in_height, width, height, sourceID);
 			in_width = width;
 			in_height = height;
 			// the video source reslution changed, update the ffmpeg filter for scale.
@@ -93,17 +287,70 @@ void RawDataFFMPEGEncoder::onRawDataFrameReceived(YUVRawDataI420 *data)
 	}
 	if (is_ffmpeg_encoding_on)
 	{
-		ffmpeg_filter(
-			reinterpret_cast<unsigned char *>(data->GetYBuffer()),
-			reinterpret_cast<unsigned char *>(data->GetUBuffer()),
-			reinterpret_cast<unsigned char *>(data->GetVBuffer()));
-		ffmpeg_encode();
+		// identical frames are dropped before scaling, the player holds the last one (VFR).
+		// A frame is still encoded as a keyframe every keyframe_interval_ms.
+		const int64_t now_ms = duration_cast<std::chrono::milliseconds>(MediaClock::now() - start_time).count();
+		const bool keyframe_due = now_ms - last_keyframe_ms >= keyframe_interval_ms;
+		// with burn-in, a still picture is encoded once a second to keep the clock running.
+		const time_t now_s = MediaClock::wall_time();
+		const bool clock_due = burn_in && now_s != clock_second_;
+		const uint8_t *Y = reinterpret_cast<const uint8_t *>(data->GetYBuffer());
+		const uint8_t *U = reinterpret_cast<const uint8_t *>(data->GetUBuffer());
+		const uint8_t *V = reinterpret_cast<const uint8_t *>(data->GetVBuffer());
+		// shares track dirty tiles, a frame without any is a duplicate.
+		const bool duplicate = profile_ == VideoProfile_Share ? dirty_.update(Y, U, V, stream_width, stream_height) == 0
+															   : fingerprint_.is_duplicate(Y, U, V, stream_width, stream_height);
+		if (duplicate && !keyframe_due && !clock_due)
+		{
+			dropped_framecnt++;
+			return;
+		}
+		// rotate after the duplicate check, dropped frames cost no rotation.
+		if (turns)
+		{
+			int rotated_width = stream_width;
+			int rotated_height = stream_height;
+			rotator_.rotate(Y, U, V, rotated_width, rotated_height, turns, &Y, &U, &V);
+		}
+		if (profile_ == VideoProfile_Camera)
+		{
+			GalleryCompositor::on_frame(user_, Y, U, V, width, height, full_range);
+			PipCompositor::on_camera_frame(user_, Y, U, V, width, height, full_range);
+		}
+		ingest.end();
+		{
+			TraceSpan scale("scale");
+			ffmpeg_filter(const_cast<uint8_t *>(Y), const_cast<uint8_t *>(U), const_cast<uint8_t *>(V));
+			if (burn_in)
+				draw_overlay(now_s);
+		}
+		ffmpeg_encode(keyframe_due);
+	}
+}
+
+void RawDataFFMPEGEncoder::count_frame(steady_clock::duration took)
+{
+	int64_t us = duration_cast<microseconds>(took).count();
+	stats_frames_.fetch_add(1, std::memory_order_relaxed);
+	stats_us_.fetch_add(us, std::memory_order_relaxed);
+	int64_t max = stats_max_us_.load(std::memory_order_relaxed);
+	while (us > max && !stats_max_us_.compare_exchange_weak(max, us, std::memory_order_relaxed))
+	{
 	}
 }
 
+void RawDataFFMPEGEncoder::take_frame_stats(int64_t *frames, double *mean_ms, double *max_ms)
+{
+	// the counters are taken one by one, a frame counted meanwhile may fall between two windows.
+	*frames = stats_frames_.exchange(0);
+	int64_t us = stats_us_.exchange(0);
+	*max_ms = stats_max_us_.exchange(0) / 1000.0;
+	*mean_ms = *frames > 0 ? us / 1000.0 / *frames : 0.0;
+}
+
 void RawDataFFMPEGEncoder::onRawDataStatusChanged(RawDataStatus status)
 {
-	log(L"********** [%d] onRawDataStatusChanged, user: %s, %d.\n", instance_id_, user_->getUserName(), status);
+	log("********** [%d] onRawDataStatusChanged, user: %s, %d.\n", instance_id_, user_->getUserName(), status);
 	if (status == RawData_On)
 	{
 	}
@@ -119,28 +366,101 @@ void RawDataFFMPEGEncoder::err_msg(int code)
 	printf("%s\n", errbuf);
 }
 
-void RawDataFFMPEGEncoder::log(const wchar_t *format, ...)
+void RawDataFFMPEGEncoder::log(const char *format, ...)
 {
 	va_list args;
 	va_start(args, format);
-	wprintf(format, args);
+	vprintf(format, args);
 	va_end(args);
 }
 
+void RawDataFFMPEGEncoder::draw_overlay(time_t now)
+{
+	if (!filter_graph)
+	{
+		// frame_out is the source frame itself, draw on a copy.
+		overlay_buffer_.resize(av_image_get_buffer_size(AV_PIX_FMT_YUV420P, out_width, out_height, 1));
+		uint8_t *data[4];
+		int linesize[4];
+		av_image_fill_arrays(data, linesize, overlay_buffer_.data(), AV_PIX_FMT_YUV420P, out_width, out_height, 1);
+		av_image_copy(data, linesize, const_cast<const uint8_t **>(frame_out->data), frame_out->linesize,
+					  AV_PIX_FMT_YUV420P, out_width, out_height);
+		for (int i = 0; i < 3; i++)
+		{
+			frame_out->data[i] = data[i];
+			frame_out->linesize[i] = linesize[i];
+		}
+	}
+	else if (av_frame_make_writable(frame_out) < 0)
+	{
+		return;
+	}
+
+	// text runs are only rasterized again when their text changes.
+	const int scale = std::max(1, out_height / 240);
+	if (name_changed_.exchange(false) || name_run_.width() == 0)
+		name_run_.set_text(user_->getUserName(), scale);
+	if (now != clock_second_)
+	{
+		struct tm local;
+		char clock_text[32];
+		localtime_r(&now, &local);
+		strftime(clock_text, sizeof(clock_text), "%Y-%m-%d %H:%M:%S", &local);
+		clock_run_.set_text(clock_text, scale);
+		clock_second_ = now;
+	}
+
+	const int margin = 4 * scale;
+	clock_run_.blend(frame_out->data[0], frame_out->data[1], frame_out->data[2], frame_out->linesize[0], frame_out->linesize[1],
+					 out_width, out_height, out_width - clock_run_.width() - margin, margin);
+	name_run_.blend(frame_out->data[0], frame_out->data[1], frame_out->data[2], frame_out->linesize[0], frame_out->linesize[1],
+					out_width, out_height, margin, out_height - name_run_.height() - margin);
+}
+
+void RawDataFFMPEGEncoder::set_camera_output_size()
+{
+	// 640x480, turned for portrait sources so they are not stretched sideways.
+	out_width = in_height > in_width ? 480 : 640;
+	out_height = in_height > in_width ? 640 : 480;
+}
+
 int RawDataFFMPEGEncoder::ffmpeg_start(const char *userName, const char *userID, int sourceID)
 {
 	int ret = 0;
 
-	// timestamp
-	start_time = steady_clock::now();
+	// timestamp, a share keeps the clock it was started with
+	if (!has_start_time_ && profile_ == VideoProfile_MultiCamera)
+	{
+		// an additional camera runs on the clock of the user's camera, so the files line up.
+		RawDataFFMPEGEncoder *camera = find_instance(user_, VideoProfile_Camera);
+		if (camera && camera->is_ffmpeg_encoding_on)
+		{
+			start_time = camera->start_time;
+			has_start_time_ = true;
+		}
+	}
+	if (!has_start_time_)
+		start_time = MediaClock::now();
+	last_pts = -1;
+	last_keyframe_ms = 0;
+	fingerprint_.reset();
+	dirty_.reset();
 
 	// init files
 	if (strlen(userID) == 0)
 		userID = "0";
 	char fileName[100];
-	sprintf(fileName, "%s_%d_%s_%dx%d_to_%dx%d", userID, sourceID, userName, in_width, in_height, out_width, out_height);
+	// the user name is cut to 40 characters, the rest of the name always fits.
+	// Full range streams are marked, a range switch never continues under the old name.
+	const char *range = full_range_ ? "_full" : "";
+	if (profile_ == VideoProfile_Share)
+		snprintf(fileName, sizeof(fileName), "%s_%d_%.40s_share%d_%dx%d%s", userID, sourceID, userName, share_number_, out_width, out_height, range);
+	else if (profile_ == VideoProfile_MultiCamera)
+		snprintf(fileName, sizeof(fileName), "%s_%d_%.40s_camera%d_%dx%d_to_%dx%d%s", userID, sourceID, userName, camera_index_, in_width, in_height, out_width, out_height, range);
+	else
+		snprintf(fileName, sizeof(fileName), "%s_%d_%.40s_%dx%d_to_%dx%d%s", userID, sourceID, userName, in_width, in_height, out_width, out_height, range);
 	char yuvFileName[110];
-	sprintf(yuvFileName, "../%s.yuv", fileName);
+	snprintf(yuvFileName, sizeof(yuvFileName), "../%s.yuv", fileName);
 	if (isOutputYUV)
 	{
 		fp_yuv = fopen(yuvFileName, "wb + ");
@@ -151,9 +471,9 @@ int RawDataFFMPEGEncoder::ffmpeg_start(const char *userName, const char *userID,
 		}
 	}
 
-	char outFileName[110];
-	sprintf(outFileName, "%s.mkv", fileName);
-	sprintf(fn_out, "../%s", outFileName);
+	// a stream restarted under the same name continues in a new file.
+	if (RecordingFile::create(fn_out, sizeof(fn_out), fileName, ".mkv") < 0)
+		return -1;
 
 	// ffmpeg init
 	// init filters
@@ -163,6 +483,7 @@ int RawDataFFMPEGEncoder::ffmpeg_start(const char *userName, const char *userID,
 
 	// init encoder
 	av_register_all();
+	MemoryScope muxer(memory_owner_, Memory_Muxer);
 	pFormatCtx = avformat_alloc_context();
 
 	// Method1: Guess Format
@@ -205,6 +526,14 @@ int RawDataFFMPEGEncoder::ffmpeg_start(const char *userName, const char *userID,
 	pCodecCtx->qmax = 51;
 	// Optional Param
 	pCodecCtx->max_b_frames = 3;
+	if (profile_ == VideoProfile_Share)
+	{
+		// screen content: frames arrive from 0 to 30 fps, so time stamps are in ms
+		// rather than ticks of a fixed rate, and keyframes are spaced far apart.
+		pCodecCtx->time_base.den = 1000;
+		pCodecCtx->bit_rate = 1000000;
+		pCodecCtx->gop_size = 300;
+	}
 
 	// Show some Information
 	av_dump_format(pFormatCtx, 0, fn_out, 1);
@@ -219,19 +548,40 @@ int RawDataFFMPEGEncoder::ffmpeg_start(const char *userName, const char *userID,
 
 	pCodecCtx->width = out_width;
 	pCodecCtx->height = out_height;
+	// the SDK's I420 is BT.601; the range is the source's, scaling keeps it.
+	pCodecCtx->color_range = full_range_ ? AVCOL_RANGE_JPEG : AVCOL_RANGE_MPEG;
+	pCodecCtx->colorspace = AVCOL_SPC_SMPTE170M;
+	pCodecCtx->color_primaries = AVCOL_PRI_SMPTE170M;
+	pCodecCtx->color_trc = AVCOL_TRC_SMPTE170M;
+	if (deterministic)
+	{
+		// one encoder thread: x264 output depends on its threading. No random file UIDs.
+		pCodecCtx->thread_count = 1;
+		pCodecCtx->flags |= AV_CODEC_FLAG_BITEXACT;
+		pFormatCtx->flags |= AVFMT_FLAG_BITEXACT;
+	}
 
 	AVDictionary *param = 0;
 	// H.264
-	if (pCodecCtx->codec_id == AV_CODEC_ID_H264)
+	if (pCodecCtx->codec_id == AV_CODEC_ID_H264 && profile_ == VideoProfile_Share)
+	{
+		av_dict_set(&param, "preset", "veryfast", 0);
+		av_dict_set(&param, "tune", "stillimage", 0);
+	}
+	else if (pCodecCtx->codec_id == AV_CODEC_ID_H264)
 	{
 		av_dict_set(&param, "preset", "slow", 0);
 		av_dict_set(&param, "tune", "zerolatency", 0);
 		// av_dict_set(&param, "profile", "main", 0);
 	}
-	if (avcodec_open2(pCodecCtx, pCodec, &param) < 0)
 	{
-		printf("Failed to open encoder! \n");
-		return -1;
+		// x264 allocates its context, lookahead and frame buffers when opened.
+		MemoryScope encoder(memory_owner_, Memory_Encoder);
+		if (avcodec_open2(pCodecCtx, pCodec, &param) < 0)
+		{
+			printf("Failed to open encoder! \n");
+			return -1;
+		}
 	}
 
 	// Write File Header
@@ -246,11 +596,24 @@ int RawDataFFMPEGEncoder::ffmpeg_start(const char *userName, const char *userID,
 int RawDataFFMPEGEncoder::ffmpeg_filter_init()
 {
 	int ret;
+	MemoryScope memory(memory_owner_, Memory_Filter);
+
+	// a rescale builds the filter again, the old one goes first.
+	ffmpeg_filter_free();
+	if (in_width == out_width && in_height == out_height)
+	{
+		// nothing to scale, frames go to the encoder as they come from the SDK.
+		frame_in = av_frame_alloc();
+		frame_out = av_frame_alloc();
+		av_image_fill_linesizes(frame_in->linesize, AV_PIX_FMT_YUV420P, in_width);
+		frame_in->format = AV_PIX_FMT_YUV420P;
+		frame_in->width = in_width;
+		frame_in->height = in_height;
+		return 0;
+	}
 
 	buffersrc = avfilter_get_by_name("buffer");
 	buffersink = avfilter_get_by_name("buffersink");
-	outputs = avfilter_inout_alloc();
-	inputs = avfilter_inout_alloc();
 	buffersink_params = av_buffersink_params_alloc();
 
 	filter_graph = avfilter_graph_alloc();
@@ -289,11 +652,17 @@ int RawDataFFMPEGEncoder::ffmpeg_filter_init()
 	inputs->pad_idx = 0;
 	inputs->next = NULL;
 
-	char filter_descr[50];
-	sprintf(filter_descr, "scale=w=%d:h=%d", out_width, out_height);
-
-	if (avfilter_graph_parse_ptr(filter_graph, filter_descr,
-								 &inputs, &outputs, NULL) < 0)
+	// no range conversion in the scaler, the output is tagged with the source range.
+	const char *range = full_range_ ? "jpeg" : "mpeg";
+	char filter_descr[150];
+	sprintf(filter_descr, "scale=w=%d:h=%d:in_range=%s:out_range=%s", out_width, out_height, range, range);
+	if (deterministic)
+		strcat(filter_descr, ":flags=bicubic+bitexact+accurate_rnd");
+
+	ret = avfilter_graph_parse_ptr(filter_graph, filter_descr, &inputs, &outputs, NULL);
+	avfilter_inout_free(&inputs);
+	avfilter_inout_free(&outputs);
+	if (ret < 0)
 		return -2;
 
 	if (avfilter_graph_config(filter_graph, NULL) < 0)
@@ -319,10 +688,13 @@ int RawDataFFMPEGEncoder::ffmpeg_filter_init()
 
 int RawDataFFMPEGEncoder::ffmpeg_filter(uint8_t *Y, uint8_t *U, uint8_t *V)
 {
+	MemoryScope memory(memory_owner_, Memory_Filter);
 	// input Y,U,V
 	frame_in->data[0] = Y;
 	frame_in->data[1] = U;
 	frame_in->data[2] = V;
+	frame_in->color_range = full_range_ ? AVCOL_RANGE_JPEG : AVCOL_RANGE_MPEG;
+	frame_in->colorspace = AVCOL_SPC_SMPTE170M;
 
 	// output Y,U,V
 	if (isOutputYUV && frame_in->format == AV_PIX_FMT_YUV420P)
@@ -341,6 +713,19 @@ int RawDataFFMPEGEncoder::ffmpeg_filter(uint8_t *Y, uint8_t *U, uint8_t *V)
 		}
 	}
 
+	if (!filter_graph)
+	{
+		for (int i = 0; i < 3; i++)
+		{
+			frame_out->data[i] = frame_in->data[i];
+			frame_out->linesize[i] = frame_in->linesize[i];
+		}
+		frame_out->format = frame_in->format;
+		frame_out->width = frame_in->width;
+		frame_out->height = frame_in->height;
+		return 0;
+	}
+
 	// apply filter
 	if (av_buffersrc_add_frame(buffersrc_ctx, frame_in) < 0)
 	{
@@ -355,31 +740,48 @@ int RawDataFFMPEGEncoder::ffmpeg_filter(uint8_t *Y, uint8_t *U, uint8_t *V)
 	return 0;
 }
 
-int RawDataFFMPEGEncoder::ffmpeg_encode()
+int RawDataFFMPEGEncoder::ffmpeg_encode(bool force_keyframe)
 {
 	int ret;
+	MemoryScope memory(memory_owner_, Memory_Encoder);
 
 	// timestamp
-	steady_clock::time_point current_time = steady_clock::now();
+	steady_clock::time_point current_time = MediaClock::now();
 
 	// frame_out->pts = ((tstruct.time - start_tstruct.time) * 1000 + (tstruct.millitm - start_tstruct.millitm)) * 10;
 	frame_out->pts = duration_cast<std::chrono::milliseconds>(current_time - start_time).count() * (video_st->time_base.den) / (video_st->time_base.num * 1000);
+	// two frames in the same ms must not share a timestamp.
+	if (frame_out->pts <= last_pts)
+		frame_out->pts = last_pts + 1;
+	last_pts = frame_out->pts;
+	frame_out->pict_type = force_keyframe ? AV_PICTURE_TYPE_I : AV_PICTURE_TYPE_NONE;
+	frame_out->color_range = pCodecCtx->color_range;
+	frame_out->colorspace = pCodecCtx->colorspace;
+	frame_out->color_primaries = pCodecCtx->color_primaries;
+	frame_out->color_trc = pCodecCtx->color_trc;
 
 	av_init_packet(&pkt);
 
 	int got_picture = 0;
+	TraceSpan encode("encode");
 	if ((ret = avcodec_encode_video2(pCodecCtx, &pkt, frame_out, &got_picture)) < 0)
 	{
 		printf("Failed to encode, code: %d, ", ret);
 		err_msg(ret);
 		return -1;
 	}
+	encode.end();
 	if (got_picture == 1)
 	{
 		printf("Succeed to encode frame: %5d\tsize:%5d\n", framecnt, pkt.size);
 		framecnt++;
 		pkt.stream_index = video_st->index;
+		if (pkt.flags & AV_PKT_FLAG_KEY)
+			last_keyframe_ms = duration_cast<std::chrono::milliseconds>(current_time - start_time).count();
+		TraceSpan mux("mux");
+		MemoryScope muxer(memory_owner_, Memory_Muxer);
 		av_write_frame(pFormatCtx, &pkt);
+		mux.end();
 		av_packet_unref(&pkt);
 	}
 
@@ -391,6 +793,13 @@ int RawDataFFMPEGEncoder::ffmpeg_encode()
 
 int RawDataFFMPEGEncoder::ffmpeg_stop()
 {
+	log("********** [%d] Encoded frames: %d, dropped duplicates: %d.\n", instance_id_, framecnt, dropped_framecnt);
+	if (profile_ == VideoProfile_Share && dirty_.frames() > 0)
+	{
+		printf("********** [%d] Share segment dirty area, user: %s, %dx%d, frames: %lld, static: %lld, small updates (<5%%): %lld, average dirty: %.1f%%, max dirty: %.1f%%.\n",
+			   instance_id_, user_->getUserName(), in_width, in_height, (long long)dirty_.frames(), (long long)dirty_.static_frames(),
+			   (long long)dirty_.small_update_frames(), dirty_.average_dirty_ratio() * 100, dirty_.max_dirty_ratio() * 100);
+	}
 
 	// Flush Encoder
 	if ((RawDataFFMPEGEncoder::ffmpeg_flush(pFormatCtx, 0)) < 0)
@@ -406,7 +815,6 @@ int RawDataFFMPEGEncoder::ffmpeg_stop()
 	if (video_st)
 	{
 		avcodec_close(video_st->codec);
-		av_free(frame_out);
 	}
 	avio_close(pFormatCtx->pb);
 	avformat_free_context(pFormatCtx);
@@ -416,11 +824,21 @@ int RawDataFFMPEGEncoder::ffmpeg_stop()
 		fclose(fp_yuv);
 	}
 
-	av_free(buffersink_params);
+	ffmpeg_filter_free();
+	return 0;
+}
 
+void RawDataFFMPEGEncoder::ffmpeg_filter_free()
+{
+	// the frames only point into the buffers below, the SDK's planes or the sink's references.
 	av_frame_free(&frame_in);
+	av_frame_free(&frame_out);
+	av_freep(&frame_buffer_in);
+	av_freep(&frame_buffer_out);
+	av_freep(&buffersink_params);
+	avfilter_inout_free(&inputs);
+	avfilter_inout_free(&outputs);
 	avfilter_graph_free(&filter_graph);
-	return 0;
 }
 
 int RawDataFFMPEGEncoder::ffmpeg_flush(AVFormatContext *fmt_ctx, unsigned int stream_index)
@@ -1,3 +1,4 @@
+#pragma once
 // ffmpeg
 #define __STDC_CONSTANT_MACROS
 extern "C"
@@ -14,36 +15,62 @@ extern "C"
 }
 #include <vector>
 #include <chrono>
+#include <atomic>
+#include <time.h>
 using namespace std::chrono;
 
+#include "frame_fingerprint.h"
+#include "dirty_region_tracker.h"
+#include "frame_rotator.h"
+#include "text_overlay.h"
+
 // Zoom Video SDK
 #include "helpers/zoom_video_sdk_user_helper_interface.h"
 using namespace ZOOMVIDEOSDK;
 
+typedef enum
+{
+	VideoProfile_Camera, // upright, scaled to 640x480 (480x640 for portrait), low latency settings
+	VideoProfile_Share,  // native resolution, screen content settings, variable frame rate
+	VideoProfile_MultiCamera, // an additional camera of a user, camera settings on the user's camera clock
+} VideoProfile;
+
 class RawDataFFMPEGEncoder :
     private IZoomVideoSDKRawDataPipeDelegate
 {
 	virtual void onRawDataFrameReceived(YUVRawDataI420* data);
 	virtual void onRawDataStatusChanged(RawDataStatus status);
-	static RawDataFFMPEGEncoder* find_instance(IZoomVideoSDKUser* user);
+	static RawDataFFMPEGEncoder* find_instance(IZoomVideoSDKUser* user, VideoProfile profile);
+	static RawDataFFMPEGEncoder* find_instance(IZoomVideoSDKRawDataPipe* pipe);
 
 	int instance_id_;
 	static int instance_count;
 	static std::vector<RawDataFFMPEGEncoder*> list_;
+	static std::atomic<int64_t> stats_frames_;
+	static std::atomic<int64_t> stats_us_;
+	static std::atomic<int64_t> stats_max_us_;
 	IZoomVideoSDKUser* user_;
+	IZoomVideoSDKRawDataPipe* pipe_;
+	VideoProfile profile_;
+	int camera_index_ = 0; // multi-camera profile, 1-based position in the user's camera list
+	int share_number_ = 0; // share profile, see start_share_for
+	int memory_owner_ = -1; // what the encoder allocates is accounted to it, see MemoryAccounting
+	void open_memory_owner();
 
 	int ffmpeg_start(const char* userName, const char* userID, int sourceID);
 	int ffmpeg_flush(AVFormatContext* fmt_ctx, unsigned int stream_index);
 	int ffmpeg_stop();
 	int ffmpeg_filter(uint8_t* Y, uint8_t* U, uint8_t* V);
-	int ffmpeg_encode();
+	int ffmpeg_encode(bool force_keyframe);
 	int ffmpeg_filter_init();
+	void ffmpeg_filter_free();
+	void set_camera_output_size();
 
 	// ffmpeg filter
-	AVFrame* frame_in;
-	AVFrame* frame_out;
-	unsigned char* frame_buffer_in;
-	unsigned char* frame_buffer_out;
+	AVFrame* frame_in = nullptr;
+	AVFrame* frame_out = nullptr;
+	unsigned char* frame_buffer_in = nullptr;
+	unsigned char* frame_buffer_out = nullptr;
 	int in_width = 0;
 	int in_height = 0;
 	int out_width = 640;
@@ -51,13 +78,13 @@ class RawDataFFMPEGEncoder :
 
 	AVFilterContext* buffersink_ctx;
 	AVFilterContext* buffersrc_ctx;
-	AVFilterGraph* filter_graph;
+	AVFilterGraph* filter_graph = nullptr;
 	//static int video_stream_index = -1;
 	AVFilter* buffersrc;
 	AVFilter* buffersink;
-	AVFilterInOut* outputs;
-	AVFilterInOut* inputs;
-	AVBufferSinkParams* buffersink_params;
+	AVFilterInOut* outputs = nullptr;
+	AVFilterInOut* inputs = nullptr;
+	AVBufferSinkParams* buffersink_params = nullptr;
 
 	//Output YUV
 	FILE* fp_yuv;
@@ -77,17 +104,55 @@ class RawDataFFMPEGEncoder :
 	int framecnt = 0;
 	int is_ffmpeg_encoding_on = 0;
 	int current_sourceID = -1;
+	int current_turns = 0;
+	bool full_range_ = false; // source is full range I420, see IsLimitedI420()
+	FrameRotator rotator_; // upright copies of rotated camera frames
+	int64_t last_pts = -1;
+
+	// duplicate frame elimination
+	static const int keyframe_interval_ms = 10000;
+	FrameFingerprint fingerprint_;
+	DirtyRegionTracker dirty_; // share profile only
+	int64_t last_keyframe_ms = 0;
+	int dropped_framecnt = 0;
+	// burned in user name and wall clock time
+	TextRun name_run_;
+	TextRun clock_run_;
+	std::atomic<bool> name_changed_;
+	time_t clock_second_ = 0;
+	std::vector<uint8_t> overlay_buffer_; // unscaled frames are copied here before drawing on them
+	void draw_overlay(time_t now);
+
 	// struct _timeb start_tstruct;
+	bool has_start_time_ = false;
 	steady_clock::time_point start_time;
 
 	//Output video file name.
 	char fn_out[120];
 
 public: 
-	RawDataFFMPEGEncoder(IZoomVideoSDKUser* user);
+	RawDataFFMPEGEncoder(IZoomVideoSDKUser* user, VideoProfile profile = VideoProfile_Camera);
+	// an additional camera stream, see onMultiCameraStreamStatusChanged.
+	RawDataFFMPEGEncoder(IZoomVideoSDKUser* user, IZoomVideoSDKRawDataPipe* pipe);
 	~RawDataFFMPEGEncoder();
 	static void stop_encoding_for(IZoomVideoSDKUser* user);
-	static void log(const wchar_t* format, ...);
+	// share recording, timestamps are relative to share_start like the shared audio.
+	// share numbers the shares of the session, every share gets its own files.
+	static void start_share_for(IZoomVideoSDKUser* user, steady_clock::time_point share_start, int share);
+	static void stop_share_for(IZoomVideoSDKUser* user);
+	// additional camera streams are recorded to their own files, like the main camera.
+	static void start_multi_camera_for(IZoomVideoSDKUser* user, IZoomVideoSDKRawDataPipe* pipe);
+	static void stop_multi_camera_for(IZoomVideoSDKRawDataPipe* pipe);
+	// burn the user name and the time into every video, off by default.
+	static bool burn_in;
+	// bit-exact output for golden comparisons: single threaded x264, bit-exact
+	// scaling and muxing. Timestamps are deterministic on MediaClock's virtual time.
+	static bool deterministic;
+	static void on_user_name_changed(IZoomVideoSDKUser* user);
+	// frames handled since the last call and their mean and max handling time, for the bot's status line.
+	static void take_frame_stats(int64_t* frames, double* mean_ms, double* max_ms);
+	static void count_frame(steady_clock::duration took);
+	static void log(const char* format, ...);
 	static void err_msg(int code);
 };
 
@@ -0,0 +1,36 @@
+#include "recording_file.h"
+#include <stdio.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <string.h>
+
+int RecordingFile::create(char *path, size_t size, const char *name, const char *extension)
+{
+	for (int segment = 1; segment <= max_segments; segment++)
+	{
+		int length;
+		if (segment == 1)
+			length = snprintf(path, size, "../%s%s", name, extension);
+		else
+			length = snprintf(path, size, "../%s_%d%s", name, segment, extension);
+		if (length < 0 || (size_t)length >= size)
+		{
+			printf("Recording file name too long: %s%s\n", name, extension);
+			return -1;
+		}
+		int fd = open(path, O_WRONLY | O_CREAT | O_EXCL, 0644);
+		if (fd >= 0)
+		{
+			close(fd);
+			return 0;
+		}
+		if (errno != EEXIST)
+		{
+			printf("Cannot create %s: %s\n", path, strerror(errno));
+			return -1;
+		}
+	}
+	printf("No free recording file name for %s%s\n", name, extension);
+	return -1;
+}
@@ -0,0 +1,16 @@
+#pragma once
+#include <stddef.h>
+
+// Output files of the recorders. A recording never reopens an existing file,
+// avio_open would truncate it: when ../<name><extension> is taken, by an
+// earlier segment of the same stream or by an earlier run, the first free one
+// of ../<name>_2<extension>, _3 and so on is used. The file is created here,
+// so two recorders starting at the same time cannot pick the same path.
+class RecordingFile
+{
+	static const int max_segments = 1000;
+
+public:
+	// path of a new, empty file for name and extension; -1 when none could be created.
+	static int create(char* path, size_t size, const char* name, const char* extension);
+};
@@ -0,0 +1,290 @@
+#include "speaker_view_recorder.h"
+#include "recording_file.h"
+#include "media_clock.h"
+#include "glib.h"
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+
+SpeakerViewRecorder *SpeakerViewRecorder::instance_ = nullptr;
+std::mutex SpeakerViewRecorder::mutex_;
+std::atomic<SpeakerViewRecorder::Feed *> SpeakerViewRecorder::speaker_{nullptr};
+
+SpeakerViewRecorder::Feed::Feed(IZoomVideoSDKUser *user, ZoomVideoSDKResolution resolution)
+{
+	user_ = user;
+	resolution_ = resolution;
+	pipe_ = user_->GetVideoPipe();
+	pipe_->subscribe(resolution_, this);
+}
+
+SpeakerViewRecorder::Feed::~Feed()
+{
+	pipe_->unSubscribe(this);
+}
+
+void SpeakerViewRecorder::Feed::set_resolution(ZoomVideoSDKResolution resolution)
+{
+	if (resolution == resolution_)
+		return;
+	resolution_ = resolution;
+	pipe_->unSubscribe(this);
+	pipe_->subscribe(resolution_, this);
+}
+
+void SpeakerViewRecorder::Feed::onRawDataFrameReceived(YUVRawDataI420 *data)
+{
+	// on virtual time the main loop timer would fire late, frames check the debounce instead.
+	if (MediaClock::is_virtual())
+		check_candidate(nullptr);
+	// other users' frames are only kept flowing so a switch has a picture at once.
+	if (this != speaker_)
+		return;
+	SpeakerViewRecorder *recorder;
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		if (!instance_ || this != speaker_)
+			return;
+		recorder = instance_;
+		// stop waits on it before closing the writer.
+		recorder->encode_mutex_.lock();
+	}
+	recorder->on_frame(data);
+	recorder->encode_mutex_.unlock();
+}
+
+SpeakerViewRecorder::SpeakerViewRecorder(int width, int height)
+{
+	width_ = width;
+	height_ = height;
+}
+
+SpeakerViewRecorder::~SpeakerViewRecorder()
+{
+	for (auto iter = feeds_.begin(); iter != feeds_.end(); iter++)
+		delete *iter;
+	feeds_.clear();
+	sws_freeContext(sws_);
+	if (frame_)
+		av_frame_free(&frame_);
+}
+
+int SpeakerViewRecorder::start(const char *name, int width, int height)
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	if (instance_)
+		return 0;
+
+	SpeakerViewRecorder *recorder = new SpeakerViewRecorder(width, height);
+	recorder->frame_ = FFMPEGVideoWriter::alloc_frame(width, height);
+	// VFR, timestamps are in milliseconds since the start.
+	char fileName[120];
+	if (!recorder->frame_ || RecordingFile::create(fileName, sizeof(fileName), name, ".mkv") < 0 ||
+		recorder->writer_.open(fileName, width, height, AVRational{1, 1000}, "veryfast", "zerolatency", 1500000, 300) < 0)
+	{
+		printf("Failed to start speaker view %s.\n", name);
+		delete recorder;
+		return -1;
+	}
+	printf("Speaker view started: %s, %dx%d.\n", fileName, width, height);
+	recorder->start_time_ = MediaClock::now();
+	instance_ = recorder;
+	return 0;
+}
+
+void SpeakerViewRecorder::stop()
+{
+	SpeakerViewRecorder *recorder;
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		recorder = instance_;
+		instance_ = nullptr;
+		speaker_ = nullptr;
+	}
+	if (!recorder)
+		return;
+	// a frame that got the recorder before it was cleared finishes its encode.
+	recorder->encode_mutex_.lock();
+	recorder->encode_mutex_.unlock();
+	recorder->writer_.close();
+	printf("Speaker view stopped: %d frames, %d speaker switches.\n", recorder->writer_.frame_count(), recorder->switch_count_);
+	delete recorder;
+}
+
+SpeakerViewRecorder::Feed *SpeakerViewRecorder::find_feed(IZoomVideoSDKUser *user)
+{
+	for (auto iter = feeds_.begin(); iter != feeds_.end(); iter++)
+	{
+		if ((*iter)->user_ == user)
+			return *iter;
+	}
+	return nullptr;
+}
+
+// Subscriptions are changed without holding mutex_: unSubscribe may wait for a
+// frame callback that is waiting for the lock.
+void SpeakerViewRecorder::switch_speaker(Feed *from, Feed *to)
+{
+	if (from)
+		from->set_resolution(ZoomVideoSDKResolution_90P);
+	if (to)
+	{
+		to->set_resolution(ZoomVideoSDKResolution_720P);
+		printf("Speaker view switched to %s.\n", to->user_->getUserName());
+	}
+}
+
+void SpeakerViewRecorder::add_user(IZoomVideoSDKUser *user)
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		if (!instance_ || instance_->find_feed(user))
+			return;
+	}
+	Feed *feed = new Feed(user, ZoomVideoSDKResolution_90P);
+	bool first;
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		instance_->feeds_.push_back(feed);
+		// the first user is shown until somebody talks.
+		first = speaker_ == nullptr;
+		if (first)
+		{
+			speaker_ = feed;
+			instance_->cut_pending_ = true;
+		}
+	}
+	if (first)
+		switch_speaker(nullptr, feed);
+}
+
+void SpeakerViewRecorder::remove_user(IZoomVideoSDKUser *user)
+{
+	Feed *feed;
+	Feed *next = nullptr;
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		if (!instance_ || !(feed = instance_->find_feed(user)))
+			return;
+		std::vector<Feed *> &feeds = instance_->feeds_;
+		feeds.erase(std::remove(feeds.begin(), feeds.end(), feed), feeds.end());
+		if (instance_->candidate_ == feed)
+			instance_->candidate_ = nullptr;
+		if (speaker_ == feed)
+		{
+			// hand over to the pending candidate, or to anyone left.
+			next = instance_->candidate_ ? instance_->candidate_ : (feeds.empty() ? nullptr : feeds.front());
+			speaker_ = next;
+			instance_->candidate_ = nullptr;
+			instance_->cut_pending_ = true;
+			instance_->switch_count_++;
+		}
+	}
+	delete feed;
+	switch_speaker(nullptr, next);
+}
+
+void SpeakerViewRecorder::on_active_audio(IVideoSDKVector<IZoomVideoSDKUser *> *list)
+{
+	bool schedule = false;
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		if (!instance_)
+			return;
+		Feed *talking = nullptr;
+		int count = list ? list->GetCount() : 0;
+		for (int index = 0; index < count; index++)
+		{
+			Feed *feed = instance_->find_feed(list->GetItem(index));
+			if (feed == speaker_)
+			{
+				// the speaker still talks, nobody takes over.
+				talking = nullptr;
+				break;
+			}
+			if (feed && !talking)
+				talking = feed;
+		}
+		if (talking != instance_->candidate_)
+		{
+			instance_->candidate_ = talking;
+			instance_->candidate_since_ = MediaClock::now();
+			schedule = talking != nullptr;
+		}
+	}
+	if (schedule && !MediaClock::is_virtual())
+		g_timeout_add(switch_debounce_ms, (GSourceFunc)check_candidate, nullptr);
+}
+
+int SpeakerViewRecorder::check_candidate(void *unused)
+{
+	Feed *from;
+	Feed *to;
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		if (!instance_ || !instance_->candidate_)
+			return FALSE;
+		// a newer candidate has its own timer.
+		if (MediaClock::now() - instance_->candidate_since_ < milliseconds(switch_debounce_ms))
+			return FALSE;
+		from = speaker_;
+		to = instance_->candidate_;
+		speaker_ = to;
+		instance_->candidate_ = nullptr;
+		instance_->cut_pending_ = true;
+		instance_->switch_count_++;
+	}
+	switch_speaker(from, to);
+	return FALSE;
+}
+
+void SpeakerViewRecorder::on_frame(YUVRawDataI420 *data)
+{
+	int width = data->GetStreamWidth();
+	int height = data->GetStreamHeight();
+	if (width <= 0 || height <= 0)
+		return;
+	const uint8_t *Y = reinterpret_cast<const uint8_t *>(data->GetYBuffer());
+	const uint8_t *U = reinterpret_cast<const uint8_t *>(data->GetUBuffer());
+	const uint8_t *V = reinterpret_cast<const uint8_t *>(data->GetVBuffer());
+	const int turns = FrameRotator::quarter_turns(data->GetRotation());
+	if (turns)
+		rotator_.rotate(Y, U, V, width, height, turns, &Y, &U, &V);
+
+	// fit the speaker into the output keeping the aspect ratio.
+	if (width != src_width_ || height != src_height_)
+	{
+		src_width_ = width;
+		src_height_ = height;
+		FFMPEGVideoWriter::clear_frame(frame_);
+	}
+	int draw_w = width_;
+	int draw_h = (int)((int64_t)width_ * height / width);
+	if (draw_h > height_)
+	{
+		draw_h = height_;
+		draw_w = (int)((int64_t)height_ * width / height);
+	}
+	draw_w &= ~1;
+	draw_h &= ~1;
+	const int draw_x = ((width_ - draw_w) / 2) & ~1;
+	const int draw_y = ((height_ - draw_h) / 2) & ~1;
+
+	sws_ = sws_getCachedContext(sws_, width, height, AV_PIX_FMT_YUV420P,
+								draw_w, draw_h, AV_PIX_FMT_YUV420P, SWS_BILINEAR, NULL, NULL, NULL);
+	if (!sws_)
+		return;
+	FFMPEGVideoWriter::set_scaler_range(sws_, !data->IsLimitedI420());
+	const uint8_t *src[4] = {Y, U, V, NULL};
+	const int src_stride[4] = {width, (width + 1) / 2, (width + 1) / 2, 0};
+	uint8_t *dst[4] = {
+		frame_->data[0] + draw_y * frame_->linesize[0] + draw_x,
+		frame_->data[1] + (draw_y / 2) * frame_->linesize[1] + draw_x / 2,
+		frame_->data[2] + (draw_y / 2) * frame_->linesize[2] + draw_x / 2,
+		NULL};
+	sws_scale(sws_, src, src_stride, 0, height, dst, frame_->linesize);
+
+	frame_->pts = duration_cast<milliseconds>(MediaClock::now() - start_time_).count();
+	// every cut starts with a keyframe.
+	writer_.write(frame_, cut_pending_.exchange(false));
+}
@@ -0,0 +1,91 @@
+#pragma once
+// ffmpeg
+#define __STDC_CONSTANT_MACROS
+extern "C"
+{
+#include "libavutil/avutil.h"
+#include "libswscale/swscale.h"
+}
+#include <vector>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+using namespace std::chrono;
+
+// Zoom Video SDK
+#include "zoom_sdk_raw_data_def.h"
+#include "helpers/zoom_video_sdk_user_helper_interface.h"
+using namespace ZOOMVIDEOSDK;
+
+#include "ffmpeg_video_writer.h"
+#include "frame_rotator.h"
+
+// Records the session as a single speaker view: one encoder fed with the camera
+// of whoever is talking. Active audio events pick the speaker; a new speaker
+// takes over only after being active for switch_debounce_ms, so short
+// interjections do not cut the picture.
+// Only the speaker is received at full resolution, everyone else is kept at
+// 90P so there is a picture to cut to while the switch is upgraded.
+class SpeakerViewRecorder
+{
+	class Feed : private IZoomVideoSDKRawDataPipeDelegate
+	{
+	public:
+		IZoomVideoSDKUser* user_;
+		IZoomVideoSDKRawDataPipe* pipe_;
+		ZoomVideoSDKResolution resolution_;
+
+		Feed(IZoomVideoSDKUser* user, ZoomVideoSDKResolution resolution);
+		~Feed();
+		void set_resolution(ZoomVideoSDKResolution resolution);
+
+	private:
+		virtual void onRawDataFrameReceived(YUVRawDataI420* data);
+		virtual void onRawDataStatusChanged(RawDataStatus status) {}
+	};
+
+	static const int switch_debounce_ms = 1500;
+
+	static SpeakerViewRecorder* instance_;
+	// guards instance_, the feeds and the speaker choice; never held while encoding.
+	static std::mutex mutex_;
+	// written under mutex_, read without it so other feeds drop their frames unlocked.
+	static std::atomic<Feed*> speaker_;
+
+	int width_;
+	int height_;
+	std::vector<Feed*> feeds_;
+	Feed* candidate_ = nullptr; // talking, not the speaker yet
+	steady_clock::time_point candidate_since_;
+	int switch_count_ = 0;
+
+	// taken under mutex_ by the speaker's frame, held while it is encoded.
+	std::mutex encode_mutex_;
+	FFMPEGVideoWriter writer_;
+	AVFrame* frame_ = nullptr;
+	SwsContext* sws_ = nullptr;
+	FrameRotator rotator_;
+	int src_width_ = 0;
+	int src_height_ = 0;
+	std::atomic<bool> cut_pending_{false};
+	steady_clock::time_point start_time_;
+	int dropped_framecnt_ = 0;
+
+	SpeakerViewRecorder(int width, int height);
+	~SpeakerViewRecorder();
+	Feed* find_feed(IZoomVideoSDKUser* user);
+	void on_frame(YUVRawDataI420* data);
+	// called on the main loop once a candidate may have passed the debounce window.
+	static int check_candidate(void* unused);
+	static void switch_speaker(Feed* from, Feed* to);
+
+public:
+	// writes ../<name>.mkv, or the first free _2, _3 ... of it.
+	static int start(const char* name, int width, int height);
+	static void stop();
+
+	static void add_user(IZoomVideoSDKUser* user);
+	static void remove_user(IZoomVideoSDKUser* user);
+	// users currently producing audio, from onUserActiveAudioChanged.
+	static void on_active_audio(IVideoSDKVector<IZoomVideoSDKUser*>* list);
+};
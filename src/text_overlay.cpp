@@ -0,0 +1,245 @@
+#include "text_overlay.h"
+#include <string.h>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+// 5x7 glyphs for ' ' to '~', one byte per row, bit 4 is the leftmost pixel.
+static const uint8_t font_5x7[95][7] = {
+	{0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00}, // space
+	{0x04, 0x04, 0x04, 0x04, 0x04, 0x00, 0x04}, // !
+	{0x0A, 0x0A, 0x0A, 0x00, 0x00, 0x00, 0x00}, // "
+	{0x0A, 0x0A, 0x1F, 0x0A, 0x1F, 0x0A, 0x0A}, // #
+	{0x04, 0x0F, 0x14, 0x0E, 0x05, 0x1E, 0x04}, // $
+	{0x18, 0x19, 0x02, 0x04, 0x08, 0x13, 0x03}, // %
+	{0x0C, 0x12, 0x14, 0x08, 0x15, 0x12, 0x0D}, // &
+	{0x04, 0x04, 0x08, 0x00, 0x00, 0x00, 0x00}, // '
+	{0x02, 0x04, 0x08, 0x08, 0x08, 0x04, 0x02}, // (
+	{0x08, 0x04, 0x02, 0x02, 0x02, 0x04, 0x08}, // )
+	{0x00, 0x04, 0x15, 0x0E, 0x15, 0x04, 0x00}, // *
+	{0x00, 0x04, 0x04, 0x1F, 0x04, 0x04, 0x00}, // +
+	{0x00, 0x00, 0x00, 0x00, 0x0C, 0x04, 0x08}, // ,
+	{0x00, 0x00, 0x00, 0x1F, 0x00, 0x00, 0x00}, // -
+	{0x00, 0x00, 0x00, 0x00, 0x00, 0x0C, 0x0C}, // .
+	{0x00, 0x01, 0x02, 0x04, 0x08, 0x10, 0x00}, // /
+	{0x0E, 0x11, 0x13, 0x15, 0x19, 0x11, 0x0E}, // 0
+	{0x04, 0x0C, 0x04, 0x04, 0x04, 0x04, 0x0E}, // 1
+	{0x0E, 0x11, 0x01, 0x02, 0x04, 0x08, 0x1F}, // 2
+	{0x1F, 0x02, 0x04, 0x02, 0x01, 0x11, 0x0E}, // 3
+	{0x02, 0x06, 0x0A, 0x12, 0x1F, 0x02, 0x02}, // 4
+	{0x1F, 0x10, 0x1E, 0x01, 0x01, 0x11, 0x0E}, // 5
+	{0x06, 0x08, 0x10, 0x1E, 0x11, 0x11, 0x0E}, // 6
+	{0x1F, 0x01, 0x02, 0x04, 0x08, 0x08, 0x08}, // 7
+	{0x0E, 0x11, 0x11, 0x0E, 0x11, 0x11, 0x0E}, // 8
+	{0x0E, 0x11, 0x11, 0x0F, 0x01, 0x02, 0x0C}, // 9
+	{0x00, 0x0C, 0x0C, 0x00, 0x0C, 0x0C, 0x00}, // :
+	{0x00, 0x0C, 0x0C, 0x00, 0x0C, 0x04, 0x08}, // ;
+	{0x02, 0x04, 0x08, 0x10, 0x08, 0x04, 0x02}, // <
+	{0x00, 0x00, 0x1F, 0x00, 0x1F, 0x00, 0x00}, // =
+	{0x08, 0x04, 0x02, 0x01, 0x02, 0x04, 0x08}, // >
+	{0x0E, 0x11, 0x01, 0x02, 0x04, 0x00, 0x04}, // ?
+	{0x0E, 0x11, 0x01, 0x0D, 0x15, 0x15, 0x0E}, // @
+	{0x0E, 0x11, 0x11, 0x1F, 0x11, 0x11, 0x11}, // A
+	{0x1E, 0x11, 0x11, 0x1E, 0x11, 0x11, 0x1E}, // B
+	{0x0E, 0x11, 0x10, 0x10, 0x10, 0x11, 0x0E}, // C
+	{0x1C, 0x12, 0x11, 0x11, 0x11, 0x12, 0x1C}, // D
+	{0x1F, 0x10, 0x10, 0x1E, 0x10, 0x10, 0x1F}, // E
+	{0x1F, 0x10, 0x10, 0x1E, 0x10, 0x10, 0x10}, // F
+	{0x0E, 0x11, 0x10, 0x17, 0x11, 0x11, 0x0F}, // G
+	{0x11, 0x11, 0x11, 0x1F, 0x11, 0x11, 0x11}, // H
+	{0x0E, 0x04, 0x04, 0x04, 0x04, 0x04, 0x0E}, // I
+	{0x07, 0x02, 0x02, 0x02, 0x02, 0x12, 0x0C}, // J
+	{0x11, 0x12, 0x14, 0x18, 0x14, 0x12, 0x11}, // K
+	{0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x1F}, // L
+	{0x11, 0x1B, 0x15, 0x15, 0x11, 0x11, 0x11}, // M
+	{0x11, 0x11, 0x19, 0x15, 0x13, 0x11, 0x11}, // N
+	{0x0E, 0x11, 0x11, 0x11, 0x11, 0x11, 0x0E}, // O
+	{0x1E, 0x11, 0x11, 0x1E, 0x10, 0x10, 0x10}, // P
+	{0x0E, 0x11, 0x11, 0x11, 0x15, 0x12, 0x0D}, // Q
+	{0x1E, 0x11, 0x11, 0x1E, 0x14, 0x12, 0x11}, // R
+	{0x0F, 0x10, 0x10, 0x0E, 0x01, 0x01, 0x1E}, // S
+	{0x1F, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04}, // T
+	{0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x0E}, // U
+	{0x11, 0x11, 0x11, 0x11, 0x11, 0x0A, 0x04}, // V
+	{0x11, 0x11, 0x11, 0x15, 0x15, 0x15, 0x0A}, // W
+	{0x11, 0x11, 0x0A, 0x04, 0x0A, 0x11, 0x11}, // X
+	{0x11, 0x11, 0x0A, 0x04, 0x04, 0x04, 0x04}, // Y
+	{0x1F, 0x01, 0x02, 0x04, 0x08, 0x10, 0x1F}, // Z
+	{0x0E, 0x08, 0x08, 0x08, 0x08, 0x08, 0x0E}, // [
+	{0x00, 0x10, 0x08, 0x04, 0x02, 0x01, 0x00}, // backslash
+	{0x0E, 0x02, 0x02, 0x02, 0x02, 0x02, 0x0E}, // ]
+	{0x04, 0x0A, 0x11, 0x00, 0x00, 0x00, 0x00}, // ^
+	{0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x1F}, // _
+	{0x08, 0x04, 0x02, 0x00, 0x00, 0x00, 0x00}, // `
+	{0x00, 0x00, 0x0E, 0x01, 0x0F, 0x11, 0x0F}, // a
+	{0x10, 0x10, 0x16, 0x19, 0x11, 0x11, 0x1E}, // b
+	{0x00, 0x00, 0x0E, 0x10, 0x10, 0x11, 0x0E}, // c
+	{0x01, 0x01, 0x0D, 0x13, 0x11, 0x11, 0x0F}, // d
+	{0x00, 0x00, 0x0E, 0x11, 0x1F, 0x10, 0x0E}, // e
+	{0x06, 0x09, 0x08, 0x1C, 0x08, 0x08, 0x08}, // f
+	{0x00, 0x0F, 0x11, 0x11, 0x0F, 0x01, 0x0E}, // g
+	{0x10, 0x10, 0x16, 0x19, 0x11, 0x11, 0x11}, // h
+	{0x04, 0x00, 0x0C, 0x04, 0x04, 0x04, 0x0E}, // i
+	{0x02, 0x00, 0x06, 0x02, 0x02, 0x12, 0x0C}, // j
+	{0x10, 0x10, 0x12, 0x14, 0x18, 0x14, 0x12}, // k
+	{0x0C, 0x04, 0x04, 0x04, 0x04, 0x04, 0x0E}, // l
+	{0x00, 0x00, 0x1A, 0x15, 0x15, 0x11, 0x11}, // m
+	{0x00, 0x00, 0x16, 0x19, 0x11, 0x11, 0x11}, // n
+	{0x00, 0x00, 0x0E, 0x11, 0x11, 0x11, 0x0E}, // o
+	{0x00, 0x00, 0x1E, 0x11, 0x1E, 0x10, 0x10}, // p
+	{0x00, 0x00, 0x0D, 0x13, 0x0F, 0x01, 0x01}, // q
+	{0x00, 0x00, 0x16, 0x19, 0x10, 0x10, 0x10}, // r
+	{0x00, 0x00, 0x0E, 0x10, 0x0E, 0x01, 0x1E}, // s
+	{0x08, 0x08, 0x1C, 0x08, 0x08, 0x09, 0x06}, // t
+	{0x00, 0x00, 0x11, 0x11, 0x11, 0x13, 0x0D}, // u
+	{0x00, 0x00, 0x11, 0x11, 0x11, 0x0A, 0x04}, // v
+	{0x00, 0x00, 0x11, 0x11, 0x15, 0x15, 0x0A}, // w
+	{0x00, 0x00, 0x11, 0x0A, 0x04, 0x0A, 0x11}, // x
+	{0x00, 0x00, 0x11, 0x11, 0x0F, 0x01, 0x0E}, // y
+	{0x00, 0x00, 0x1F, 0x02, 0x04, 0x08, 0x1F}, // z
+	{0x02, 0x04, 0x04, 0x08, 0x04, 0x04, 0x02}, // {
+	{0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04}, // |
+	{0x08, 0x04, 0x04, 0x02, 0x04, 0x04, 0x08}, // }
+	{0x00, 0x00, 0x08, 0x15, 0x02, 0x00, 0x00}, // ~
+
+};
+
+static const int glyph_width = 5;
+static const int glyph_height = 7;
+// text is white on a box that darkens the picture behind it.
+static const uint8_t text_luma = 235;
+static const uint8_t box_luma = 16;
+static const uint8_t box_alpha = 144;
+
+std::map<int, GlyphAtlas *> GlyphAtlas::atlases_;
+std::mutex GlyphAtlas::atlases_mutex_;
+
+GlyphAtlas::GlyphAtlas(int scale)
+	: scale(scale), cell_width((glyph_width + 1) * scale), cell_height((glyph_height + 2) * scale)
+{
+	const int cell_size = cell_width * cell_height;
+	alpha_.assign(95 * cell_size, 0);
+	for (int c = 0; c < 95; c++)
+	{
+		uint8_t *cell = alpha_.data() + c * cell_size;
+		for (int row = 0; row < glyph_height; row++)
+		{
+			for (int col = 0; col < glyph_width; col++)
+			{
+				if (!(font_5x7[c][row] & (0x10 >> col)))
+					continue;
+				// one row of padding above, one column of spacing on the right.
+				for (int dy = 0; dy < scale; dy++)
+					memset(cell + ((row + 1) * scale + dy) * cell_width + col * scale, 255, scale);
+			}
+		}
+	}
+}
+
+const GlyphAtlas &GlyphAtlas::get(int scale)
+{
+	std::lock_guard<std::mutex> lock(atlases_mutex_);
+	GlyphAtlas *&atlas = atlases_[scale];
+	if (!atlas)
+		atlas = new GlyphAtlas(scale);
+	return *atlas;
+}
+
+const uint8_t *GlyphAtlas::cell(unsigned char ch) const
+{
+	if (ch < 32 || ch > 126)
+		ch = '?';
+	return alpha_.data() + (ch - 32) * cell_width * cell_height;
+}
+
+bool TextRun::set_text(const std::string &text, int scale)
+{
+	if (text == text_ && scale == scale_ && width_ > 0)
+		return false;
+	text_ = text;
+	scale_ = scale;
+
+	const GlyphAtlas &atlas = GlyphAtlas::get(scale);
+	const int pad = 2 * scale;
+	// even, so the run covers whole chroma samples.
+	width_ = (int)(text.size() * atlas.cell_width + pad * 2 + 1) & ~1;
+	height_ = (atlas.cell_height + 1) & ~1;
+	luma_.assign(width_ * height_, box_luma);
+	alpha_.assign(width_ * height_, box_alpha);
+
+	for (size_t i = 0; i < text.size(); i++)
+	{
+		const uint8_t *cell = atlas.cell((unsigned char)text[i]);
+		const int x0 = pad + (int)i * atlas.cell_width;
+		for (int row = 0; row < atlas.cell_height && row < height_; row++)
+		{
+			for (int col = 0; col < atlas.cell_width; col++)
+			{
+				if (cell[row * atlas.cell_width + col])
+				{
+					luma_[row * width_ + x0 + col] = text_luma;
+					alpha_[row * width_ + x0 + col] = 255;
+				}
+			}
+		}
+	}
+
+	// chroma only fades towards grey, with the average alpha of each 2x2 block.
+	chroma_alpha_.resize((width_ / 2) * (height_ / 2));
+	for (int row = 0; row < height_ / 2; row++)
+	{
+		for (int col = 0; col < width_ / 2; col++)
+		{
+			const uint8_t *a = alpha_.data() + (row * 2) * width_ + col * 2;
+			chroma_alpha_[row * (width_ / 2) + col] = (uint8_t)((a[0] + a[1] + a[width_] + a[width_ + 1] + 2) / 4);
+		}
+	}
+	return true;
+}
+
+// dst = (dst * (256 - a') + src * a') >> 8 with a' = a + (a >> 7), so 255 is opaque.
+static void blend_row(uint8_t *dst, const uint8_t *src, uint8_t src_value, const uint8_t *alpha, int count)
+{
+	int i = 0;
+#if defined(__SSE2__)
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i full = _mm_set1_epi16(256);
+	const __m128i value = _mm_set1_epi16(src_value);
+	for (; i + 8 <= count; i += 8)
+	{
+		__m128i d = _mm_unpacklo_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i *>(dst + i)), zero);
+		__m128i a = _mm_unpacklo_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i *>(alpha + i)), zero);
+		__m128i s = src ? _mm_unpacklo_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i *>(src + i)), zero) : value;
+		a = _mm_add_epi16(a, _mm_srli_epi16(a, 7));
+		// both products stay below 65536, and so does their sum.
+		__m128i sum = _mm_add_epi16(_mm_mullo_epi16(d, _mm_sub_epi16(full, a)), _mm_mullo_epi16(s, a));
+		_mm_storel_epi64(reinterpret_cast<__m128i *>(dst + i), _mm_packus_epi16(_mm_srli_epi16(sum, 8), zero));
+	}
+#endif
+	for (; i < count; i++)
+	{
+		const int a = alpha[i] + (alpha[i] >> 7);
+		const int s = src ? src[i] : src_value;
+		dst[i] = (uint8_t)((dst[i] * (256 - a) + s * a) >> 8);
+	}
+}
+
+void TextRun::blend(uint8_t *Y, uint8_t *U, uint8_t *V, int y_stride, int uv_stride,
+					int frame_width, int frame_height, int x, int y) const
+{
+	x &= ~1;
+	y &= ~1;
+	if (width_ == 0 || x < 0 || y < 0 || x >= frame_width || y >= frame_height)
+		return;
+	const int w = (x + width_ <= frame_width ? width_ : frame_width - x) & ~1;
+	const int h = (y + height_ <= frame_height ? height_ : frame_height - y) & ~1;
+
+	for (int row = 0; row < h; row++)
+		blend_row(Y + (y + row) * y_stride + x, luma_.data() + row * width_, 0, alpha_.data() + row * width_, w);
+	for (int row = 0; row < h / 2; row++)
+	{
+		const uint8_t *a = chroma_alpha_.data() + row * (width_ / 2);
+		blend_row(U + (y / 2 + row) * uv_stride + x / 2, NULL, 128, a, w / 2);
+		blend_row(V + (y / 2 + row) * uv_stride + x / 2, NULL, 128, a, w / 2);
+	}
+}
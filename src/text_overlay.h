@@ -0,0 +1,52 @@
+#pragma once
+#include <stdint.h>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Glyphs of the built-in 5x7 font, rendered once per scale into cells of
+// luma and alpha. Characters outside printable ASCII are drawn as '?'.
+class GlyphAtlas
+{
+	static std::map<int, GlyphAtlas*> atlases_;
+	static std::mutex atlases_mutex_;
+
+	std::vector<uint8_t> alpha_; // 95 cells, one after another
+
+	explicit GlyphAtlas(int scale);
+
+public:
+	const int scale;
+	const int cell_width;
+	const int cell_height;
+
+	// never freed, shared by every overlay of that size.
+	static const GlyphAtlas& get(int scale);
+	const uint8_t* cell(unsigned char ch) const;
+};
+
+// A line of text rasterized from the atlas on a dark box, kept until the text
+// changes and alpha-blended into I420 frames with SSE2.
+class TextRun
+{
+	std::string text_;
+	int scale_ = 0;
+	int width_ = 0;
+	int height_ = 0;
+	std::vector<uint8_t> luma_;
+	std::vector<uint8_t> alpha_;
+	std::vector<uint8_t> chroma_alpha_; // alpha at 4:2:0
+
+public:
+	// re-rasterizes only when text or scale differ from the current run.
+	// returns true when it did.
+	bool set_text(const std::string& text, int scale);
+	const std::string& text() const { return text_; }
+	int width() const { return width_; }
+	int height() const { return height_; }
+
+	// blend at (x, y) into planes of a frame_width x frame_height I420 frame, clipped to the frame.
+	void blend(uint8_t* Y, uint8_t* U, uint8_t* V, int y_stride, int uv_stride,
+			   int frame_width, int frame_height, int x, int y) const;
+};
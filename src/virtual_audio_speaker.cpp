@@ -0,0 +1,17 @@
+#include "virtual_audio_speaker.h"
+#include "raw_audio_ffmpeg_encoder.h"
+
+void VirtualAudioSpeaker::onVirtualSpeakerMixedAudioReceived(AudioRawData *data_)
+{
+	RawAudioFFMPEGEncoder::on_mixed_audio_received(data_);
+}
+
+void VirtualAudioSpeaker::onVirtualSpeakerOneWayAudioReceived(AudioRawData *data_, IZoomVideoSDKUser *pUser)
+{
+	RawAudioFFMPEGEncoder::on_audio_received(data_, pUser);
+}
+
+void VirtualAudioSpeaker::onVirtualSpeakerSharedAudioReceived(AudioRawData *data_)
+{
+	RawAudioFFMPEGEncoder::on_share_audio_received(data_);
+}
@@ -0,0 +1,17 @@
+#pragma once
+// Zoom Video SDK
+#include "zoom_sdk_raw_data_def.h"
+#include "helpers/zoom_video_sdk_audio_send_rawdata_interface.h"
+using namespace ZOOMVIDEOSDK;
+
+// Virtual speaker handed to the SDK in ZoomVideoSDKSessionContext. The SDK
+// delivers session audio here instead of decoding it to a playback device, so
+// the bot needs no PulseAudio/ALSA and every buffer goes straight to the
+// audio recording queue.
+class VirtualAudioSpeaker : public IZoomVideoSDKVirtualAudioSpeaker
+{
+public:
+	virtual void onVirtualSpeakerMixedAudioReceived(AudioRawData* data_);
+	virtual void onVirtualSpeakerOneWayAudioReceived(AudioRawData* data_, IZoomVideoSDKUser* pUser);
+	virtual void onVirtualSpeakerSharedAudioReceived(AudioRawData* data_);
+};
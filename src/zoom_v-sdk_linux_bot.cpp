@@ -11,16 +11,45 @@
 #include "glib.h"
 #include "json.hpp"
 #include "helpers/zoom_video_sdk_user_helper_interface.h"
+#include "helpers/zoom_video_sdk_audio_helper_interface.h"
 #include "zoom_video_sdk_api.h"
 #include "zoom_video_sdk_def.h"
 #include "zoom_video_sdk_delegate_interface.h"
 #include "zoom_video_sdk_interface.h"
+#include "zoom_video_sdk_session_info_interface.h"
 #include "raw_data_ffmpeg_encoder.h"
+#include "raw_audio_ffmpeg_encoder.h"
+#include "virtual_audio_speaker.h"
+#include "gallery_compositor.h"
+#include "speaker_view_recorder.h"
+#include "pip_compositor.h"
+#include "frame_capture.h"
+#include "frame_trace.h"
+#include "memory_accounting.h"
+#include "media_clock.h"
+#include "audio_ingest_queue.h"
 
 using Json = nlohmann::json;
 USING_ZOOM_VIDEO_SDK_NAMESPACE
 IZoomVideoSDK *video_sdk_obj;
 GMainLoop *loop;
+// receive session audio through a virtual speaker instead of the system audio device.
+bool use_virtual_speaker = true;
+bool use_gallery_view = false;
+bool use_speaker_view = false;
+bool use_pip = false;
+// write every frame of the per-user videos and the user events to ../capture.zvc for zoom_v-sdk_replay.
+bool use_capture = false;
+// trace one video frame in trace_sample to ../trace.json, 0 is off. kill -USR1 writes the trace so far.
+int trace_sample = 0;
+// print process and per-user heap use every memory_report seconds, 0 is off. Per user needs -DMEMORY_ACCOUNTING=ON.
+int memory_report = 0;
+// print a status line every status_interval seconds for zoom_v-sdk_soak, 0 is off.
+int status_interval = 0;
+steady_clock::time_point session_start;
+gboolean status_callback(gpointer data);
+// shares are numbered in the session, a user sharing again does not reuse the names of the last share.
+int share_count = 0;
 
 std::string getSelfDirPath()
 {
@@ -44,14 +73,45 @@ public:
     virtual void onSessionJoin()
     {
         printf("Joined session successfully\n");
+        // without the virtual speaker, audio raw data is only delivered to this delegate after subscribing.
+        IZoomVideoSDKAudioHelper *audio_helper = video_sdk_obj->getAudioHelper();
+        if (audio_helper && !use_virtual_speaker)
+            audio_helper->subscribe();
+
+        // users already in the session; onUserJoin adds the ones reported later.
+        IVideoSDKVector<IZoomVideoSDKUser *> *users = video_sdk_obj->getSessionInfo()->getRemoteUsers();
+        if (use_speaker_view)
+        {
+            if (SpeakerViewRecorder::start("speaker_view", 1280, 720) == 0)
+            {
+                for (int index = 0; users && index < users->GetCount(); index++)
+                    SpeakerViewRecorder::add_user(users->GetItem(index));
+            }
+        }
+        else if (use_gallery_view && GalleryCompositor::start("gallery_view", 1280, 720, 15) == 0)
+        {
+            for (int index = 0; users && index < users->GetCount(); index++)
+                GalleryCompositor::add_user(users->GetItem(index));
+        }
     };
 
     /// \brief Triggered when session leaveSession
     virtual void onSessionLeave()
     {
+        // the last status line tells zoom_v-sdk_soak how far the session got.
+        if (status_interval > 0)
+            status_callback(NULL);
+        RawAudioFFMPEGEncoder::stop_all();
+        GalleryCompositor::stop();
+        SpeakerViewRecorder::stop();
+        PipCompositor::stop_all();
+        FrameCapture::stop();
+        FrameTrace::stop();
+        MemoryAccounting::stop_reports();
         g_main_loop_unref(loop);
         printf("Already left session.\n");
-        exit(1);
+        // leaving is how the bot ends, a crash or a failed join exits otherwise.
+        exit(0);
     };
 
     /// \brief Triggered when session error.
@@ -75,7 +135,29 @@ public:
                 IZoomVideoSDKUser *user = userList->GetItem(index);
                 if (user)
                 {
-                    RawDataFFMPEGEncoder *encoder = new RawDataFFMPEGEncoder(user);
+                    FrameCapture::on_user_event(Record_Join, user);
+                    RawAudioFFMPEGEncoder::start_encoding_for(user);
+                    // the bot itself has no camera, it is not shown in the composed views.
+                    bool is_myself = user == video_sdk_obj->getSessionInfo()->getMyself();
+                    if (use_speaker_view)
+                    {
+                        // one encoder for everyone instead of one per camera.
+                        if (!is_myself)
+                            SpeakerViewRecorder::add_user(user);
+                    }
+                    else
+                    {
+                        RawDataFFMPEGEncoder *encoder = new RawDataFFMPEGEncoder(user);
+                        if (!is_myself)
+                            GalleryCompositor::add_user(user);
+                        // cameras the user already added, later ones arrive with onMultiCameraStreamStatusChanged.
+                        IVideoSDKVector<IZoomVideoSDKRawDataPipe *> *cameras = user->getMultiCameraStreamList();
+                        for (int camera = 0; cameras && camera < cameras->GetCount(); camera++)
+                        {
+                            FrameCapture::on_camera_event(Record_CameraJoin, user, cameras->GetItem(camera));
+                            RawDataFFMPEGEncoder::start_multi_camera_for(user, cameras->GetItem(camera));
+                        }
+                    }
                 }
             }
         }
@@ -94,7 +176,12 @@ public:
                 IZoomVideoSDKUser *user = userList->GetItem(index);
                 if (user)
                 {
+                    FrameCapture::on_user_event(Record_Leave, user);
+                    GalleryCompositor::remove_user(user);
+                    SpeakerViewRecorder::remove_user(user);
+                    PipCompositor::remove_user(user);
                     RawDataFFMPEGEncoder::stop_encoding_for(user);
+                    RawAudioFFMPEGEncoder::stop_encoding_for(user);
                 }
             }
         }
@@ -140,7 +227,13 @@ public:
     /// \param pAudioHelper is the pointer to audio helper object, see \link IZoomVideoSDKAudioHelper \endlink.
     /// \param list is the pointer to user object list.
     virtual void onUserActiveAudioChanged(IZoomVideoSDKAudioHelper *pAudioHelper,
-                                          IVideoSDKVector<IZoomVideoSDKUser *> *list){};
+                                          IVideoSDKVector<IZoomVideoSDKUser *> *list)
+    {
+        if (use_speaker_view)
+            SpeakerViewRecorder::on_active_audio(list);
+        else if (use_pip)
+            PipCompositor::on_active_audio(list);
+    };
 
     /// \brief Triggered when session needs password.
     /// \param handler is the pointer to password handler object, see \link IZoomVideoSDKPasswordHandler \endlink.
@@ -152,16 +245,28 @@ public:
 
     /// \brief Triggered when mixed audio raw data received.
     /// \param data_ is the pointer to audio raw data, see \link AudioRawData \endlink.
-    virtual void onMixedAudioRawDataReceived(AudioRawData *data_){};
+    virtual void onMixedAudioRawDataReceived(AudioRawData *data_)
+    {
+        if (!use_virtual_speaker)
+            RawAudioFFMPEGEncoder::on_mixed_audio_received(data_);
+    };
 
     /// \brief Triggered when one way audio raw data received.
     /// \param data_ is the pointer to audio raw data, see \link AudioRawData \endlink.
     /// \param pUser is the pointer to user object, see \link IZoomVideoSDKUser \endlink.
-    virtual void onOneWayAudioRawDataReceived(AudioRawData *data_, IZoomVideoSDKUser *pUser){};
+    virtual void onOneWayAudioRawDataReceived(AudioRawData *data_, IZoomVideoSDKUser *pUser)
+    {
+        if (!use_virtual_speaker)
+            RawAudioFFMPEGEncoder::on_audio_received(data_, pUser);
+    };
 
     /// \brief Triggered when share audio data received.
     /// \param data_ is the pointer to audio raw data, see \link AudioRawData \endlink.
-    virtual void onSharedAudioRawDataReceived(AudioRawData *data_){};
+    virtual void onSharedAudioRawDataReceived(AudioRawData *data_)
+    {
+        if (!use_virtual_speaker)
+            RawAudioFFMPEGEncoder::on_share_audio_received(data_);
+    };
 
     /// \brief Triggered when user get session manager role.
     /// \param pUser is the pointer to user object, see \link IZoomVideoSDKUser \endlink.
@@ -169,7 +274,14 @@ public:
 
     /// \brief Triggered when user name changed.
     /// \param pUser is the pointer to user object, see \link IZoomVideoSDKUser \endlink.
-    virtual void onUserNameChanged(IZoomVideoSDKUser *pUser){};
+    virtual void onUserNameChanged(IZoomVideoSDKUser *pUser)
+    {
+        if (pUser)
+        {
+            FrameCapture::on_user_event(Record_NameChanged, pUser);
+            RawDataFFMPEGEncoder::on_user_name_changed(pUser);
+        }
+    };
 
     /// \brief Callback for when the current user is granted camera control access.
     /// Once the current user sends the camera control request, this callback will be triggered with the result of the
@@ -211,9 +323,64 @@ public:
     /// \brief Triggered when host ask you to unmute.
     virtual void onHostAskUnmute(){};
 
-    virtual void onUserShareStatusChanged(IZoomVideoSDKShareHelper *pShareHelper, IZoomVideoSDKUser *pUser, ZoomVideoSDKShareStatus status, ZoomVideoSDKShareType type) {}
+    virtual void onUserShareStatusChanged(IZoomVideoSDKShareHelper *pShareHelper, IZoomVideoSDKUser *pUser, ZoomVideoSDKShareStatus status, ZoomVideoSDKShareType type)
+    {
+        if (!pUser || !pUser->GetSharePipe())
+            return;
+        // every share type has a share audio encoder, a resume with one continues the same files.
+        // a resume without one is a share that was paused before the bot joined.
+        if (status == ZoomVideoSDKShareStatus_Resume && RawAudioFFMPEGEncoder::has_share_audio_for(pUser))
+        {
+            printf("share resumed, user: %s\n", pUser->getUserName());
+        }
+        else if (status == ZoomVideoSDKShareStatus_Start || status == ZoomVideoSDKShareStatus_Resume)
+        {
+            // the share start is the clock origin of everything recorded from this share.
+            steady_clock::time_point share_start = MediaClock::now();
+            int share = ++share_count;
+            if (type != ZoomVideoSDKShareType_PureAudio)
+                FrameCapture::on_user_event(Record_ShareStart, pUser);
+            // picture in picture needs the camera encoders, the speaker view has none.
+            if (type != ZoomVideoSDKShareType_PureAudio && use_pip && !use_speaker_view)
+                PipCompositor::start_for(pUser, share_start, share);
+            else if (type != ZoomVideoSDKShareType_PureAudio)
+                RawDataFFMPEGEncoder::start_share_for(pUser, share_start, share);
+            RawAudioFFMPEGEncoder::start_share_audio_for(pUser, share_start, share);
+            if (!use_virtual_speaker)
+                pUser->GetSharePipe()->subscribeToSharedComputerAudio();
+        }
+        else if (status == ZoomVideoSDKShareStatus_Pause)
+        {
+            // no frames arrive while paused, the encoders and the subscription stay for the resume.
+            printf("share paused, user: %s\n", pUser->getUserName());
+        }
+        else if (status == ZoomVideoSDKShareStatus_Stop)
+        {
+            if (!use_virtual_speaker)
+                pUser->GetSharePipe()->unsubscribeToSharedComputerAudio();
+            FrameCapture::on_user_event(Record_ShareStop, pUser);
+            RawDataFFMPEGEncoder::stop_share_for(pUser);
+            PipCompositor::stop_for(pUser);
+            RawAudioFFMPEGEncoder::stop_share_audio_for(pUser);
+        }
+    }
 
-    virtual void onMultiCameraStreamStatusChanged(ZoomVideoSDKMultiCameraStreamStatus status, IZoomVideoSDKUser *pUser, IZoomVideoSDKRawDataPipe *pVideoPipe) {}
+    virtual void onMultiCameraStreamStatusChanged(ZoomVideoSDKMultiCameraStreamStatus status, IZoomVideoSDKUser *pUser, IZoomVideoSDKRawDataPipe *pVideoPipe)
+    {
+        // the speaker view records main cameras only.
+        if (use_speaker_view || !pUser || !pVideoPipe)
+            return;
+        if (status == ZoomVideoSDKMultiCameraStreamStatus_Joined)
+        {
+            FrameCapture::on_camera_event(Record_CameraJoin, pUser, pVideoPipe);
+            RawDataFFMPEGEncoder::start_multi_camera_for(pUser, pVideoPipe);
+        }
+        else if (status == ZoomVideoSDKMultiCameraStreamStatus_Left)
+        {
+            FrameCapture::on_camera_event(Record_CameraLeave, pUser, pVideoPipe);
+            RawDataFFMPEGEncoder::stop_multi_camera_for(pVideoPipe);
+        }
+    }
 
     virtual void onMicSpeakerVolumeChanged(unsigned int micVolume, unsigned int speakerVolume) {}
 
@@ -264,6 +431,8 @@ void joinVideoSDKSession(std::string &session_name, std::string &session_psw, st
     session_context.videoOption.localVideoOn = true;
     session_context.audioOption.connect = true;
     session_context.audioOption.mute = true;
+    if (use_virtual_speaker)
+        session_context.virtualAudioSpeaker = new VirtualAudioSpeaker();
     IZoomVideoSDKSession *session = NULL;
     if (video_sdk_obj)
         session = video_sdk_obj->joinSession(session_context);
@@ -274,6 +443,24 @@ gboolean timeout_callback(gpointer data)
     return TRUE;
 }
 
+gboolean status_callback(gpointer data)
+{
+    int64_t frames;
+    double mean_ms, max_ms;
+    RawDataFFMPEGEncoder::take_frame_stats(&frames, &mean_ms, &max_ms);
+    printf("status: media %.1f s, audio queue %zu, video frames %lld, frame %.3f ms mean %.3f ms max, audio dropped %lld\n",
+           duration_cast<milliseconds>(MediaClock::now() - session_start).count() / 1000.0,
+           AudioIngestQueue::instance().depth(), (long long)frames, mean_ms, max_ms,
+           (long long)AudioIngestQueue::instance().dropped());
+    fflush(stdout);
+    return TRUE;
+}
+
+void trace_handler(int s)
+{
+    FrameTrace::request_dump();
+}
+
 void my_handler(int s)
 {
     printf("\nCaught signal %d\n", s);
@@ -286,6 +473,9 @@ int main(int argc, char *argv[])
     std::string self_dir = getSelfDirPath();
     printf("self path: %s\n", self_dir.c_str());
     self_dir.append("/config.json");
+    // another config can be given as the only argument.
+    if (argc > 1)
+        self_dir = argv[1];
 
     std::ifstream t(self_dir.c_str());
     t.seekg(0, std::ios::end);
@@ -316,6 +506,15 @@ int main(int argc, char *argv[])
         Json json_name = config_json["session_name"];
         Json json_psw = config_json["session_psw"];
         Json json_token = config_json["token"];
+        Json json_virtual_speaker = config_json["virtual_speaker"];
+        Json json_gallery_view = config_json["gallery_view"];
+        Json json_speaker_view = config_json["speaker_view"];
+        Json json_burn_in = config_json["burn_in"];
+        Json json_pip = config_json["pip"];
+        Json json_capture = config_json["capture"];
+        Json json_trace = config_json["trace"];
+        Json json_memory_report = config_json["memory_report"];
+        Json json_status = config_json["status"];
         if (!json_name.is_null())
         {
             session_name = json_name.get<std::string>();
@@ -331,6 +530,51 @@ int main(int argc, char *argv[])
             session_token = json_token.get<std::string>();
             printf("config session_token: %s\n", session_token.c_str());
         }
+        if (json_virtual_speaker.is_boolean())
+        {
+            use_virtual_speaker = json_virtual_speaker.get<bool>();
+            printf("config virtual_speaker: %d\n", use_virtual_speaker);
+        }
+        if (json_gallery_view.is_boolean())
+        {
+            use_gallery_view = json_gallery_view.get<bool>();
+            printf("config gallery_view: %d\n", use_gallery_view);
+        }
+        if (json_speaker_view.is_boolean())
+        {
+            use_speaker_view = json_speaker_view.get<bool>();
+            printf("config speaker_view: %d\n", use_speaker_view);
+        }
+        if (json_burn_in.is_boolean())
+        {
+            RawDataFFMPEGEncoder::burn_in = json_burn_in.get<bool>();
+            printf("config burn_in: %d\n", RawDataFFMPEGEncoder::burn_in);
+        }
+        if (json_pip.is_boolean())
+        {
+            use_pip = json_pip.get<bool>();
+            printf("config pip: %d\n", use_pip);
+        }
+        if (json_capture.is_boolean())
+        {
+            use_capture = json_capture.get<bool>();
+            printf("config capture: %d\n", use_capture);
+        }
+        if (json_trace.is_number_integer())
+        {
+            trace_sample = json_trace.get<int>();
+            printf("config trace: %d\n", trace_sample);
+        }
+        if (json_memory_report.is_number_integer())
+        {
+            memory_report = json_memory_report.get<int>();
+            printf("config memory_report: %d\n", memory_report);
+        }
+        if (json_status.is_number_integer())
+        {
+            status_interval = json_status.get<int>();
+            printf("config status: %d\n", status_interval);
+        }
     } while (false);
 
     if (session_name.size() == 0 || session_token.size() == 0)
@@ -338,7 +582,15 @@ int main(int argc, char *argv[])
         return 0;
     }
 
+    if (use_capture)
+        FrameCapture::start("../capture.zvc");
+    if (trace_sample > 0)
+        FrameTrace::start("../trace.json", trace_sample);
+    if (memory_report > 0)
+        MemoryAccounting::start_reports(memory_report);
+
     printf("begin to join: %s\n", self_dir.c_str());
+    session_start = MediaClock::now();
     joinVideoSDKSession(session_name, session_psw, session_token);
 
     struct sigaction sigIntHandler;
@@ -349,10 +601,18 @@ int main(int argc, char *argv[])
 
     sigaction(SIGINT, &sigIntHandler, NULL);
 
+    struct sigaction sigTraceHandler;
+    sigTraceHandler.sa_handler = trace_handler;
+    sigemptyset(&sigTraceHandler.sa_mask);
+    sigTraceHandler.sa_flags = 0;
+    sigaction(SIGUSR1, &sigTraceHandler, NULL);
+
     loop = g_main_loop_new(NULL, FALSE);
 
     // add source to default context
     g_timeout_add(100, timeout_callback, loop);
+    if (status_interval > 0)
+        g_timeout_add_seconds(status_interval, status_callback, NULL);
     g_main_loop_run(loop);
     return 0;
 }
\ No newline at end of file
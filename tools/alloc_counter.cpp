@@ -0,0 +1,106 @@
+#include "alloc_counter.h"
+#include <stddef.h>
+#include <errno.h>
+#include <malloc.h>
+#include <atomic>
+
+extern "C"
+{
+	void *__libc_malloc(size_t size);
+	void *__libc_calloc(size_t count, size_t size);
+	void *__libc_realloc(void *ptr, size_t size);
+	void *__libc_memalign(size_t alignment, size_t size);
+	void __libc_free(void *ptr);
+}
+
+// relaxed: the totals are read between runs, not while they change.
+static std::atomic<uint64_t> allocation_count(0);
+static std::atomic<uint64_t> allocation_bytes(0);
+static std::atomic<int64_t> live(0);
+
+static inline void count(size_t size)
+{
+	allocation_count.fetch_add(1, std::memory_order_relaxed);
+	allocation_bytes.fetch_add(size, std::memory_order_relaxed);
+}
+
+// returns the block, counted as live by its usable size.
+static inline void *alive(void *ptr)
+{
+	if (ptr)
+		live.fetch_add(malloc_usable_size(ptr), std::memory_order_relaxed);
+	return ptr;
+}
+
+static inline void gone(void *ptr)
+{
+	if (ptr)
+		live.fetch_sub(malloc_usable_size(ptr), std::memory_order_relaxed);
+}
+
+uint64_t AllocCounter::allocations()
+{
+	return allocation_count.load(std::memory_order_relaxed);
+}
+
+uint64_t AllocCounter::bytes()
+{
+	return allocation_bytes.load(std::memory_order_relaxed);
+}
+
+int64_t AllocCounter::live_bytes()
+{
+	return live.load(std::memory_order_relaxed);
+}
+
+extern "C"
+{
+	void *malloc(size_t size)
+	{
+		count(size);
+		return alive(__libc_malloc(size));
+	}
+
+	void *calloc(size_t count_, size_t size)
+	{
+		count(count_ * size);
+		return alive(__libc_calloc(count_, size));
+	}
+
+	void *realloc(void *ptr, size_t size)
+	{
+		count(size);
+		gone(ptr);
+		void *result = __libc_realloc(ptr, size);
+		// a failed realloc keeps the old block.
+		return alive(result || size == 0 ? result : ptr);
+	}
+
+	void free(void *ptr)
+	{
+		gone(ptr);
+		__libc_free(ptr);
+	}
+
+	void *memalign(size_t alignment, size_t size)
+	{
+		count(size);
+		return alive(__libc_memalign(alignment, size));
+	}
+
+	void *aligned_alloc(size_t alignment, size_t size)
+	{
+		count(size);
+		return alive(__libc_memalign(alignment, size));
+	}
+
+	int posix_memalign(void **ptr, size_t alignment, size_t size)
+	{
+		count(size);
+		void *result = alive(__libc_memalign(alignment, size));
+		if (!result)
+			return ENOMEM;
+		*ptr = result;
+		return 0;
+	}
+}
@@ -0,0 +1,15 @@
+#pragma once
+#include <stdint.h>
+
+// Counts heap allocations of the whole process, ffmpeg's included: linking
+// alloc_counter.cpp into an executable replaces malloc and friends with
+// counting wrappers around glibc's. For the benchmark tools only.
+class AllocCounter
+{
+public:
+	// malloc, calloc, realloc, memalign family and operator new calls so far.
+	static uint64_t allocations();
+	static uint64_t bytes();
+	// heap in use now, in allocated block sizes, for leak checks between quiet points.
+	static int64_t live_bytes();
+};
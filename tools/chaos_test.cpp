@@ -0,0 +1,412 @@
+// Stress test of the per-user video encoder's riskiest paths: resolution
+// changes (the filter graph is rebuilt mid-stream), rotation and range
+// switches, sourceID switches (files are closed and reopened), share starts and
+// stops, name changes, and join and leave storms through stop_encoding_for.
+// Events are drawn at random around a steady stream of frames, on virtual time,
+// so hours of session run in minutes:
+//   zoom_v-sdk_chaos [--hours h] [--users n] [--fps n] [--event-rate n] [--round-s s]
+//                    [--seed n] [--max-latency-ms ms] [--leak-kb kb] [--dir path] [--burn-in]
+// Every round all users leave. With no encoder left, the heap in use and the
+// open descriptors must not grow from round to round. No event may take longer
+// than --max-latency-ms. Reports the handling cost of each kind of event and
+// exits 1 when a check failed.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <math.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include <random>
+#include <string>
+#include <vector>
+#include <chrono>
+
+#include "fake_video_sdk.h"
+#include "media_clock.h"
+#include "raw_data_ffmpeg_encoder.h"
+#include "alloc_counter.h"
+#include "tool_helpers.h"
+
+using namespace std::chrono;
+
+typedef enum
+{
+    Event_Frame,
+    Event_Resize,
+    Event_Rotate,
+    Event_Range,
+    Event_Source,
+    Event_ShareStart,
+    Event_ShareStop,
+    Event_Name,
+    Event_Join,
+    Event_Leave,
+    Event_Count,
+} ChaosEvent;
+
+static const char *event_names[Event_Count] = {"frame",       "resize",     "rotate", "range", "source_switch",
+                                               "share_start", "share_stop", "rename", "join",  "leave"};
+
+// camera sizes within the 360p subscription, as the SDK would send them.
+static const int sizes[][2] = {{640, 360}, {480, 270}, {320, 180}, {160, 90}, {640, 480}, {320, 240}};
+static const int size_count = sizeof(sizes) / sizeof(sizes[0]);
+static const int share_sizes[][2] = {{1280, 720}, {1024, 768}, {800, 600}};
+static const int share_size_count = sizeof(share_sizes) / sizeof(share_sizes[0]);
+
+struct Options
+{
+    double hours = 2;
+    int users = 8;
+    int fps = 5; // frames per simulated second and user; events happen between them
+    double event_rate = 0.2; // events per simulated second and user
+    int round_s = 600;
+    unsigned int seed = 1;
+    double max_latency_ms = 1000;
+    int leak_kb = 1024;
+    std::string dir = "/tmp/zoom_v-sdk_chaos";
+    bool burn_in = false;
+};
+
+// one participant; its FakeUser is reused by every join, users are never freed.
+struct Slot
+{
+    FakeUser *user;
+    bool joined;
+    bool sharing;
+    int size;
+    int share_size;
+    unsigned int rotation;
+    bool full_range;
+    unsigned int source_id;
+    int renames;
+};
+
+// handling times go into fixed buckets, 5% wide from 1 us up: the leak check
+// counts the whole heap, so the test itself must not grow it while it runs.
+static const int cost_buckets = 400;
+static const double cost_bucket_base_ms = 0.001;
+static const double cost_bucket_growth = 1.05;
+
+struct Cost
+{
+    int64_t count = 0;
+    int64_t buckets[cost_buckets] = {};
+    double total_ms = 0;
+    double max_ms = 0;
+
+    // upper bound of the bucket holding the sample at rank count * percent / 100.
+    double percentile_ms(int percent) const
+    {
+        int64_t rank = std::min(count - 1, count * percent / 100);
+        int64_t seen = 0;
+        for (int bucket = 0; bucket < cost_buckets; bucket++)
+        {
+            seen += buckets[bucket];
+            if (seen > rank)
+                return std::min(max_ms, cost_bucket_base_ms * pow(cost_bucket_growth, bucket + 1));
+        }
+        return max_ms;
+    }
+};
+
+static Cost costs[Event_Count];
+
+static void record_cost(ChaosEvent event, steady_clock::time_point begin)
+{
+    double ms = duration_cast<microseconds>(steady_clock::now() - begin).count() / 1000.0;
+    int bucket = ms > cost_bucket_base_ms ? (int)(log(ms / cost_bucket_base_ms) / log(cost_bucket_growth)) : 0;
+    costs[event].buckets[std::min(bucket, cost_buckets - 1)]++;
+    costs[event].count++;
+    costs[event].total_ms += ms;
+    costs[event].max_ms = std::max(costs[event].max_ms, ms);
+}
+
+static int open_descriptors()
+{
+    int count = 0;
+    DIR *d = opendir("/proc/self/fd");
+    if (!d)
+        return -1;
+    while (readdir(d))
+        count++;
+    closedir(d);
+    // ".", ".." and the descriptor of the listing itself.
+    return count - 3;
+}
+
+// the camera frame is accounted to event: a change of size, rotation, range or
+// source is handled when the first frame showing it arrives.
+static void send_frame(Slot &slot, int phase, ChaosEvent event)
+{
+    int width = sizes[slot.size][0], height = sizes[slot.size][1];
+    FakeYUVRawData data(SyntheticMedia::frame(SyntheticMedia::Pattern_Camera, width, height, phase), width, height,
+                        slot.rotation, slot.full_range, slot.source_id);
+    steady_clock::time_point begin = steady_clock::now();
+    slot.user->video_pipe()->deliver(&data);
+    record_cost(event, begin);
+    if (slot.sharing)
+    {
+        width = share_sizes[slot.share_size][0];
+        height = share_sizes[slot.share_size][1];
+        FakeYUVRawData share(SyntheticMedia::frame(SyntheticMedia::Pattern_Share, width, height, phase / 4), width, height, 0,
+                             false, slot.source_id);
+        begin = steady_clock::now();
+        slot.user->share_pipe()->deliver(&share);
+        record_cost(Event_Frame, begin);
+    }
+}
+
+static void join(Slot &slot)
+{
+    steady_clock::time_point begin = steady_clock::now();
+    new RawDataFFMPEGEncoder(slot.user);
+    record_cost(Event_Join, begin);
+    slot.joined = true;
+}
+
+static void leave(Slot &slot)
+{
+    steady_clock::time_point begin = steady_clock::now();
+    RawDataFFMPEGEncoder::stop_encoding_for(slot.user);
+    record_cost(Event_Leave, begin);
+    slot.joined = false;
+    slot.sharing = false;
+}
+
+// one random event for a joined user, returns what its next frame is accounted to.
+// Leaves may come as a storm of several users.
+static ChaosEvent chaos_event(std::vector<Slot> &slots, Slot &slot, std::mt19937 &random)
+{
+    static int shares = 0;
+    steady_clock::time_point begin;
+    switch (std::uniform_int_distribution<int>(0, 9)(random))
+    {
+    case 0:
+    case 1:
+        // the same orientation rebuilds the filter, the other one opens a new file.
+        slot.size = std::uniform_int_distribution<int>(0, size_count - 1)(random);
+        if (slot.sharing)
+            slot.share_size = std::uniform_int_distribution<int>(0, share_size_count - 1)(random);
+        return Event_Resize;
+    case 2:
+        slot.rotation = std::uniform_int_distribution<int>(0, 3)(random) * 90;
+        return Event_Rotate;
+    case 3:
+        slot.full_range = !slot.full_range;
+        return Event_Range;
+    case 4:
+    case 5:
+        slot.source_id++;
+        return Event_Source;
+    case 6:
+        begin = steady_clock::now();
+        if (!slot.sharing)
+        {
+            slot.share_size = std::uniform_int_distribution<int>(0, share_size_count - 1)(random);
+            RawDataFFMPEGEncoder::start_share_for(slot.user, MediaClock::now(), ++shares);
+            record_cost(Event_ShareStart, begin);
+        }
+        else
+        {
+            RawDataFFMPEGEncoder::stop_share_for(slot.user);
+            record_cost(Event_ShareStop, begin);
+        }
+        slot.sharing = !slot.sharing;
+        return Event_Frame;
+    case 7:
+        slot.user->set_name("chaos_" + std::to_string(&slot - &slots[0] + 1) + "_" + std::to_string(++slot.renames % 10));
+        begin = steady_clock::now();
+        RawDataFFMPEGEncoder::on_user_name_changed(slot.user);
+        record_cost(Event_Name, begin);
+        return Event_Frame;
+    default:
+    {
+        // a storm: this user and up to three others leave at once.
+        int storm = std::uniform_int_distribution<int>(0, 3)(random);
+        leave(slot);
+        for (auto iter = slots.begin(); iter != slots.end() && storm > 0; iter++)
+        {
+            if (iter->joined)
+            {
+                leave(*iter);
+                storm--;
+            }
+        }
+        return Event_Frame;
+    }
+    }
+}
+
+static void usage()
+{
+    printf("usage: zoom_v-sdk_chaos [--hours h] [--users n] [--fps n] [--event-rate n] [--round-s s] [--seed n]\n"
+           "                        [--max-latency-ms ms] [--leak-kb kb] [--dir path] [--burn-in]\n");
+}
+
+int main(int argc, char *argv[])
+{
+    Options options;
+    for (int index = 1; index < argc; index++)
+    {
+        bool has_value = index + 1 < argc;
+        if (strcmp(argv[index], "--hours") == 0 && has_value)
+            options.hours = atof(argv[++index]);
+        else if (strcmp(argv[index], "--users") == 0 && has_value)
+            options.users = atoi(argv[++index]);
+        else if (strcmp(argv[index], "--fps") == 0 && has_value)
+            options.fps = atoi(argv[++index]);
+        else if (strcmp(argv[index], "--event-rate") == 0 && has_value)
+            options.event_rate = atof(argv[++index]);
+        else if (strcmp(argv[index], "--round-s") == 0 && has_value)
+            options.round_s = atoi(argv[++index]);
+        else if (strcmp(argv[index], "--seed") == 0 && has_value)
+            options.seed = strtoul(argv[++index], NULL, 10);
+        else if (strcmp(argv[index], "--max-latency-ms") == 0 && has_value)
+            options.max_latency_ms = atof(argv[++index]);
+        else if (strcmp(argv[index], "--leak-kb") == 0 && has_value)
+            options.leak_kb = atoi(argv[++index]);
+        else if (strcmp(argv[index], "--dir") == 0 && has_value)
+            options.dir = argv[++index];
+        else if (strcmp(argv[index], "--burn-in") == 0)
+            options.burn_in = true;
+        else
+        {
+            usage();
+            return 1;
+        }
+    }
+    if (options.hours <= 0 || options.users <= 0 || options.fps <= 0 || options.round_s <= 0)
+    {
+        usage();
+        return 1;
+    }
+
+    // the encoders write ../<file>.mkv, they run in <dir>/bin and <dir> is cleared every round.
+    std::string bin = options.dir + "/bin";
+    mkdir(options.dir.c_str(), 0755);
+    mkdir(bin.c_str(), 0755);
+    if (chdir(bin.c_str()) != 0)
+    {
+        printf("Cannot use %s.\n", bin.c_str());
+        return 1;
+    }
+    av_log_set_level(AV_LOG_ERROR);
+    av_register_all();
+    avfilter_register_all();
+    RawDataFFMPEGEncoder::burn_in = options.burn_in;
+    MediaClock::start_virtual(time(NULL));
+    printf("chaos: %.1f h of %d users at %d fps, %.2f events/s per user, seed %u\n", options.hours, options.users,
+           options.fps, options.event_rate, options.seed);
+    fflush(stdout);
+
+    std::mt19937 random(options.seed);
+    std::vector<Slot> slots(options.users);
+    for (int index = 0; index < options.users; index++)
+    {
+        Slot &slot = slots[index];
+        slot.user = new FakeUser("chaos_" + std::to_string(index + 1), std::to_string(16778240 + index * 1024), 0);
+        slot.joined = slot.sharing = slot.full_range = false;
+        slot.size = slot.share_size = 0;
+        slot.rotation = 0;
+        slot.source_id = 0;
+        slot.renames = 0;
+    }
+
+    const int64_t ticks = (int64_t)(options.hours * 3600 * options.fps);
+    const int64_t round_ticks = (int64_t)options.round_s * options.fps;
+    const microseconds interval(1000000 / options.fps);
+    std::bernoulli_distribution event_due(std::min(1.0, options.event_rate / options.fps));
+    // a user out of the session comes back after 5 s on average.
+    std::bernoulli_distribution rejoin(std::min(1.0, 0.2 / options.fps));
+    std::vector<int64_t> quiet_bytes;
+    std::vector<int> quiet_descriptors;
+    // sized up front, like the costs, to stay out of the heap growth.
+    quiet_bytes.reserve(ticks / round_ticks + 2);
+    quiet_descriptors.reserve(ticks / round_ticks + 2);
+    steady_clock::time_point started = steady_clock::now();
+    int failures = 0;
+
+    for (int64_t tick = 0; tick < ticks; tick++)
+    {
+        MediaClock::advance(interval);
+        if (tick % round_ticks == 0)
+        {
+            // a quiet point: no encoder is left, what stays allocated is kept for good or leaked.
+            for (auto iter = slots.begin(); iter != slots.end(); iter++)
+            {
+                if (iter->joined)
+                    leave(*iter);
+            }
+            remove_recordings(options.dir);
+            quiet_bytes.push_back(AllocCounter::live_bytes());
+            quiet_descriptors.push_back(open_descriptors());
+            printf("round %lld: %.1f h simulated, heap %lld KB, %d descriptors, %.0f s elapsed\n",
+                   (long long)(tick / round_ticks), tick / (3600.0 * options.fps), (long long)(quiet_bytes.back() / 1024),
+                   quiet_descriptors.back(), duration_cast<milliseconds>(steady_clock::now() - started).count() / 1000.0);
+            fflush(stdout);
+            for (auto iter = slots.begin(); iter != slots.end(); iter++)
+                join(*iter);
+        }
+        for (auto iter = slots.begin(); iter != slots.end(); iter++)
+        {
+            if (!iter->joined)
+            {
+                if (rejoin(random))
+                    join(*iter);
+                continue;
+            }
+            ChaosEvent event = event_due(random) ? chaos_event(slots, *iter, random) : Event_Frame;
+            if (iter->joined)
+                send_frame(*iter, (int)tick, event);
+        }
+    }
+    for (auto iter = slots.begin(); iter != slots.end(); iter++)
+    {
+        if (iter->joined)
+            leave(*iter);
+    }
+    remove_recordings(options.dir);
+    quiet_bytes.push_back(AllocCounter::live_bytes());
+    quiet_descriptors.push_back(open_descriptors());
+
+    printf("%-14s %9s %10s %10s %10s\n", "event", "count", "mean ms", "p99 ms", "max ms");
+    for (int event = 0; event < Event_Count; event++)
+    {
+        Cost &cost = costs[event];
+        if (cost.count == 0)
+            continue;
+        printf("%-14s %9lld %10.2f %10.2f %10.2f\n", event_names[event], (long long)cost.count, cost.total_ms / cost.count,
+               cost.percentile_ms(99), cost.max_ms);
+        if (cost.max_ms > options.max_latency_ms)
+        {
+            printf("FAIL: %s took %.1f ms, over %.0f ms\n", event_names[event], cost.max_ms, options.max_latency_ms);
+            failures++;
+        }
+    }
+    // the first rounds warm up allocator pools, the frame cache and ffmpeg's static tables.
+    if (quiet_bytes.size() >= 3)
+    {
+        int64_t growth = quiet_bytes.back() - quiet_bytes[1];
+        int descriptors = quiet_descriptors.back() - quiet_descriptors[1];
+        printf("heap growth since round 1: %lld KB, descriptors: %d\n", (long long)(growth / 1024), descriptors);
+        if (growth > (int64_t)options.leak_kb * 1024)
+        {
+            printf("FAIL: heap grew %lld KB with no encoder running, over %d KB\n", (long long)(growth / 1024), options.leak_kb);
+            failures++;
+        }
+        if (descriptors > 0)
+        {
+            printf("FAIL: %d descriptors more with no encoder running\n", descriptors);
+            failures++;
+        }
+    }
+    else
+    {
+        printf("too few rounds for the leak check, lower --round-s or raise --hours\n");
+    }
+    printf("%s after %.1f h simulated in %.0f s\n", failures ? "FAILED" : "passed", options.hours,
+           duration_cast<milliseconds>(steady_clock::now() - started).count() / 1000.0);
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,148 @@
+// Feeds a capture written with "capture": true back into the per-user video
+// encoders, through the offline SDK's raw data pipes, so a session can be
+// reproduced without the SDK:
+//   zoom_v-sdk_replay <capture.zvc> [--speed <n> | --fast] [--burn-in] [--trace <n>]
+// Frames are delivered at their captured time, n times faster with --speed, or
+// back to back with --fast. Output files are written like the bot writes them,
+// stamped with the captured times whatever the speed: the encoders run on
+// virtual time set to each record's time.
+// --trace n traces one frame in n to trace.json, see FrameTrace.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <map>
+#include <string>
+#include <thread>
+#include <chrono>
+
+#include "fake_video_sdk.h"
+#include "frame_capture.h"
+#include "frame_trace.h"
+#include "media_clock.h"
+#include "raw_data_ffmpeg_encoder.h"
+
+using namespace std::chrono;
+
+static void usage()
+{
+    printf("usage: zoom_v-sdk_replay <capture.zvc> [--speed <n> | --fast] [--burn-in] [--trace <n>]\n");
+}
+
+int main(int argc, char *argv[])
+{
+    const char *file_name = NULL;
+    double speed = 1.0;
+    bool fast = false;
+    int trace_sample = 0;
+    for (int index = 1; index < argc; index++)
+    {
+        if (strcmp(argv[index], "--speed") == 0 && index + 1 < argc)
+            speed = atof(argv[++index]);
+        else if (strcmp(argv[index], "--fast") == 0)
+            fast = true;
+        else if (strcmp(argv[index], "--burn-in") == 0)
+            RawDataFFMPEGEncoder::burn_in = true;
+        else if (strcmp(argv[index], "--trace") == 0 && index + 1 < argc)
+            trace_sample = atoi(argv[++index]);
+        else if (argv[index][0] != '-' && !file_name)
+            file_name = argv[index];
+        else
+        {
+            usage();
+            return 1;
+        }
+    }
+    if (!file_name || speed <= 0)
+    {
+        usage();
+        return 1;
+    }
+
+    FrameCaptureReader reader;
+    if (reader.open(file_name) != 0)
+        return 1;
+    printf("replaying %s\n", file_name);
+    if (trace_sample > 0)
+        FrameTrace::start("trace.json", trace_sample);
+
+    // by capture id, the SDK user id of a capture can be empty.
+    std::map<uint32_t, FakeUser *> users;
+    CaptureRecord record;
+    int64_t frames = 0, skipped = 0, dropped = 0, last_time_us = 0;
+    int shares = 0;
+    steady_clock::time_point origin = steady_clock::now();
+    MediaClock::start_virtual(reader.start_epoch_ms() / 1000);
+    steady_clock::time_point media_origin = MediaClock::now();
+    while (reader.next(record))
+    {
+        if (!fast)
+            std::this_thread::sleep_until(origin + microseconds((int64_t)(record.time_us / speed)));
+        MediaClock::advance_to(media_origin + microseconds(record.time_us));
+        last_time_us = record.time_us;
+
+        auto found = users.find(record.capture_id);
+        FakeUser *user = found != users.end() ? found->second : NULL;
+        if (!user && record.type != Record_Join)
+        {
+            // the user joined before the capture started.
+            skipped++;
+            continue;
+        }
+        switch (record.type)
+        {
+        case Record_Join:
+            if (user)
+                RawDataFFMPEGEncoder::stop_encoding_for(user);
+            // users are never freed, an encoder may still log with them while it finishes.
+            user = new FakeUser(record.name, record.user_id, 0);
+            users[record.capture_id] = user;
+            new RawDataFFMPEGEncoder(user);
+            break;
+        case Record_Leave:
+            RawDataFFMPEGEncoder::stop_encoding_for(user);
+            users.erase(record.capture_id);
+            break;
+        case Record_NameChanged:
+            user->set_name(record.name);
+            RawDataFFMPEGEncoder::on_user_name_changed(user);
+            break;
+        case Record_ShareStart:
+            RawDataFFMPEGEncoder::start_share_for(user, MediaClock::now(), ++shares);
+            break;
+        case Record_ShareStop:
+            RawDataFFMPEGEncoder::stop_share_for(user);
+            break;
+        case Record_CameraJoin:
+            RawDataFFMPEGEncoder::start_multi_camera_for(user, user->camera_pipe(record.camera));
+            break;
+        case Record_CameraLeave:
+            RawDataFFMPEGEncoder::stop_multi_camera_for(user->camera_pipe(record.camera));
+            break;
+        case Record_Dropped:
+            dropped++;
+            break;
+        case Record_Frame:
+        {
+            FakeRawDataPipe *pipe = record.profile == VideoProfile_Share         ? user->share_pipe()
+                                    : record.profile == VideoProfile_MultiCamera ? user->camera_pipe(record.camera)
+                                                                                 : user->video_pipe();
+            FakeYUVRawData data(record.planes.data(), record.width, record.height, record.rotation, record.full_range,
+                                record.source_id);
+            pipe->deliver(&data);
+            frames++;
+            break;
+        }
+        default:
+            break;
+        }
+    }
+    for (auto iter = users.begin(); iter != users.end(); iter++)
+        RawDataFFMPEGEncoder::stop_encoding_for(iter->second);
+    FrameTrace::stop();
+
+    double elapsed = duration_cast<microseconds>(steady_clock::now() - origin).count() / 1e6;
+    printf("replayed %lld frames of %.1f s in %.1f s, %.1f frames/s, %lld records skipped, %lld frames lost in the capture\n",
+           (long long)frames, last_time_us / 1e6, elapsed, elapsed > 0 ? frames / elapsed : 0.0, (long long)skipped,
+           (long long)dropped);
+    return 0;
+}
@@ -0,0 +1,297 @@
+// Regression check of the per-user video encoder: known synthetic sequences go
+// through RawDataFFMPEGEncoder in deterministic mode on virtual time, and every
+// packet of the files it writes (size, flags, timestamps, MD5) is compared with
+// the golden file of the scenario:
+//   zoom_v-sdk_golden [--golden dir] [--dir path] [--update] [--require-golden] [scenario ...]
+// --update writes the golden files instead. Goldens hold for one ffmpeg and
+// x264 build, update them together with lib/ffmpeg.tar.gz. A scenario without a
+// golden file is played but not checked, unless --require-golden.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include <fstream>
+#include <string>
+#include <vector>
+
+extern "C"
+{
+#include "libavutil/md5.h"
+}
+
+#include "fake_video_sdk.h"
+#include "media_clock.h"
+#include "raw_data_ffmpeg_encoder.h"
+
+struct Step
+{
+    int frames;
+    int width;
+    int height;
+    unsigned int rotation;
+    bool full_range;
+    int phase_every; // the picture changes every n frames, the encoder drops the repeats
+};
+
+struct Scenario
+{
+    const char *name;
+    VideoProfile profile;
+    int fps;
+    bool burn_in;
+    std::vector<Step> steps;
+};
+
+// camera frames are sent at the size given, the pipe fits them to the 360p subscription.
+static const std::vector<Scenario> scenarios = {
+    {"camera_360p", VideoProfile_Camera, 25, false, {{100, 640, 360, 0, false, 1}}},
+    {"camera_portrait", VideoProfile_Camera, 25, false, {{50, 640, 360, 90, false, 1}, {50, 640, 360, 0, false, 1}}},
+    {"camera_full_range", VideoProfile_Camera, 25, false, {{50, 640, 360, 0, true, 1}, {50, 640, 360, 0, false, 1}}},
+    {"camera_rescale", VideoProfile_Camera, 25, false, {{40, 640, 360, 0, false, 1}, {40, 320, 180, 0, false, 1}, {40, 480, 270, 0, false, 1}}},
+    {"camera_duplicates", VideoProfile_Camera, 25, false, {{300, 640, 360, 0, false, 50}}},
+    {"camera_burn_in", VideoProfile_Camera, 25, true, {{60, 640, 360, 0, false, 1}}},
+    {"share", VideoProfile_Share, 15, false, {{90, 1280, 720, 0, false, 15}, {30, 1024, 768, 0, false, 5}}},
+};
+
+static std::string hex(const uint8_t *data, int size)
+{
+    static const char digits[] = "0123456789abcdef";
+    std::string out;
+    for (int i = 0; i < size; i++)
+    {
+        out += digits[data[i] >> 4];
+        out += digits[data[i] & 15];
+    }
+    return out;
+}
+
+// the stream parameters and one line per packet of a written file.
+static int describe(const std::string &file, std::vector<std::string> &lines)
+{
+    AVFormatContext *fmt_ctx = NULL;
+    if (avformat_open_input(&fmt_ctx, file.c_str(), NULL, NULL) < 0)
+    {
+        printf("Cannot open %s.\n", file.c_str());
+        return -1;
+    }
+    avformat_find_stream_info(fmt_ctx, NULL);
+    char line[256];
+    for (unsigned int index = 0; index < fmt_ctx->nb_streams; index++)
+    {
+        AVCodecContext *codec = fmt_ctx->streams[index]->codec;
+        snprintf(line, sizeof(line), "stream %u %s %dx%d range %d", index, avcodec_get_name(codec->codec_id), codec->width,
+                 codec->height, codec->color_range);
+        lines.push_back(line);
+    }
+    AVPacket pkt;
+    av_init_packet(&pkt);
+    int count = 0;
+    while (av_read_frame(fmt_ctx, &pkt) >= 0)
+    {
+        uint8_t md5[16];
+        av_md5_sum(md5, pkt.data, pkt.size);
+        snprintf(line, sizeof(line), "%d pts %lld dts %lld %s size %d md5 %s", count++, (long long)pkt.pts, (long long)pkt.dts,
+                 pkt.flags & AV_PKT_FLAG_KEY ? "key" : "-", pkt.size, hex(md5, 16).c_str());
+        lines.push_back(line);
+        av_packet_unref(&pkt);
+    }
+    avformat_close_input(&fmt_ctx);
+    return 0;
+}
+
+static std::vector<std::string> recordings(const std::string &dir)
+{
+    std::vector<std::string> files;
+    DIR *d = opendir(dir.c_str());
+    if (!d)
+        return files;
+    struct dirent *entry;
+    while ((entry = readdir(d)) != NULL)
+    {
+        size_t length = strlen(entry->d_name);
+        if (length > 4 && strcmp(entry->d_name + length - 4, ".mkv") == 0)
+            files.push_back(entry->d_name);
+    }
+    closedir(d);
+    std::sort(files.begin(), files.end());
+    return files;
+}
+
+// plays a scenario, returns the description of everything it wrote.
+static int play(const Scenario &scenario, const std::string &dir, std::vector<std::string> &lines)
+{
+    std::vector<std::string> old = recordings(dir);
+    for (auto iter = old.begin(); iter != old.end(); iter++)
+        unlink((dir + "/" + *iter).c_str());
+
+    // the same virtual start every run, 2024-01-01 00:00:00 UTC for burned in clocks.
+    MediaClock::start_virtual(1704067200);
+    RawDataFFMPEGEncoder::burn_in = scenario.burn_in;
+    // users are never freed, an encoder may still log with them while it finishes.
+    FakeUser *user = new FakeUser(scenario.name, "16778240", 0);
+    if (scenario.profile == VideoProfile_Share)
+        RawDataFFMPEGEncoder::start_share_for(user, MediaClock::now(), 1);
+    else
+        new RawDataFFMPEGEncoder(user);
+    const microseconds interval(1000000 / scenario.fps);
+    int frame = 0;
+    for (auto step = scenario.steps.begin(); step != scenario.steps.end(); step++)
+    {
+        for (int index = 0; index < step->frames; index++, frame++)
+        {
+            MediaClock::advance(interval);
+            if (scenario.profile == VideoProfile_Share)
+                user->share_pipe()->deliver(SyntheticMedia::Pattern_Share, step->width, step->height,
+                                            frame / step->phase_every, 0, false);
+            else
+                user->video_pipe()->deliver(SyntheticMedia::Pattern_Camera, step->width, step->height,
+                                            frame / step->phase_every, step->rotation, step->full_range);
+        }
+    }
+    RawDataFFMPEGEncoder::stop_encoding_for(user);
+
+    std::vector<std::string> files = recordings(dir);
+    if (files.empty())
+    {
+        printf("Scenario %s wrote no file.\n", scenario.name);
+        return -1;
+    }
+    for (auto iter = files.begin(); iter != files.end(); iter++)
+    {
+        lines.push_back("file " + *iter);
+        if (describe(dir + "/" + *iter, lines) != 0)
+            return -1;
+        unlink((dir + "/" + *iter).c_str());
+    }
+    return 0;
+}
+
+static void usage()
+{
+    printf("usage: zoom_v-sdk_golden [--golden dir] [--dir path] [--update] [--require-golden] [scenario ...]\n");
+    printf("scenarios:");
+    for (auto iter = scenarios.begin(); iter != scenarios.end(); iter++)
+        printf(" %s", iter->name);
+    printf("\n");
+}
+
+int main(int argc, char *argv[])
+{
+    // run from bin like the bot, the goldens are kept in the source tree.
+    std::string golden_dir = "../tools/golden";
+    std::string dir = "/tmp/zoom_v-sdk_golden";
+    bool update = false;
+    bool require_golden = false;
+    std::vector<std::string> selected;
+    for (int index = 1; index < argc; index++)
+    {
+        if (strcmp(argv[index], "--golden") == 0 && index + 1 < argc)
+            golden_dir = argv[++index];
+        else if (strcmp(argv[index], "--dir") == 0 && index + 1 < argc)
+            dir = argv[++index];
+        else if (strcmp(argv[index], "--update") == 0)
+            update = true;
+        else if (strcmp(argv[index], "--require-golden") == 0)
+            require_golden = true;
+        else if (argv[index][0] != '-')
+            selected.push_back(argv[index]);
+        else
+        {
+            usage();
+            return 1;
+        }
+    }
+    if (golden_dir[0] != '/')
+    {
+        char cwd[4096];
+        if (getcwd(cwd, sizeof(cwd)))
+            golden_dir = std::string(cwd) + "/" + golden_dir;
+    }
+
+    if (update)
+        mkdir(golden_dir.c_str(), 0755);
+
+    // the encoders write ../<file>.mkv, so they run in <dir>/bin.
+    std::string bin = dir + "/bin";
+    mkdir(dir.c_str(), 0755);
+    mkdir(bin.c_str(), 0755);
+    if (chdir(bin.c_str()) != 0)
+    {
+        printf("Cannot use %s.\n", bin.c_str());
+        return 1;
+    }
+    // burned in clocks show local time.
+    setenv("TZ", "UTC", 1);
+    tzset();
+    RawDataFFMPEGEncoder::deterministic = true;
+    av_log_set_level(AV_LOG_ERROR);
+    av_register_all();
+    printf("%s golden files in %s\n", update ? "updating" : "checking against", golden_dir.c_str());
+    fflush(stdout);
+
+    int run = 0, failed = 0, unchecked = 0;
+    for (auto scenario = scenarios.begin(); scenario != scenarios.end(); scenario++)
+    {
+        if (!selected.empty() && std::find(selected.begin(), selected.end(), scenario->name) == selected.end())
+            continue;
+        run++;
+        std::vector<std::string> lines;
+        if (play(*scenario, dir, lines) != 0)
+        {
+            failed++;
+            continue;
+        }
+        std::string golden_file = golden_dir + "/" + scenario->name + ".txt";
+        if (update)
+        {
+            std::ofstream out(golden_file.c_str());
+            for (auto iter = lines.begin(); iter != lines.end(); iter++)
+                out << *iter << "\n";
+            if (!out)
+            {
+                printf("Cannot write %s.\n", golden_file.c_str());
+                failed++;
+                continue;
+            }
+            printf("%-20s written, %d lines\n", scenario->name, (int)lines.size());
+            continue;
+        }
+
+        std::ifstream in(golden_file.c_str());
+        if (!in)
+        {
+            printf("%-20s no golden file %s, run with --update on the reference build\n", scenario->name, golden_file.c_str());
+            if (require_golden)
+                failed++;
+            else
+                unchecked++;
+            continue;
+        }
+        std::vector<std::string> golden;
+        std::string line;
+        while (std::getline(in, line))
+            golden.push_back(line);
+        size_t mismatch = 0;
+        while (mismatch < lines.size() && mismatch < golden.size() && lines[mismatch] == golden[mismatch])
+            mismatch++;
+        if (mismatch == lines.size() && mismatch == golden.size())
+        {
+            printf("%-20s ok, %d lines\n", scenario->name, (int)lines.size());
+            continue;
+        }
+        failed++;
+        printf("%-20s differs at line %d\n  golden: %s\n  output: %s\n", scenario->name, (int)mismatch + 1,
+               mismatch < golden.size() ? golden[mismatch].c_str() : "(end)",
+               mismatch < lines.size() ? lines[mismatch].c_str() : "(end)");
+    }
+    if (run == 0)
+    {
+        usage();
+        return 1;
+    }
+    printf("%d scenarios, %d failed, %d without a golden file\n", run, failed, unchecked);
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,338 @@
+// Capacity test of the per-user video encoders: simulated participants are
+// added step by step, each sending synthetic frames through the offline SDK's
+// raw data pipes into a real RawDataFFMPEGEncoder, until the frame latency or the
+// drop rate breaks the SLO. Reports per step the participants per busy core and
+// per profile the largest participant count that held the SLO:
+//   zoom_v-sdk_loadtest [--profiles camera,share] [--start n] [--step n] [--max n]
+//                       [--step-s s] [--fps n] [--threads n] [--slo-p99-ms ms]
+//                       [--slo-drop-pct pct] [--dir path] [--label text] [--json]
+// A frame is due every 1/fps per participant; its latency runs from when it was
+// due to when the encoder callback returned. A frame still undelivered a whole
+// interval after it was due is dropped, like the SDK drops for a slow receiver.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <chrono>
+
+#include "json.hpp"
+#include "fake_video_sdk.h"
+#include "raw_data_ffmpeg_encoder.h"
+#include "tool_helpers.h"
+
+using Json = nlohmann::json;
+using namespace std::chrono;
+
+struct Profile
+{
+    const char *name;
+    VideoProfile profile;
+    SyntheticMedia::Pattern pattern;
+    int width; // sent size, the camera pipe scales it down to the 360p subscription
+    int height;
+    int fps;
+};
+
+static const Profile profiles[] = {
+    {"camera", VideoProfile_Camera, SyntheticMedia::Pattern_Camera, 1280, 720, 25},
+    {"share", VideoProfile_Share, SyntheticMedia::Pattern_Share, 1280, 720, 15},
+};
+
+struct Options
+{
+    int start = 4;
+    int step = 4;
+    int max = 256;
+    int step_s = 10;
+    int warmup_s = 2; // before each step's measurement, new encoders open their files
+    int fps = 0;      // 0: the profile's
+    int threads = 0;  // 0: one per core
+    double slo_p99_ms = 100;
+    double slo_drop_pct = 1;
+    std::string dir = "/tmp/zoom_v-sdk_load";
+    std::string label;
+    bool json = false;
+};
+
+struct Participant
+{
+    FakeUser *user;
+    steady_clock::time_point due;
+    int frame;
+};
+
+// the participants one delivery thread sends for, and what it measured.
+struct Lane
+{
+    std::vector<Participant> participants;
+    std::vector<int32_t> latency_us;
+    int64_t delivered;
+    int64_t dropped;
+};
+
+static void run_lane(Lane *lane, const Profile *profile, int interval_us, steady_clock::time_point measure_start,
+                     steady_clock::time_point end)
+{
+    const microseconds interval(interval_us);
+    while (true)
+    {
+        // the participant whose frame is due first.
+        Participant *next = NULL;
+        for (auto iter = lane->participants.begin(); iter != lane->participants.end(); iter++)
+        {
+            if (!next || iter->due < next->due)
+                next = &*iter;
+        }
+        if (!next || next->due >= end)
+            break;
+        std::this_thread::sleep_until(next->due);
+        steady_clock::time_point due = next->due;
+        next->due += interval;
+        const bool measured = due >= measure_start;
+        if (steady_clock::now() - due >= interval)
+        {
+            if (measured)
+                lane->dropped++;
+            continue;
+        }
+        FakeRawDataPipe *pipe = profile->profile == VideoProfile_Share ? next->user->share_pipe() : next->user->video_pipe();
+        pipe->deliver(profile->pattern, profile->width, profile->height, next->frame++, 0, false);
+        if (measured)
+        {
+            lane->delivered++;
+            lane->latency_us.push_back((int32_t)duration_cast<microseconds>(steady_clock::now() - due).count());
+        }
+    }
+}
+
+static double percentile(std::vector<int32_t> &values, double fraction)
+{
+    if (values.empty())
+        return 0;
+    size_t index = std::min(values.size() - 1, (size_t)(values.size() * fraction));
+    std::nth_element(values.begin(), values.begin() + index, values.end());
+    return values[index] / 1000.0;
+}
+
+// ramps one profile, returns the largest participant count within the SLO (0 if none).
+static int ramp(const Profile &profile, const Options &options, int cores)
+{
+    const int fps = options.fps > 0 ? options.fps : profile.fps;
+    const int interval_us = 1000000 / fps;
+    const int thread_count = options.threads > 0 ? options.threads : cores;
+    std::vector<Lane> lanes(thread_count);
+    std::vector<FakeUser *> users;
+    int sustained = 0;
+    bool knee = false;
+
+    for (int count = options.start; count <= options.max && !knee; count += options.step)
+    {
+        // encoders are created between steps, while no frame is being delivered.
+        while ((int)users.size() < count)
+        {
+            int index = users.size();
+            // users are never freed, an encoder may still log with them while it finishes.
+            FakeUser *user = new FakeUser("load_" + std::to_string(index + 1), std::to_string(16778240 + index * 1024), 0);
+            users.push_back(user);
+            if (profile.profile == VideoProfile_Share)
+                RawDataFFMPEGEncoder::start_share_for(user, steady_clock::now(), index + 1);
+            else
+                new RawDataFFMPEGEncoder(user);
+            lanes[index % thread_count].participants.push_back({user, steady_clock::time_point(), 0});
+        }
+
+        // frames of a lane's participants are spread over the interval rather than sent in bursts.
+        steady_clock::time_point start = steady_clock::now() + milliseconds(10);
+        steady_clock::time_point measure_start = start + seconds(options.warmup_s);
+        steady_clock::time_point end = measure_start + seconds(options.step_s);
+        for (size_t lane = 0; lane < lanes.size(); lane++)
+        {
+            std::vector<Participant> &participants = lanes[lane].participants;
+            for (size_t index = 0; index < participants.size(); index++)
+                participants[index].due = start + microseconds((int64_t)interval_us * (index * thread_count + lane) / count);
+            lanes[lane].latency_us.clear();
+            lanes[lane].latency_us.reserve((size_t)participants.size() * fps * options.step_s);
+            lanes[lane].delivered = 0;
+            lanes[lane].dropped = 0;
+        }
+        std::vector<std::thread> threads;
+        for (size_t lane = 0; lane < lanes.size(); lane++)
+            threads.push_back(std::thread(run_lane, &lanes[lane], &profile, interval_us, measure_start, end));
+        std::this_thread::sleep_until(measure_start);
+        double cpu = cpu_seconds();
+        std::this_thread::sleep_until(end);
+        cpu = cpu_seconds() - cpu;
+        for (auto iter = threads.begin(); iter != threads.end(); iter++)
+            iter->join();
+
+        std::vector<int32_t> latency_us;
+        int64_t delivered = 0, dropped = 0;
+        for (auto iter = lanes.begin(); iter != lanes.end(); iter++)
+        {
+            latency_us.insert(latency_us.end(), iter->latency_us.begin(), iter->latency_us.end());
+            delivered += iter->delivered;
+            dropped += iter->dropped;
+        }
+        const double p50_ms = percentile(latency_us, 0.5);
+        const double p99_ms = percentile(latency_us, 0.99);
+        const double drop_pct = delivered + dropped > 0 ? 100.0 * dropped / (delivered + dropped) : 0;
+        const double busy_cores = cpu / options.step_s;
+        const double per_core = busy_cores > 0 ? count / busy_cores : 0;
+        const bool within_slo = p99_ms <= options.slo_p99_ms && drop_pct <= options.slo_drop_pct;
+        if (within_slo)
+            sustained = count;
+        else
+            knee = true;
+
+        if (options.json)
+        {
+            Json result;
+            result["label"] = options.label;
+            result["profile"] = profile.name;
+            result["participants"] = count;
+            result["fps"] = fps;
+            result["threads"] = thread_count;
+            result["frames"] = delivered;
+            result["dropped"] = dropped;
+            result["drop_pct"] = drop_pct;
+            result["p50_ms"] = p50_ms;
+            result["p99_ms"] = p99_ms;
+            result["busy_cores"] = busy_cores;
+            result["participants_per_core"] = per_core;
+            result["within_slo"] = within_slo;
+            printf("%s\n", result.dump().c_str());
+        }
+        else
+        {
+            printf("%-6s %4d participants %6.2f busy cores %6.2f per core  p50 %7.1f ms  p99 %7.1f ms  dropped %5.2f%%%s\n",
+                   profile.name, count, busy_cores, per_core, p50_ms, p99_ms, drop_pct, within_slo ? "" : "  over SLO");
+        }
+        fflush(stdout);
+    }
+
+    for (auto iter = users.begin(); iter != users.end(); iter++)
+        RawDataFFMPEGEncoder::stop_encoding_for(*iter);
+    // the encoders write ../<file>.mkv, the load test runs in <dir>/bin and clears <dir> after each profile.
+    remove_recordings(options.dir);
+
+    if (options.json)
+    {
+        Json summary;
+        summary["label"] = options.label;
+        summary["profile"] = profile.name;
+        summary["max_participants"] = sustained;
+        summary["cores"] = cores;
+        summary["max_participants_per_core"] = (double)sustained / cores;
+        summary["knee_found"] = knee;
+        printf("%s\n", summary.dump().c_str());
+    }
+    else
+    {
+        printf("%-6s sustains %d participants at %d fps on %d cores, %.2f per core%s\n", profile.name, sustained, fps, cores,
+               (double)sustained / cores, knee ? "" : " (no knee below --max)");
+    }
+    fflush(stdout);
+    return sustained;
+}
+
+static void usage()
+{
+    printf("usage: zoom_v-sdk_loadtest [--profiles camera,share] [--start n] [--step n] [--max n] [--step-s s]\n"
+           "                           [--fps n] [--threads n] [--slo-p99-ms ms] [--slo-drop-pct pct]\n"
+           "                           [--dir path] [--label text] [--json]\n");
+}
+
+int main(int argc, char *argv[])
+{
+    std::vector<std::string> profile_names = split("camera,share");
+    Options options;
+    for (int index = 1; index < argc; index++)
+    {
+        bool has_value = index + 1 < argc;
+        if (strcmp(argv[index], "--profiles") == 0 && has_value)
+            profile_names = split(argv[++index]);
+        else if (strcmp(argv[index], "--start") == 0 && has_value)
+            options.start = atoi(argv[++index]);
+        else if (strcmp(argv[index], "--step") == 0 && has_value)
+            options.step = atoi(argv[++index]);
+        else if (strcmp(argv[index], "--max") == 0 && has_value)
+            options.max = atoi(argv[++index]);
+        else if (strcmp(argv[index], "--step-s") == 0 && has_value)
+            options.step_s = atoi(argv[++index]);
+        else if (strcmp(argv[index], "--fps") == 0 && has_value)
+            options.fps = atoi(argv[++index]);
+        else if (strcmp(argv[index], "--threads") == 0 && has_value)
+            options.threads = atoi(argv[++index]);
+        else if (strcmp(argv[index], "--slo-p99-ms") == 0 && has_value)
+            options.slo_p99_ms = atof(argv[++index]);
+        else if (strcmp(argv[index], "--slo-drop-pct") == 0 && has_value)
+            options.slo_drop_pct = atof(argv[++index]);
+        else if (strcmp(argv[index], "--dir") == 0 && has_value)
+            options.dir = argv[++index];
+        else if (strcmp(argv[index], "--label") == 0 && has_value)
+            options.label = argv[++index];
+        else if (strcmp(argv[index], "--json") == 0)
+            options.json = true;
+        else
+        {
+            usage();
+            return 1;
+        }
+    }
+    if (options.start <= 0 || options.step <= 0 || options.step_s <= 0 || options.max < options.start)
+    {
+        usage();
+        return 1;
+    }
+
+    std::string bin = options.dir + "/bin";
+    mkdir(options.dir.c_str(), 0755);
+    mkdir(bin.c_str(), 0755);
+    if (chdir(bin.c_str()) != 0)
+    {
+        printf("Cannot use %s.\n", bin.c_str());
+        return 1;
+    }
+    // registered once up front, the encoders register again from their delivery threads.
+    av_log_set_level(AV_LOG_ERROR);
+    av_register_all();
+    avfilter_register_all();
+
+    const int cores = std::max(1u, std::thread::hardware_concurrency());
+    if (options.json)
+    {
+        Json setup;
+        setup["label"] = options.label;
+        setup["cores"] = cores;
+        setup["slo_p99_ms"] = options.slo_p99_ms;
+        setup["slo_drop_pct"] = options.slo_drop_pct;
+        printf("%s\n", setup.dump().c_str());
+    }
+    else
+    {
+        printf("load test on %d cores, SLO p99 %.0f ms and %.1f%% dropped\n", cores, options.slo_p99_ms, options.slo_drop_pct);
+    }
+    fflush(stdout);
+    for (auto name = profile_names.begin(); name != profile_names.end(); name++)
+    {
+        const Profile *profile = NULL;
+        for (size_t index = 0; index < sizeof(profiles) / sizeof(profiles[0]); index++)
+        {
+            if (*name == profiles[index].name)
+                profile = &profiles[index];
+        }
+        if (!profile)
+        {
+            usage();
+            return 1;
+        }
+        ramp(*profile, options, cores);
+    }
+    return 0;
+}
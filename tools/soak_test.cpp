@@ -0,0 +1,440 @@
+// Long session soak test of the whole bot: runs zoom_v-sdk_linux_bot_offline on a
+// generated session script in which users keep leaving and coming back with
+// other camera sizes, talking and sharing, and samples the bot as it goes:
+//   zoom_v-sdk_soak [--hours h] [--users n] [--churn-min m] [--warmup-min m] [--dir path]
+//                   [--bot path] [--speaker-view] [--real-time] [--keep-output] [--csv file]
+//                   [--rss-mb-per-h mb] [--fd-per-h n] [--threads-per-h n] [--queue-per-h n]
+//                   [--latency-pct-per-h pct]
+// The session runs on virtual time unless --real-time, so hours take minutes.
+// Each status line of the bot is a sample: its resident size, descriptors and
+// threads from /proc, the depth of the audio encoding queue and the mean time a
+// video frame took. After the warm-up a least squares line is fitted to each
+// against session time; a slope over its limit fails the test (exit 1), as does
+// a bot that crashes, exits with an error or ends before the scripted session.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <chrono>
+
+#include "json.hpp"
+#include "tool_helpers.h"
+
+using Json = nlohmann::json;
+using namespace std::chrono;
+
+struct Options
+{
+    double hours = 2;
+    int users = 8;
+    int churn_min = 10; // every user leaves and comes back with another camera this often
+    int warmup_min = 20;
+    std::string dir = "/tmp/zoom_v-sdk_soak";
+    std::string bot;
+    bool speaker_view = false;
+    bool real_time = false;
+    bool keep_output = false;
+    std::string csv;
+    double rss_mb_per_h = 8;
+    double fd_per_h = 1;
+    double threads_per_h = 1;
+    double queue_per_h = 50;
+    double latency_pct_per_h = 10;
+};
+
+struct Sample
+{
+    double media_s;
+    double real_s;
+    double rss_mb;
+    int fds;
+    int threads;
+    double queue;
+    long long frames;
+    double frame_ms;
+};
+
+// camera sizes a user comes back with, the encoders fit them to the 360p subscription.
+static const int cameras[][4] = {{640, 360, 15, 0}, {1280, 720, 25, 0}, {640, 360, 15, 90}, {320, 180, 15, 0}};
+static const int camera_count = sizeof(cameras) / sizeof(cameras[0]);
+
+// one entry per user and stay; a user's stays follow each other churn_min apart.
+static Json make_script(const Options &options)
+{
+    const double duration_s = options.hours * 3600;
+    const double churn_s = options.churn_min * 60.0;
+    Json users = Json::array();
+    for (int slot = 0; slot < options.users; slot++)
+    {
+        // the users are staggered, someone leaves or joins every churn_s / users.
+        double join_s = slot * churn_s / options.users;
+        for (int stay = 0; join_s < duration_s; stay++, join_s += churn_s)
+        {
+            const int *camera = cameras[(slot + stay) % camera_count];
+            const int *changed = cameras[(slot + stay + 1) % camera_count];
+            Json user;
+            user["name"] = "Soak " + std::to_string(slot + 1);
+            user["join_s"] = join_s;
+            // back one second later as a new user.
+            if (join_s + churn_s - 1 < duration_s)
+                user["leave_s"] = join_s + churn_s - 1;
+            user["video"] = {{"width", camera[0]}, {"height", camera[1]}, {"fps", camera[2]}, {"rotation", camera[3]},
+                             {"full_range", stay % 3 == 2}};
+            Json change = {{"at_s", join_s + churn_s / 2}, {"width", changed[0]}, {"height", changed[1]}, {"rotation", changed[3]}};
+            user["resolution_changes"] = Json::array();
+            user["resolution_changes"].push_back(change);
+            // turns to talk, the speaker changes every few seconds.
+            user["talk"] = {{"start_s", join_s + 5 + slot * 4}, {"talk_s", 4}, {"pause_s", 4 * options.users}};
+            // every other stay of the first user shares its screen for most of it.
+            if (slot == 0 && stay % 2 == 0 && churn_s > 120)
+                user["share"] = {{"start_s", join_s + 30}, {"stop_s", join_s + churn_s - 30}, {"width", 1920},
+                                 {"height", 1080}, {"fps", 5}, {"audio", true}};
+            users.push_back(user);
+        }
+    }
+    Json script;
+    script["duration_s"] = duration_s;
+    script["virtual_time"] = !options.real_time;
+    script["audio"] = {{"sample_rate", 32000}, {"channels", 1}};
+    script["users"] = users;
+    return script;
+}
+
+static std::string self_dir()
+{
+    char path[4096];
+    ssize_t length = readlink("/proc/self/exe", path, sizeof(path) - 1);
+    if (length <= 0)
+        return ".";
+    path[length] = 0;
+    char *slash = strrchr(path, '/');
+    if (slash)
+        *slash = 0;
+    return path;
+}
+
+static int count_entries(const std::string &dir)
+{
+    DIR *d = opendir(dir.c_str());
+    if (!d)
+        return -1;
+    int count = 0;
+    struct dirent *entry;
+    while ((entry = readdir(d)) != NULL)
+    {
+        if (entry->d_name[0] != '.')
+            count++;
+    }
+    closedir(d);
+    return count;
+}
+
+static double rss_mb(pid_t pid)
+{
+    long pages = 0;
+    std::string file = "/proc/" + std::to_string(pid) + "/statm";
+    FILE *fp = fopen(file.c_str(), "r");
+    if (!fp)
+        return 0;
+    if (fscanf(fp, "%*d %ld", &pages) != 1)
+        pages = 0;
+    fclose(fp);
+    return pages * (double)sysconf(_SC_PAGESIZE) / (1024 * 1024);
+}
+
+// slope of the least squares line through (x, y) and its value at x0.
+static bool fit(const std::vector<double> &x, const std::vector<double> &y, double x0, double *slope, double *at_x0)
+{
+    const size_t n = x.size();
+    if (n < 2)
+        return false;
+    double mean_x = 0, mean_y = 0;
+    for (size_t i = 0; i < n; i++)
+    {
+        mean_x += x[i];
+        mean_y += y[i];
+    }
+    mean_x /= n;
+    mean_y /= n;
+    double sxx = 0, sxy = 0;
+    for (size_t i = 0; i < n; i++)
+    {
+        sxx += (x[i] - mean_x) * (x[i] - mean_x);
+        sxy += (x[i] - mean_x) * (y[i] - mean_y);
+    }
+    if (sxx <= 0)
+        return false;
+    *slope = sxy / sxx;
+    *at_x0 = mean_y + *slope * (x0 - mean_x);
+    return true;
+}
+
+static void usage()
+{
+    printf("usage: zoom_v-sdk_soak [--hours h] [--users n] [--churn-min m] [--warmup-min m] [--dir path]\n"
+           "                       [--bot path] [--speaker-view] [--real-time] [--keep-output] [--csv file]\n"
+           "                       [--rss-mb-per-h mb] [--fd-per-h n] [--threads-per-h n] [--queue-per-h n]\n"
+           "                       [--latency-pct-per-h pct]\n");
+}
+
+int main(int argc, char *argv[])
+{
+    Options options;
+    for (int index = 1; index < argc; index++)
+    {
+        bool has_value = index + 1 < argc;
+        if (strcmp(argv[index], "--hours") == 0 && has_value)
+            options.hours = atof(argv[++index]);
+        else if (strcmp(argv[index], "--users") == 0 && has_value)
+            options.users = atoi(argv[++index]);
+        else if (strcmp(argv[index], "--churn-min") == 0 && has_value)
+            options.churn_min = atoi(argv[++index]);
+        else if (strcmp(argv[index], "--warmup-min") == 0 && has_value)
+            options.warmup_min = atoi(argv[++index]);
+        else if (strcmp(argv[index], "--dir") == 0 && has_value)
+            options.dir = argv[++index];
+        else if (strcmp(argv[index], "--bot") == 0 && has_value)
+            options.bot = argv[++index];
+        else if (strcmp(argv[index], "--speaker-view") == 0)
+            options.speaker_view = true;
+        else if (strcmp(argv[index], "--real-time") == 0)
+            options.real_time = true;
+        else if (strcmp(argv[index], "--keep-output") == 0)
+            options.keep_output = true;
+        else if (strcmp(argv[index], "--csv") == 0 && has_value)
+            options.csv = argv[++index];
+        else if (strcmp(argv[index], "--rss-mb-per-h") == 0 && has_value)
+            options.rss_mb_per_h = atof(argv[++index]);
+        else if (strcmp(argv[index], "--fd-per-h") == 0 && has_value)
+            options.fd_per_h = atof(argv[++index]);
+        else if (strcmp(argv[index], "--threads-per-h") == 0 && has_value)
+            options.threads_per_h = atof(argv[++index]);
+        else if (strcmp(argv[index], "--queue-per-h") == 0 && has_value)
+            options.queue_per_h = atof(argv[++index]);
+        else if (strcmp(argv[index], "--latency-pct-per-h") == 0 && has_value)
+            options.latency_pct_per_h = atof(argv[++index]);
+        else
+        {
+            usage();
+            return 1;
+        }
+    }
+    if (options.hours <= 0 || options.users <= 0 || options.churn_min <= 0 || options.warmup_min < 0)
+    {
+        usage();
+        return 1;
+    }
+    if (options.bot.empty())
+        options.bot = self_dir() + "/zoom_v-sdk_linux_bot_offline";
+
+    // the bot writes ../<file>, it runs in <dir>/bin with its script and config in <dir>.
+    std::string bin = options.dir + "/bin";
+    mkdir(options.dir.c_str(), 0755);
+    mkdir(bin.c_str(), 0755);
+    remove_recordings(options.dir);
+    std::string script_file = options.dir + "/soak_session.json";
+    std::string config_file = options.dir + "/soak_config.json";
+    std::string log_file = options.dir + "/soak_bot.log";
+    {
+        Json config;
+        // the offline SDK takes any session and token.
+        config["session_name"] = "soak";
+        config["token"] = "offline";
+        config["gallery_view"] = !options.speaker_view;
+        config["speaker_view"] = options.speaker_view;
+        config["status"] = 1;
+        std::ofstream script(script_file.c_str());
+        script << make_script(options).dump(1) << "\n";
+        std::ofstream out(config_file.c_str());
+        out << config.dump(1) << "\n";
+        if (!script || !out)
+        {
+            printf("Cannot write to %s.\n", options.dir.c_str());
+            return 1;
+        }
+    }
+    FILE *log = fopen(log_file.c_str(), "w");
+    if (!log)
+    {
+        printf("Cannot write %s.\n", log_file.c_str());
+        return 1;
+    }
+
+    int out[2];
+    if (pipe(out) != 0)
+        return 1;
+    printf("soak: %.1f h, %d users back every %d min%s, bot %s\n", options.hours, options.users, options.churn_min,
+           options.real_time ? ", real time" : "", options.bot.c_str());
+    fflush(stdout);
+    steady_clock::time_point started = steady_clock::now();
+    pid_t pid = fork();
+    if (pid < 0)
+        return 1;
+    if (pid == 0)
+    {
+        // ffmpeg's messages go to the log, the status lines to the pipe.
+        dup2(out[1], STDOUT_FILENO);
+        dup2(fileno(log), STDERR_FILENO);
+        close(out[0]);
+        close(out[1]);
+        if (chdir(bin.c_str()) != 0)
+            _exit(127);
+        setenv("FAKE_SDK_SCRIPT", script_file.c_str(), 1);
+        execl(options.bot.c_str(), options.bot.c_str(), config_file.c_str(), (char *)NULL);
+        fprintf(stderr, "Cannot run %s.\n", options.bot.c_str());
+        _exit(127);
+    }
+    close(out[1]);
+
+    std::vector<Sample> samples;
+    std::string proc = "/proc/" + std::to_string(pid);
+    FILE *bot_out = fdopen(out[0], "r");
+    char line[1024];
+    double next_print_s = 0;
+    printf("%8s %9s %8s %5s %7s %7s %9s %8s\n", "session", "real s", "rss MB", "fds", "threads", "queue", "frame ms", "speed");
+    while (fgets(line, sizeof(line), bot_out))
+    {
+        Sample sample;
+        size_t queue;
+        if (sscanf(line, "status: media %lf s, audio queue %zu, video frames %lld, frame %lf ms", &sample.media_s, &queue,
+                   &sample.frames, &sample.frame_ms) != 4)
+        {
+            // everything else is noise, but for errors.
+            if (strstr(line, "Error") || strstr(line, "error") || strstr(line, "Fail") || strstr(line, "fail"))
+                fputs(line, log);
+            continue;
+        }
+        sample.queue = (double)queue;
+        sample.real_s = duration_cast<milliseconds>(steady_clock::now() - started).count() / 1000.0;
+        sample.rss_mb = rss_mb(pid);
+        // the listing's own descriptor is in the bot's process, not here.
+        sample.fds = count_entries(proc + "/fd");
+        sample.threads = count_entries(proc + "/task");
+        samples.push_back(sample);
+        // deleted while the bot runs to keep the disk from filling.
+        if (!options.keep_output)
+            remove_recordings(options.dir);
+        if (sample.media_s >= next_print_s)
+        {
+            int minutes = (int)(sample.media_s / 60);
+            printf("%5d:%02d %9.0f %8.1f %5d %7d %7.0f %9.3f %7.1fx\n", minutes / 60, minutes % 60, sample.real_s,
+                   sample.rss_mb, sample.fds, sample.threads, sample.queue, sample.frame_ms,
+                   sample.real_s > 0 ? sample.media_s / sample.real_s : 0.0);
+            fflush(stdout);
+            next_print_s = sample.media_s + options.churn_min * 60.0;
+        }
+    }
+    fclose(bot_out);
+    int status = 0;
+    waitpid(pid, &status, 0);
+    fclose(log);
+    if (!options.keep_output)
+        remove_recordings(options.dir);
+
+    if (!options.csv.empty())
+    {
+        FILE *csv = fopen(options.csv.c_str(), "w");
+        if (csv)
+        {
+            fprintf(csv, "media_s,real_s,rss_mb,fds,threads,audio_queue,video_frames,frame_ms\n");
+            for (auto iter = samples.begin(); iter != samples.end(); iter++)
+                fprintf(csv, "%.1f,%.1f,%.2f,%d,%d,%.0f,%lld,%.3f\n", iter->media_s, iter->real_s, iter->rss_mb, iter->fds,
+                        iter->threads, iter->queue, iter->frames, iter->frame_ms);
+            fclose(csv);
+        }
+    }
+
+    int failures = 0;
+    if (WIFSIGNALED(status))
+    {
+        printf("FAIL: the bot was killed by signal %d, see %s\n", WTERMSIG(status), log_file.c_str());
+        failures++;
+    }
+    else if (WEXITSTATUS(status) != 0)
+    {
+        printf("FAIL: the bot exited with %d, see %s\n", WEXITSTATUS(status), log_file.c_str());
+        failures++;
+    }
+    if (samples.empty())
+    {
+        printf("FAIL: no status from the bot, see %s\n", log_file.c_str());
+        failures++;
+    }
+    // the bot prints a last status line when the session ends.
+    double reached_s = samples.empty() ? 0 : samples.back().media_s;
+    const double duration_s = options.hours * 3600;
+    if (!samples.empty() && reached_s < duration_s * 0.99)
+    {
+        printf("FAIL: the bot stopped after %.1f of %.1f h of session, see %s\n", reached_s / 3600, options.hours,
+               log_file.c_str());
+        failures++;
+    }
+
+    // trends after the warm-up, in units per session hour.
+    std::vector<double> x, rss, fds, threads, queue, latency_x, latency;
+    const double warmup_s = options.warmup_min * 60.0;
+    for (auto iter = samples.begin(); iter != samples.end(); iter++)
+    {
+        if (iter->media_s < warmup_s)
+            continue;
+        double hours = iter->media_s / 3600;
+        x.push_back(hours);
+        rss.push_back(iter->rss_mb);
+        fds.push_back(iter->fds);
+        threads.push_back(iter->threads);
+        queue.push_back(iter->queue);
+        if (iter->frames > 0)
+        {
+            latency_x.push_back(hours);
+            latency.push_back(iter->frame_ms);
+        }
+    }
+    if (x.size() < 10 || x.back() - x.front() < 0.5)
+    {
+        printf("FAIL: too little session after the warm-up for trends, raise --hours or lower --warmup-min\n");
+        failures++;
+    }
+    else
+    {
+        struct Trend
+        {
+            const char *name;
+            const std::vector<double> &x;
+            const std::vector<double> &y;
+            double limit;
+            bool relative; // limit in percent of the value at the end of the warm-up
+        };
+        const Trend trends[] = {
+            {"rss MB", x, rss, options.rss_mb_per_h, false},
+            {"descriptors", x, fds, options.fd_per_h, false},
+            {"threads", x, threads, options.threads_per_h, false},
+            {"audio queue", x, queue, options.queue_per_h, false},
+            {"frame ms", latency_x, latency, options.latency_pct_per_h, true},
+        };
+        printf("%-12s %12s %12s %12s\n", "trend", "at warm-up", "per hour", "limit");
+        for (size_t index = 0; index < sizeof(trends) / sizeof(trends[0]); index++)
+        {
+            const Trend &trend = trends[index];
+            double slope, start;
+            if (!fit(trend.x, trend.y, warmup_s / 3600, &slope, &start))
+                continue;
+            double growth = trend.relative ? (start > 0 ? slope / start * 100 : 0) : slope;
+            printf("%-12s %12.2f %11.2f%s %11.2f%s\n", trend.name, start, growth, trend.relative ? "%" : " ", trend.limit,
+                   trend.relative ? "%" : " ");
+            if (growth > trend.limit)
+            {
+                printf("FAIL: %s grows %.2f%s per hour, over %.2f\n", trend.name, growth, trend.relative ? "%" : "", trend.limit);
+                failures++;
+            }
+        }
+    }
+    printf("%s after %.1f h of session in %.0f s\n", failures ? "FAILED" : "passed", reached_s / 3600,
+           duration_cast<milliseconds>(steady_clock::now() - started).count() / 1000.0);
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,646 @@
+// Microbenchmark of the stages a recorded video frame goes through:
+//   ingest   copy of the SDK's I420 planes
+//   filter   the encoder's avfilter scale graph, input size to 640x480
+//   swscale  the same scale done with swscale directly
+//   encode   H.264 at the input size with the camera settings, one result per preset
+//   mux      av_write_frame of encoded packets to a Matroska file
+//   io       fwrite and fflush of the same packets to a plain file
+// Each stage runs on every thread count given, one independent pipeline per
+// thread, and reports wall ns per frame, frames per second per CPU core and heap
+// allocations per frame. With --json every result is a JSON line.
+//   zoom_v-sdk_bench [--stages a,b] [--resolutions 90p,360p] [--threads 1,4]
+//                    [--presets ultrafast,slow] [--frames n] [--dir path] [--label text] [--json]
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <string>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+
+#define __STDC_CONSTANT_MACROS
+extern "C"
+{
+#include "libavfilter/avfiltergraph.h"
+#include "libavfilter/buffersink.h"
+#include "libavfilter/buffersrc.h"
+#include "libavutil/imgutils.h"
+#include "libavformat/avformat.h"
+#include "libavcodec/avcodec.h"
+#include "libswscale/swscale.h"
+}
+
+#include "json.hpp"
+#include "synthetic_media.h"
+#include "alloc_counter.h"
+#include "tool_helpers.h"
+
+using Json = nlohmann::json;
+using namespace std::chrono;
+
+struct Resolution
+{
+    const char *name;
+    int width;
+    int height;
+};
+
+static const Resolution resolutions[] = {
+    {"90p", 160, 90}, {"180p", 320, 180}, {"360p", 640, 360}, {"720p", 1280, 720}, {"1080p", 1920, 1080},
+};
+
+// the camera profile's output, see RawDataFFMPEGEncoder::set_camera_output_size().
+static const int camera_width = 640;
+static const int camera_height = 480;
+
+class Stage
+{
+public:
+    virtual ~Stage() {}
+    // not timed. Returns 0 on success.
+    virtual int setup(int width, int height) = 0;
+    // one frame, index counts from 0.
+    virtual int run(int64_t index) = 0;
+};
+
+// the input of every stage: a moving test picture.
+static void input_planes(int width, int height, int64_t index, uint8_t **Y, uint8_t **U, uint8_t **V)
+{
+    char *frame = const_cast<char *>(SyntheticMedia::frame(SyntheticMedia::Pattern_Camera, width, height, (int)index));
+    *Y = (uint8_t *)frame;
+    *U = *Y + width * height;
+    *V = *U + ((width + 1) / 2) * ((height + 1) / 2);
+}
+
+class IngestStage : public Stage
+{
+    int width_, height_;
+    std::vector<uint8_t> buffer_;
+
+public:
+    int setup(int width, int height)
+    {
+        width_ = width;
+        height_ = height;
+        buffer_.resize(av_image_get_buffer_size(AV_PIX_FMT_YUV420P, width, height, 1));
+        return 0;
+    }
+    int run(int64_t index)
+    {
+        uint8_t *Y, *U, *V;
+        input_planes(width_, height_, index, &Y, &U, &V);
+        size_t y_size = (size_t)width_ * height_, uv_size = (size_t)((width_ + 1) / 2) * ((height_ + 1) / 2);
+        memcpy(buffer_.data(), Y, y_size);
+        memcpy(buffer_.data() + y_size, U, uv_size);
+        memcpy(buffer_.data() + y_size + uv_size, V, uv_size);
+        return 0;
+    }
+};
+
+// the graph RawDataFFMPEGEncoder::ffmpeg_filter_init() builds, fed the way ffmpeg_filter() feeds it.
+class FilterStage : public Stage
+{
+    int width_, height_;
+    AVFilterGraph *graph_ = NULL;
+    AVFilterContext *src_ = NULL;
+    AVFilterContext *sink_ = NULL;
+    AVFrame *frame_in_ = NULL;
+    AVFrame *frame_out_ = NULL;
+
+public:
+    ~FilterStage()
+    {
+        av_frame_free(&frame_in_);
+        av_frame_free(&frame_out_);
+        avfilter_graph_free(&graph_);
+    }
+    int setup(int width, int height)
+    {
+        static const AVPixelFormat pix_fmts[] = {AV_PIX_FMT_YUV420P, AV_PIX_FMT_NONE};
+        width_ = width;
+        height_ = height;
+        graph_ = avfilter_graph_alloc();
+        char args[512];
+        snprintf(args, sizeof(args), "video_size=%dx%d:pix_fmt=%d:time_base=%d/%d:pixel_aspect=%d/%d", width, height,
+                 AV_PIX_FMT_YUV420P, 1, 25, 1, 1);
+        if (avfilter_graph_create_filter(&src_, avfilter_get_by_name("buffer"), "in", args, NULL, graph_) < 0)
+            return -1;
+        AVBufferSinkParams *params = av_buffersink_params_alloc();
+        params->pixel_fmts = pix_fmts;
+        int ret = avfilter_graph_create_filter(&sink_, avfilter_get_by_name("buffersink"), "out", NULL, params, graph_);
+        av_free(params);
+        if (ret < 0)
+            return -1;
+
+        AVFilterInOut *outputs = avfilter_inout_alloc();
+        AVFilterInOut *inputs = avfilter_inout_alloc();
+        outputs->name = av_strdup("in");
+        outputs->filter_ctx = src_;
+        outputs->pad_idx = 0;
+        outputs->next = NULL;
+        inputs->name = av_strdup("out");
+        inputs->filter_ctx = sink_;
+        inputs->pad_idx = 0;
+        inputs->next = NULL;
+        char descr[100];
+        sprintf(descr, "scale=w=%d:h=%d:in_range=mpeg:out_range=mpeg", camera_width, camera_height);
+        ret = avfilter_graph_parse_ptr(graph_, descr, &inputs, &outputs, NULL);
+        avfilter_inout_free(&inputs);
+        avfilter_inout_free(&outputs);
+        if (ret < 0 || avfilter_graph_config(graph_, NULL) < 0)
+            return -1;
+
+        frame_in_ = av_frame_alloc();
+        frame_out_ = av_frame_alloc();
+        av_image_fill_linesizes(frame_in_->linesize, AV_PIX_FMT_YUV420P, width);
+        frame_in_->format = AV_PIX_FMT_YUV420P;
+        frame_in_->width = width;
+        frame_in_->height = height;
+        return 0;
+    }
+    int run(int64_t index)
+    {
+        uint8_t *Y, *U, *V;
+        input_planes(width_, height_, index, &Y, &U, &V);
+        frame_in_->data[0] = Y;
+        frame_in_->data[1] = U;
+        frame_in_->data[2] = V;
+        frame_in_->color_range = AVCOL_RANGE_MPEG;
+        frame_in_->colorspace = AVCOL_SPC_SMPTE170M;
+        if (av_buffersrc_add_frame(src_, frame_in_) < 0 || av_buffersink_get_frame(sink_, frame_out_) < 0)
+            return -1;
+        av_frame_unref(frame_out_);
+        return 0;
+    }
+};
+
+class SwscaleStage : public Stage
+{
+    int width_, height_;
+    SwsContext *sws_ = NULL;
+    AVFrame *frame_out_ = NULL;
+
+public:
+    ~SwscaleStage()
+    {
+        sws_freeContext(sws_);
+        av_frame_free(&frame_out_);
+    }
+    int setup(int width, int height)
+    {
+        width_ = width;
+        height_ = height;
+        // bicubic like the scale filter's default.
+        sws_ = sws_getContext(width, height, AV_PIX_FMT_YUV420P, camera_width, camera_height, AV_PIX_FMT_YUV420P,
+                              SWS_BICUBIC, NULL, NULL, NULL);
+        frame_out_ = av_frame_alloc();
+        frame_out_->format = AV_PIX_FMT_YUV420P;
+        frame_out_->width = camera_width;
+        frame_out_->height = camera_height;
+        if (!sws_ || av_frame_get_buffer(frame_out_, 32) < 0)
+            return -1;
+        return 0;
+    }
+    int run(int64_t index)
+    {
+        uint8_t *Y, *U, *V;
+        input_planes(width_, height_, index, &Y, &U, &V);
+        const uint8_t *src[4] = {Y, U, V, NULL};
+        int src_stride[4] = {width_, (width_ + 1) / 2, (width_ + 1) / 2, 0};
+        sws_scale(sws_, src, src_stride, 0, height_, frame_out_->data, frame_out_->linesize);
+        return 0;
+    }
+};
+
+// an H.264 encoder with the camera profile's settings, see RawDataFFMPEGEncoder::ffmpeg_start().
+static AVCodecContext *open_encoder(int width, int height, const char *preset)
+{
+    AVCodec *codec = avcodec_find_encoder(AV_CODEC_ID_H264);
+    if (!codec)
+        return NULL;
+    AVCodecContext *ctx = avcodec_alloc_context3(codec);
+    ctx->pix_fmt = AV_PIX_FMT_YUV420P;
+    ctx->width = width;
+    ctx->height = height;
+    ctx->bit_rate = 400000;
+    ctx->gop_size = 250;
+    ctx->time_base.num = 1;
+    ctx->time_base.den = 25;
+    ctx->qmin = 10;
+    ctx->qmax = 51;
+    ctx->max_b_frames = 3;
+    ctx->color_range = AVCOL_RANGE_MPEG;
+    ctx->colorspace = AVCOL_SPC_SMPTE170M;
+    AVDictionary *param = NULL;
+    av_dict_set(&param, "preset", preset, 0);
+    av_dict_set(&param, "tune", "zerolatency", 0);
+    int ret = avcodec_open2(ctx, codec, &param);
+    av_dict_free(&param);
+    if (ret < 0)
+    {
+        avcodec_free_context(&ctx);
+        return NULL;
+    }
+    return ctx;
+}
+
+class EncodeStage : public Stage
+{
+    std::string preset_;
+    int width_, height_;
+    AVCodecContext *ctx_ = NULL;
+    AVFrame *frame_ = NULL;
+    AVPacket pkt_;
+
+public:
+    EncodeStage(const std::string &preset) : preset_(preset) {}
+    ~EncodeStage()
+    {
+        av_frame_free(&frame_);
+        if (ctx_)
+            avcodec_close(ctx_);
+        avcodec_free_context(&ctx_);
+    }
+    int setup(int width, int height)
+    {
+        width_ = width;
+        height_ = height;
+        ctx_ = open_encoder(width, height, preset_.c_str());
+        if (!ctx_)
+            return -1;
+        frame_ = av_frame_alloc();
+        frame_->format = AV_PIX_FMT_YUV420P;
+        frame_->width = width;
+        frame_->height = height;
+        av_image_fill_linesizes(frame_->linesize, AV_PIX_FMT_YUV420P, width);
+        return 0;
+    }
+    int run(int64_t index)
+    {
+        uint8_t *Y, *U, *V;
+        input_planes(width_, height_, index, &Y, &U, &V);
+        frame_->data[0] = Y;
+        frame_->data[1] = U;
+        frame_->data[2] = V;
+        frame_->pts = index;
+        av_init_packet(&pkt_);
+        pkt_.data = NULL;
+        pkt_.size = 0;
+        int got_packet = 0;
+        if (avcodec_encode_video2(ctx_, &pkt_, frame_, &got_packet) < 0)
+            return -1;
+        if (got_packet)
+            av_packet_unref(&pkt_);
+        return 0;
+    }
+};
+
+// encoded packets for the mux and io stages, encoded once in setup.
+struct PacketPool
+{
+    std::vector<std::vector<uint8_t> > data;
+    std::vector<bool> key;
+
+    int fill(int width, int height, int count)
+    {
+        AVCodecContext *ctx = open_encoder(width, height, "ultrafast");
+        if (!ctx)
+            return -1;
+        AVFrame *frame = av_frame_alloc();
+        frame->format = AV_PIX_FMT_YUV420P;
+        frame->width = width;
+        frame->height = height;
+        av_image_fill_linesizes(frame->linesize, AV_PIX_FMT_YUV420P, width);
+        for (int index = 0; index < count; index++)
+        {
+            uint8_t *Y, *U, *V;
+            input_planes(width, height, index, &Y, &U, &V);
+            frame->data[0] = Y;
+            frame->data[1] = U;
+            frame->data[2] = V;
+            frame->pts = index;
+            AVPacket pkt;
+            av_init_packet(&pkt);
+            pkt.data = NULL;
+            pkt.size = 0;
+            int got_packet = 0;
+            if (avcodec_encode_video2(ctx, &pkt, frame, &got_packet) == 0 && got_packet)
+            {
+                data.push_back(std::vector<uint8_t>(pkt.data, pkt.data + pkt.size));
+                key.push_back((pkt.flags & AV_PKT_FLAG_KEY) != 0);
+                av_packet_unref(&pkt);
+            }
+        }
+        av_frame_free(&frame);
+        avcodec_close(ctx);
+        avcodec_free_context(&ctx);
+        return data.empty() ? -1 : 0;
+    }
+};
+
+class MuxStage : public Stage
+{
+    std::string file_;
+    PacketPool pool_;
+    AVFormatContext *fmt_ctx_ = NULL;
+    AVStream *st_ = NULL;
+
+public:
+    MuxStage(const std::string &file) : file_(file) {}
+    ~MuxStage()
+    {
+        if (fmt_ctx_)
+        {
+            av_write_trailer(fmt_ctx_);
+            avio_closep(&fmt_ctx_->pb);
+            avformat_free_context(fmt_ctx_);
+        }
+        unlink(file_.c_str());
+    }
+    int setup(int width, int height)
+    {
+        if (pool_.fill(width, height, 50) != 0)
+            return -1;
+        // the stream is set up like the encoder sets up its own.
+        fmt_ctx_ = avformat_alloc_context();
+        fmt_ctx_->oformat = av_guess_format(NULL, file_.c_str(), NULL);
+        if (!fmt_ctx_->oformat || avio_open(&fmt_ctx_->pb, file_.c_str(), AVIO_FLAG_WRITE) < 0)
+            return -1;
+        st_ = avformat_new_stream(fmt_ctx_, 0);
+        st_->codec->codec_id = AV_CODEC_ID_H264;
+        st_->codec->codec_type = AVMEDIA_TYPE_VIDEO;
+        st_->codec->pix_fmt = AV_PIX_FMT_YUV420P;
+        st_->codec->width = width;
+        st_->codec->height = height;
+        st_->codec->time_base.num = 1;
+        st_->codec->time_base.den = 25;
+        st_->time_base = st_->codec->time_base;
+        return avformat_write_header(fmt_ctx_, NULL) < 0 ? -1 : 0;
+    }
+    int run(int64_t index)
+    {
+        size_t slot = index % pool_.data.size();
+        AVPacket pkt;
+        av_init_packet(&pkt);
+        pkt.data = pool_.data[slot].data();
+        pkt.size = pool_.data[slot].size();
+        pkt.flags = pool_.key[slot] ? AV_PKT_FLAG_KEY : 0;
+        pkt.stream_index = st_->index;
+        pkt.pts = pkt.dts = av_rescale_q(index, st_->codec->time_base, st_->time_base);
+        return av_write_frame(fmt_ctx_, &pkt) < 0 ? -1 : 0;
+    }
+};
+
+class IoStage : public Stage
+{
+    std::string file_;
+    PacketPool pool_;
+    FILE *fp_ = NULL;
+
+public:
+    IoStage(const std::string &file) : file_(file) {}
+    ~IoStage()
+    {
+        if (fp_)
+            fclose(fp_);
+        unlink(file_.c_str());
+    }
+    int setup(int width, int height)
+    {
+        if (pool_.fill(width, height, 50) != 0)
+            return -1;
+        fp_ = fopen(file_.c_str(), "wb");
+        return fp_ ? 0 : -1;
+    }
+    int run(int64_t index)
+    {
+        const std::vector<uint8_t> &packet = pool_.data[index % pool_.data.size()];
+        if (fwrite(packet.data(), 1, packet.size(), fp_) != packet.size())
+            return -1;
+        return fflush(fp_);
+    }
+};
+
+struct Options
+{
+    int frames = 0; // 0: per stage default
+    std::string dir = "/tmp";
+    std::string label;
+    bool json = false;
+};
+
+// the stages make_stage builds, in pipeline order.
+static const char *const stage_list[] = {"ingest", "filter", "swscale", "encode", "mux", "io"};
+
+static bool known_stage(const std::string &stage)
+{
+    for (size_t index = 0; index < sizeof(stage_list) / sizeof(stage_list[0]); index++)
+    {
+        if (stage == stage_list[index])
+            return true;
+    }
+    return false;
+}
+
+static Stage *make_stage(const std::string &stage, const std::string &variant, const std::string &file)
+{
+    if (stage == "ingest")
+        return new IngestStage();
+    if (stage == "filter")
+        return new FilterStage();
+    if (stage == "swscale")
+        return new SwscaleStage();
+    if (stage == "encode")
+        return new EncodeStage(variant);
+    if (stage == "mux")
+        return new MuxStage(file + ".mkv");
+    if (stage == "io")
+        return new IoStage(file + ".h264");
+    return NULL;
+}
+
+// one result: threads pipelines of the stage side by side, started together.
+static int bench(const std::string &stage, const std::string &variant, const Resolution &res, int threads,
+                 const Options &options)
+{
+    int frames = options.frames;
+    if (frames <= 0)
+        frames = stage == "encode" ? 200 : 2000;
+
+    std::vector<Stage *> stages;
+    for (int index = 0; index < threads; index++)
+    {
+        std::string file = options.dir + "/zoom_v-sdk_bench_" + std::to_string(getpid()) + "_" + std::to_string(index);
+        Stage *s = make_stage(stage, variant, file);
+        // a few frames outside the measurement warm caches and lazy initialization.
+        bool ok = s && s->setup(res.width, res.height) == 0;
+        for (int warm = 0; ok && warm < 8; warm++)
+            ok = s->run(warm) == 0;
+        if (s)
+            stages.push_back(s);
+        if (!ok)
+        {
+            printf("Error setting up stage %s %s at %s.\n", stage.c_str(), variant.c_str(), res.name);
+            for (auto iter = stages.begin(); iter != stages.end(); iter++)
+                delete *iter;
+            return -1;
+        }
+    }
+
+    std::mutex mutex;
+    std::condition_variable cond;
+    bool go = false;
+    int failed = 0;
+    std::vector<std::thread> workers;
+    for (int index = 0; index < threads; index++)
+    {
+        workers.push_back(std::thread([&, index]() {
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                cond.wait(lock, [&go] { return go; });
+            }
+            for (int64_t frame = 8; frame < frames + 8; frame++)
+            {
+                if (stages[index]->run(frame) != 0)
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    failed++;
+                    break;
+                }
+            }
+        }));
+    }
+
+    uint64_t allocations = AllocCounter::allocations();
+    double cpu = cpu_seconds();
+    steady_clock::time_point start = steady_clock::now();
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        go = true;
+        cond.notify_all();
+    }
+    for (auto iter = workers.begin(); iter != workers.end(); iter++)
+        iter->join();
+    double wall = duration_cast<nanoseconds>(steady_clock::now() - start).count() / 1e9;
+    cpu = cpu_seconds() - cpu;
+    allocations = AllocCounter::allocations() - allocations;
+    for (auto iter = stages.begin(); iter != stages.end(); iter++)
+        delete *iter;
+    if (failed)
+    {
+        printf("Error running stage %s %s at %s.\n", stage.c_str(), variant.c_str(), res.name);
+        return -1;
+    }
+
+    int64_t total = (int64_t)frames * threads;
+    double ns_per_frame = wall * 1e9 / frames;
+    double per_core = cpu > 0 ? total / cpu : 0;
+    double allocs_per_frame = (double)allocations / total;
+    if (options.json)
+    {
+        Json result;
+        result["label"] = options.label;
+        result["stage"] = stage;
+        result["variant"] = variant;
+        result["resolution"] = res.name;
+        result["width"] = res.width;
+        result["height"] = res.height;
+        result["threads"] = threads;
+        result["frames"] = total;
+        result["ns_per_frame"] = (int64_t)ns_per_frame;
+        result["frames_per_sec_per_core"] = per_core;
+        result["allocs_per_frame"] = allocs_per_frame;
+        printf("%s\n", result.dump().c_str());
+    }
+    else
+    {
+        printf("%-8s %-10s %-6s %3d threads %12.0f ns/frame %10.1f frames/s/core %8.2f allocs/frame\n", stage.c_str(),
+               variant.c_str(), res.name, threads, ns_per_frame, per_core, allocs_per_frame);
+    }
+    fflush(stdout);
+    return 0;
+}
+
+static void usage()
+{
+    printf("usage: zoom_v-sdk_bench [--stages ingest,filter,swscale,encode,mux,io] [--resolutions 90p,180p,360p,720p,1080p]\n"
+           "                        [--threads 1,2,4] [--presets ultrafast,veryfast,medium,slow] [--frames n]\n"
+           "                        [--dir path] [--label text] [--json]\n");
+}
+
+int main(int argc, char *argv[])
+{
+    std::vector<std::string> stage_names = split("ingest,filter,swscale,encode,mux,io");
+    std::vector<std::string> resolution_names = split("90p,180p,360p,720p,1080p");
+    std::vector<std::string> thread_counts = split("1");
+    // the camera profile uses slow, the share and composed views veryfast.
+    std::vector<std::string> presets = split("ultrafast,veryfast,medium,slow");
+    Options options;
+    for (int index = 1; index < argc; index++)
+    {
+        bool has_value = index + 1 < argc;
+        if (strcmp(argv[index], "--stages") == 0 && has_value)
+            stage_names = split(argv[++index]);
+        else if (strcmp(argv[index], "--resolutions") == 0 && has_value)
+            resolution_names = split(argv[++index]);
+        else if (strcmp(argv[index], "--threads") == 0 && has_value)
+            thread_counts = split(argv[++index]);
+        else if (strcmp(argv[index], "--presets") == 0 && has_value)
+            presets = split(argv[++index]);
+        else if (strcmp(argv[index], "--frames") == 0 && has_value)
+            options.frames = atoi(argv[++index]);
+        else if (strcmp(argv[index], "--dir") == 0 && has_value)
+            options.dir = argv[++index];
+        else if (strcmp(argv[index], "--label") == 0 && has_value)
+            options.label = argv[++index];
+        else if (strcmp(argv[index], "--json") == 0)
+            options.json = true;
+        else
+        {
+            usage();
+            return 1;
+        }
+    }
+
+    av_log_set_level(AV_LOG_ERROR);
+    av_register_all();
+    avfilter_register_all();
+
+    int errors = 0;
+    for (auto stage = stage_names.begin(); stage != stage_names.end(); stage++)
+    {
+        std::vector<std::string> variants = *stage == "encode" ? presets : std::vector<std::string>(1, "");
+        for (auto name = resolution_names.begin(); name != resolution_names.end(); name++)
+        {
+            const Resolution *res = NULL;
+            for (size_t index = 0; index < sizeof(resolutions) / sizeof(resolutions[0]); index++)
+            {
+                if (*name == resolutions[index].name)
+                    res = &resolutions[index];
+            }
+            if (!res)
+            {
+                printf("Unknown resolution %s.\n", name->c_str());
+                return 1;
+            }
+            for (auto variant = variants.begin(); variant != variants.end(); variant++)
+            {
+                for (auto threads = thread_counts.begin(); threads != thread_counts.end(); threads++)
+                {
+                    int count = atoi(threads->c_str());
+                    if (count <= 0 || !known_stage(*stage))
+                    {
+                        usage();
+                        return 1;
+                    }
+                    if (bench(*stage, *variant, *res, count, options) != 0)
+                        errors++;
+                }
+            }
+        }
+    }
+    return errors ? 1 : 0;
+}
@@ -0,0 +1,49 @@
+#include "tool_helpers.h"
+#include <string.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/resource.h>
+
+std::vector<std::string> split(const char *list)
+{
+	std::vector<std::string> items;
+	std::string item;
+	for (const char *c = list;; c++)
+	{
+		if (*c == ',' || *c == 0)
+		{
+			if (!item.empty())
+				items.push_back(item);
+			item.clear();
+			if (*c == 0)
+				break;
+		}
+		else
+		{
+			item += *c;
+		}
+	}
+	return items;
+}
+
+double cpu_seconds()
+{
+	struct rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+	return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec + (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6;
+}
+
+void remove_recordings(const std::string &dir)
+{
+	DIR *d = opendir(dir.c_str());
+	if (!d)
+		return;
+	struct dirent *entry;
+	while ((entry = readdir(d)) != NULL)
+	{
+		size_t length = strlen(entry->d_name);
+		if (length > 4 && (strcmp(entry->d_name + length - 4, ".mkv") == 0 || strcmp(entry->d_name + length - 4, ".mka") == 0))
+			unlink((dir + "/" + entry->d_name).c_str());
+	}
+	closedir(d);
+}
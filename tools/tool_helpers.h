@@ -0,0 +1,14 @@
+#pragma once
+#include <string>
+#include <vector>
+
+// Small helpers shared by the benchmark and test tools.
+
+// the non-empty items of a comma separated list.
+std::vector<std::string> split(const char* list);
+
+// user and system time of the process so far.
+double cpu_seconds();
+
+// deletes the .mkv and .mka files in dir; files still open are freed when their writer closes them.
+void remove_recordings(const std::string& dir);